@@ -0,0 +1,35 @@
+# Writes OUTPUT, a header embedding the SPIR-V binary INPUT as the constexpr
+# array shaders::SYMBOL. Run with cmake -P; see CMakeLists.txt.
+
+file(READ ${INPUT} HEX_CONTENTS HEX)
+string(LENGTH "${HEX_CONTENTS}" HEX_LENGTH)
+math(EXPR TRAILING_DIGITS "${HEX_LENGTH} % 8")
+if(HEX_LENGTH EQUAL 0 OR NOT TRAILING_DIGITS EQUAL 0)
+    message(FATAL_ERROR "${INPUT} is not a SPIR-V binary.")
+endif()
+
+# SPIR-V is a sequence of little-endian 32-bit words; write eight per line.
+string(REGEX REPLACE "(..)(..)(..)(..)" "0x\\4\\3\\2\\1, " WORDS "${HEX_CONTENTS}")
+# CMake regular expressions have no {n} repetition, so spell it out.
+string(REPEAT "0x[0-9a-f]+, " 7 LINE_PATTERN)
+string(REGEX REPLACE "(${LINE_PATTERN}0x[0-9a-f]+,) " "\\1\n    " WORDS "${WORDS}")
+string(STRIP "${WORDS}" WORDS)
+
+set(GUARD "${SYMBOL}_SPV_H_")
+file(WRITE ${OUTPUT}
+    "// Generated from ${SOURCE} by embed_spirv.cmake; do not edit.\n"
+    "\n"
+    "#ifndef ${GUARD}\n"
+    "#define ${GUARD}\n"
+    "\n"
+    "#include <cstdint>\n"
+    "\n"
+    "namespace shaders {\n"
+    "\n"
+    "inline constexpr uint32_t ${SYMBOL}[] = {\n"
+    "    ${WORDS}\n"
+    "};\n"
+    "\n"
+    "} // namespace shaders\n"
+    "\n"
+    "#endif // ${GUARD}\n")
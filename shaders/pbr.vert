@@ -9,12 +9,18 @@ layout(set = 0, binding = 0) uniform CameraUniform {
     vec3 viewerPos;
 } cameraUbo;
 
-layout(set = 1, binding = 0) uniform ModelUniform {
-    mat4 model;
-    vec3 meshColor;
+struct ModelData {
+    mat4  model;
+    vec3  meshColor;
     float roughness;
     float metallic;
-} modelUbo;
+};
+
+// Data of every mesh in the scene; each draw's firstInstance is its mesh's
+// index.
+layout(std430, set = 1, binding = 0) readonly buffer ModelStorage {
+    ModelData models[];
+};
 
 // Inputs.
 
@@ -28,13 +34,31 @@ layout(location = 4) in vec3 inNormal;
 
 layout(location = 0) out vec3 vOutColor;
 
+// Specialization constants; see GlfwVulkanWrapper::PipelineVariant.
+
+const int MAX_LIGHTS = 4;
+layout(constant_id = 1) const int NUM_LIGHTS = 2;
+
+// World-space light positions; only the first NUM_LIGHTS are used.
+layout(constant_id = 2) const float LIGHT0_X = -1.0;
+layout(constant_id = 3) const float LIGHT0_Y = 5.0;
+layout(constant_id = 4) const float LIGHT0_Z = 1.0;
+layout(constant_id = 5) const float LIGHT1_X = 1.0;
+layout(constant_id = 6) const float LIGHT1_Y = 4.0;
+layout(constant_id = 7) const float LIGHT1_Z = 1.0;
+layout(constant_id = 8) const float LIGHT2_X = 0.0;
+layout(constant_id = 9) const float LIGHT2_Y = 5.0;
+layout(constant_id = 10) const float LIGHT2_Z = -2.0;
+layout(constant_id = 11) const float LIGHT3_X = 0.0;
+layout(constant_id = 12) const float LIGHT3_Y = 3.0;
+layout(constant_id = 13) const float LIGHT3_Z = 3.0;
+
 // Constants.
 
 const float PI = 3.14159265359;
-const vec3 lightPos[2] = {vec3(-1.0, 5.0, 1.0), vec3(1.0, 4.0, 1.0)};
 
 // Cited as RGB for noon sunlight.
-const vec3 lightColors[2] = {vec3(1.0, 1.0, 0.9843), vec3(1.0, 1.0, 0.9843)};
+const vec3 LIGHT_COLOR = vec3(1.0, 1.0, 0.9843);
 
 // ---------
 
@@ -46,30 +70,39 @@ float GeometrySmith(vec3 N, vec3 V, vec3 L, float roughness);
 vec3 fresnelSchlick(float cosTheta, vec3 F0);
 
 void main() {
-    vec3 worldPos = vec3(modelUbo.model * vec4(inPosition, 1.0));
+    ModelData modelData = models[gl_InstanceIndex];
+
+    vec3 lightPos[MAX_LIGHTS] = {
+        vec3(LIGHT0_X, LIGHT0_Y, LIGHT0_Z),
+        vec3(LIGHT1_X, LIGHT1_Y, LIGHT1_Z),
+        vec3(LIGHT2_X, LIGHT2_Y, LIGHT2_Z),
+        vec3(LIGHT3_X, LIGHT3_Y, LIGHT3_Z),
+    };
+
+    vec3 worldPos = vec3(modelData.model * vec4(inPosition, 1.0));
     vec3 V = normalize(cameraUbo.viewerPos - worldPos);
-    vec3 N = mat3(modelUbo.model) * inNormal;
+    vec3 N = mat3(modelData.model) * inNormal;
 
-    vec3 albedo = modelUbo.meshColor;
+    vec3 albedo = modelData.meshColor;
     vec3 F0 = vec3(0.04);
-    F0 = mix(F0, albedo, modelUbo.metallic);
+    F0 = mix(F0, albedo, modelData.metallic);
 
     vec3 Lo = vec3(0.0);
-    for(int i = 0; i < 2; ++i)
+    for(int i = 0; i < NUM_LIGHTS; ++i)
     {
         vec3 L = normalize(lightPos[i] - worldPos);
         vec3 H = normalize(V + L);
         float distance    = length(L);
         float attenuation = 1.0 / (distance * distance);
-        vec3 radiance     = lightColors[i] * attenuation;
+        vec3 radiance     = LIGHT_COLOR * attenuation;
 
-        float NDF = DistributionGGX(N, H, modelUbo.roughness);
-        float G   = GeometrySmith(N, V, L, modelUbo.roughness);
+        float NDF = DistributionGGX(N, H, modelData.roughness);
+        float G   = GeometrySmith(N, V, L, modelData.roughness);
         vec3 F    = fresnelSchlick(max(dot(H, V), 0.0), F0);
 
         vec3 kS = F;
         vec3 kD = vec3(1.0) - kS;
-        kD *= 1.0 - modelUbo.metallic;
+        kD *= 1.0 - modelData.metallic;
 
         vec3 numerator    = NDF * G * F;
         float denominator = 4.0 * max(dot(N, V), 0.0) * max(dot(N, L), 0.0) + 0.0001;
@@ -9,23 +9,48 @@ layout(set = 0, binding = 0) uniform CameraUniform {
     vec3 _viewerPos;
 } cameraUbo;
 
-layout(set = 1, binding = 0) uniform ModelUniform {
+struct ModelData {
     mat4  _model;
     vec3  meshColor;
     float roughness;
     float metallic;
-    int   colorEffect;
-} modelUbo;
+    uint  normalMapped;
+};
+
+// Data of every mesh in the scene; each draw's firstInstance is its mesh's
+// index.
+layout(std430, set = 1, binding = 0) readonly buffer ModelStorage {
+    ModelData models[];
+};
+
+// Gradients (dy/dx, dy/dz) of the current graph over the unit square; see
+// NormalMap. Only read by models with normalMapped set.
+layout(set = 2, binding = 0) uniform sampler2D normalMap;
+
+// Specialization constants; see GlfwVulkanWrapper::PipelineVariant.
+
+// Color effects:
+//  0 = none
+//  1 = color blend based on world y-value
+//  2 = color blend based on tangent y-value
+layout(constant_id = 0) const int COLOR_EFFECT = 0;
+
+const int MAX_LIGHTS = 4;
+layout(constant_id = 1) const int NUM_LIGHTS = 2;
 
 // Inputs.
 
 struct VertexOut {
-    vec3 tangentLightOffset[2];
+    vec3 tangentLightOffset[MAX_LIGHTS];
     vec3 tangentViewOffset;
     vec3 worldPosition;
 };
 
 layout(location = 0) in VertexOut vIn;
+layout(location = 6) flat in int vInModelIndex;
+// Mesh position and vertex normal before the model transform.
+layout(location = 7) in vec3 vInModelPosition;
+layout(location = 8) in vec3 vInModelNormal;
 
 // Outputs.
 
@@ -38,9 +63,6 @@ const float PI = 3.14159265359;
 // Cited as RGB for noon sunlight.
 const vec3 LIGHT_COLOR = vec3(1.0, 1.0, 0.9843);
 
-// For now we give everything an outward unit normal.
-const vec3 N = vec3(0.0, 0.0, 1.0);
-
 // ---------
 
 // Credit: The code here is adapted from the example on learnopengl.com.
@@ -50,20 +72,37 @@ float GeometrySchlickGGX(float NdotV, float roughness);
 float GeometrySmith(vec3 N, vec3 V, vec3 L, float roughness);
 vec3 fresnelSchlick(float cosTheta, vec3 F0);
 
+// The normal from the normal map, in the tangent space of the interpolated
+// vertex normal. That frame is rebuilt as FunctionMesh builds it, and the
+// model transform, a rotation, leaves its components unchanged.
+vec3 mappedNormal()
+{
+    vec2 gradient = texture(normalMap, vInModelPosition.xz).rg;
+    vec3 mapNormal = normalize(vec3(-gradient.x, 1.0, -gradient.y));
+
+    vec3 normal = normalize(vInModelNormal);
+    vec3 tangent = normalize(vec3(1.0, 0.0, 0.0) - normal.x * normal);
+    vec3 bitangent = normalize(vec3(0.0, 0.0, 1.0) - normal.z * normal - tangent.z * tangent);
+    return normalize(vec3(dot(tangent, mapNormal), dot(bitangent, mapNormal), dot(normal, mapNormal)));
+}
+
 void main() {
+    ModelData modelData = models[vInModelIndex];
+
+    // Otherwise the vertex normal, which is the tangent frame's z-axis.
+    vec3 N = modelData.normalMapped != 0 ? mappedNormal() : vec3(0.0, 0.0, 1.0);
+
     vec3 V = normalize(vIn.tangentViewOffset);
     vec3 albedo;
 
-    // Color effects:
-    //  0 = none
-    //  1 = color blend based on tangent y-value
-    //  2 = color blend based on world y-value
-    if (modelUbo.colorEffect == 2)
+    // COLOR_EFFECT is fixed when the pipeline is compiled, so the driver
+    // removes the branches not taken.
+    if (COLOR_EFFECT == 2)
     {
         float t = (V.y + 1.0) * 0.5;
         albedo =  t * vec3(0.0, 0.0, 1.0) + (1.0 - t) * vec3(1.0, 0.0, 0.0);
     }
-    else if (modelUbo.colorEffect == 1)
+    else if (COLOR_EFFECT == 1)
     {
         vec3 worldPos = vIn.worldPosition;
         float t = clamp((worldPos.y + 0.5) * 1.25, 0.0, 1.0);
@@ -71,14 +110,14 @@ void main() {
     }
     else
     {
-        albedo = modelUbo.meshColor;
+        albedo = modelData.meshColor;
     }
 
     vec3 F0 = vec3(0.04);
-    F0 = mix(F0, albedo, modelUbo.metallic);
+    F0 = mix(F0, albedo, modelData.metallic);
 
     vec3 Lo = vec3(0.0);
-    for(int i = 0; i < 2; ++i)
+    for(int i = 0; i < NUM_LIGHTS; ++i)
     {
         vec3 L = normalize(vIn.tangentLightOffset[i]);
         vec3 H = normalize(V + L);
@@ -86,13 +125,13 @@ void main() {
         float attenuation = 1.0 / (distance * distance);
         vec3 radiance     = LIGHT_COLOR * attenuation;
 
-        float NDF = DistributionGGX(N, H, modelUbo.roughness);
-        float G   = GeometrySmith(N, V, L, modelUbo.roughness);
+        float NDF = DistributionGGX(N, H, modelData.roughness);
+        float G   = GeometrySmith(N, V, L, modelData.roughness);
         vec3 F    = fresnelSchlick(max(dot(H, V), 0.0), F0);
 
         vec3 kS = F;
         vec3 kD = vec3(1.0) - kS;
-        kD *= 1.0 - modelUbo.metallic;
+        kD *= 1.0 - modelData.metallic;
 
         vec3 numerator    = NDF * G * F;
         float denominator = 4.0 * max(dot(N, V), 0.0) * max(dot(N, L), 0.0) + 0.0001;
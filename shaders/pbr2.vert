@@ -9,13 +9,37 @@ layout(set = 0, binding = 0) uniform CameraUniform {
     vec3 viewerPos;
 } cameraUbo;
 
-layout(set = 1, binding = 0) uniform ModelUniform {
+struct ModelData {
     mat4  model;
     vec3  _meshColor;
     float _roughness;
     float _metallic;
-    int   _colorEffect;
-} modelUbo;
+};
+
+// Data of every mesh in the scene; each draw's firstInstance is its mesh's
+// index.
+layout(std430, set = 1, binding = 0) readonly buffer ModelStorage {
+    ModelData models[];
+};
+
+// Specialization constants; see GlfwVulkanWrapper::PipelineVariant.
+
+const int MAX_LIGHTS = 4;
+layout(constant_id = 1) const int NUM_LIGHTS = 2;
+
+// World-space light positions; only the first NUM_LIGHTS are used.
+layout(constant_id = 2) const float LIGHT0_X = -2.0;
+layout(constant_id = 3) const float LIGHT0_Y = 5.0;
+layout(constant_id = 4) const float LIGHT0_Z = 2.0;
+layout(constant_id = 5) const float LIGHT1_X = 2.0;
+layout(constant_id = 6) const float LIGHT1_Y = 5.0;
+layout(constant_id = 7) const float LIGHT1_Z = 2.0;
+layout(constant_id = 8) const float LIGHT2_X = 0.0;
+layout(constant_id = 9) const float LIGHT2_Y = 5.0;
+layout(constant_id = 10) const float LIGHT2_Z = -2.0;
+layout(constant_id = 11) const float LIGHT3_X = 0.0;
+layout(constant_id = 12) const float LIGHT3_Y = 3.0;
+layout(constant_id = 13) const float LIGHT3_Z = 3.0;
 
 // Inputs.
 
@@ -28,29 +52,41 @@ layout(location = 4) in vec3 inNormal;
 // Outputs.
 
 struct VertexOut {
-    vec3 tangentLightOffset[2];
+    vec3 tangentLightOffset[MAX_LIGHTS];
     vec3 tangentViewOffset;
     vec3 worldPosition;
 };
 
 layout(location = 0) out VertexOut vOut;
+layout(location = 6) flat out int vOutModelIndex;
+// For the normal map; see pbr2.frag.
+layout(location = 7) out vec3 vOutModelPosition;
+layout(location = 8) out vec3 vOutModelNormal;
 
-// Constants.
+void main() {
+    ModelData modelData = models[gl_InstanceIndex];
+    vOutModelIndex = gl_InstanceIndex;
+    vOutModelPosition = inPosition;
+    vOutModelNormal = inNormal;
 
-const vec3 lightPos[2] = {vec3(-2.0, 5.0, 2.0), vec3(2.0, 5.0, 2.0)};
+    vec3 lightPos[MAX_LIGHTS] = {
+        vec3(LIGHT0_X, LIGHT0_Y, LIGHT0_Z),
+        vec3(LIGHT1_X, LIGHT1_Y, LIGHT1_Z),
+        vec3(LIGHT2_X, LIGHT2_Y, LIGHT2_Z),
+        vec3(LIGHT3_X, LIGHT3_Y, LIGHT3_Z),
+    };
 
-void main() {
-    vec4 worldPos = modelUbo.model * vec4(inPosition, 1.0);
+    vec4 worldPos = modelData.model * vec4(inPosition, 1.0);
     gl_Position = cameraUbo.proj * cameraUbo.view * worldPos;
     vOut.worldPosition = worldPos.xyz;
 
-    mat3 modelRot = mat3(modelUbo.model);
+    mat3 modelRot = mat3(modelData.model);
     vec3 T = modelRot * inTangent;
     vec3 B = modelRot * inBitangent;
     vec3 N = modelRot * inNormal;
 
     mat3 TBNt = transpose(mat3(T, B, N));
-    for (int i = 0; i < 2; ++i)
+    for (int i = 0; i < NUM_LIGHTS; ++i)
     {
         vOut.tangentLightOffset[i] = TBNt * (lightPos[i] - vec3(worldPos));
     }
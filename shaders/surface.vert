@@ -0,0 +1,32 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Corners of the patches of a HeightField, for surface.tesc and
+// surface.tese. There is no vertex input: vertex i is corner i % 4 of patch
+// i / 4, and patches are numbered row by row along x.
+
+// Uniforms.
+
+// Heights over the unit square; see HeightField.
+layout(set = 3, binding = 0) uniform sampler2D heights;
+
+// Must match HeightField::PATCHES.
+const int PATCHES = 32;
+
+// In the order of the corners of the quad tessellation domain.
+const vec2 CORNERS[4] = vec2[](vec2(0.0, 0.0), vec2(1.0, 0.0), vec2(1.0, 1.0), vec2(0.0, 1.0));
+
+// Outputs.
+
+layout(location = 0) out vec3 vOutPosition;
+layout(location = 1) flat out int vOutModelIndex;
+
+void main() {
+    int patchIndex = gl_VertexIndex / 4;
+    vec2 xz = (vec2(patchIndex % PATCHES, patchIndex / PATCHES) + CORNERS[gl_VertexIndex % 4]) / float(PATCHES);
+
+    // Corners are grid points.
+    ivec2 texel = ivec2(round(xz * vec2(textureSize(heights, 0) - 1)));
+    vOutPosition = vec3(xz.x, texelFetch(heights, texel, 0).r, xz.y);
+    vOutModelIndex = gl_InstanceIndex;
+}
@@ -8,12 +8,18 @@ layout(set = 0, binding = 0) uniform CameraUniform {
     vec3 viewerPos;
 } cameraUbo;
 
-layout(set = 1, binding = 0) uniform ModelUniform {
-    mat4 model;
-    vec3 meshColor;
+struct ModelData {
+    mat4  model;
+    vec3  meshColor;
     float _roughness;
     float _metallic;
-} modelUbo;
+};
+
+// Data of every mesh in the scene; each draw's firstInstance is its mesh's
+// index.
+layout(std430, set = 1, binding = 0) readonly buffer ModelStorage {
+    ModelData models[];
+};
 
 // Inputs.
 layout(location = 0) in vec3 inPosition;
@@ -26,6 +32,7 @@ layout(location = 4) in vec3 inNormal;
 layout(location = 0) out vec3 fragColor;
 
 void main() {
-    gl_Position = cameraUbo.proj * cameraUbo.view * modelUbo.model * vec4(inPosition, 1.0);
+    ModelData modelData = models[gl_InstanceIndex];
+    gl_Position = cameraUbo.proj * cameraUbo.view * modelData.model * vec4(inPosition, 1.0);
     fragColor = inColor;
 }
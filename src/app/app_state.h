@@ -93,11 +93,30 @@ struct AppState {
     bool functionInputCursorReset                          = false;
 
     // Render preferences.
-    bool rotating        = false;
-    bool wireframe       = false;
-    bool pbrFragPipeline = true;
-    bool drawFloor       = false;
-    bool resetPosition   = false;
+    bool rotating          = false;
+    bool wireframe         = false;
+    bool pbrFragPipeline   = true;
+    bool drawFloor         = false;
+    bool resetPosition     = false;
+    bool pinGraph          = false;
+    bool clearPinnedGraphs = false;
+
+    // Largest projected height error, in pixels, of the mesh levels of
+    // detail drawn, and of the tessellated surface.
+    float lodPixelError = 1.0f;
+
+    // Draw built-in generator graphs by GPU tessellation of a height field
+    // instead of building meshes; see HeightField.
+    bool tessellatedSurface = false;
+
+    // Shade built-in generator graphs with normals from a texture much
+    // finer than the mesh; see NormalMap. Only evaluated while the graph
+    // pipeline samples it; see normalMapSampled.
+    bool normalMap = true;
+
+    // Scene lighting. Each light count is a separate pipeline variant.
+    static constexpr int MAX_LIGHTS = 4;
+    int numLights                   = 2;
 
     // Mesh parameters.
     glm::vec3 graphColor = {0.0f, 0.13f, 0.94f};
@@ -135,6 +154,11 @@ public:
         return static_cast<size_t>(colorEffect);
     }
 
+    // Only the per-fragment PBR graph pipeline reads the normal map.
+    bool normalMapSampled() const {
+        return normalMap && pbrFragPipeline && !wireframe;
+    }
+
     size_t textBufferLen() {
         return std::strlen(functionInputBuffer.data());
     }
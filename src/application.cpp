@@ -1,9 +1,12 @@
 #include "application.h"
 
 #include "app_state.h"
+#include "builtin_functions.h"
 #include "function_mesh.h"
 #include "gmsh_wrapper.h"
+#include "latest_job_queue.h"
 #include "mesh.h"
+#include "mesh_build_result.h"
 #include "user_function.h"
 #include "util.h"
 #include "vulkan_wrapper.h"
@@ -51,11 +54,24 @@ Application::Application() {
     windowEvents.init(window, &appState);
     // Needs done after our glfw callbacks are set.
     initUI();
+
+    // Builds upload from a background thread, so start them once the
+    // device and the UI backend are set up.
+    populateFunctionMeshes();
 }
 
 Application::~Application() {
     spdlog::trace("Cleaning up...");
 
+    // Builds and unclaimed results hold device buffers. Closing first
+    // releases a build waiting for room in the channel.
+    meshResults.close();
+    normalMapResults.close();
+    meshBuildQueue.cancelAll();
+    normalMapQueue.cancelAll();
+    while (meshResults.tryPop()) {
+    }
+
     // Cleanup DearImGui.
     ImGui_ImplVulkan_Shutdown();
     ImGui_ImplGlfw_Shutdown();
@@ -107,41 +123,254 @@ void Application::initUI() {
         });
 }
 
-void Application::meshBuilderThreadPtr(const FuncXZPtr func) {
-    FunctionMesh mesh{func};
-    auto floorMesh      = FunctionMesh::simpleFloorMesh();
-    meshesToRender      = {IndexedMesh{std::move(mesh.functionVertices()), std::move(mesh.meshIndices())},
-                           IndexedMesh{std::move(floorMesh.vertices), std::move(floorMesh.indices)}};
-    backgroundWorkReady = true;
+// Packages a function mesh together with the floor mesh. Builder thread only:
+// the function mesh is uploaded here unless upload already holds it, in
+// which case the arrays may be empty. Either way only the function mesh's
+// metadata is sent on; its arrays are freed once on the device.
+MeshBuildResult Application::makeMeshResult(std::vector<Vertex> &&vertices, std::vector<uint32_t> &&indices,
+                                            std::optional<MeshUpload> upload) {
+    if (!upload.has_value()) {
+        upload.emplace(vulkan.getGeometryArena(), vertices.size(), indices.size());
+        upload->writeVertices(0, vertices);
+        upload->writeIndices(0, indices);
+        upload->finish();
+    }
+
+    MeshBuildResult result;
+    result.numVertices = upload->numVertices();
+    result.numIndices  = upload->numIndices();
+    result.graphUpload = std::move(upload);
+
+    auto floorMesh = FunctionMesh::simpleFloorMesh();
+    result.meshes  = {IndexedMesh{std::move(vertices), std::move(indices)},
+                      IndexedMesh{std::move(floorMesh.vertices), std::move(floorMesh.indices)}};
+    result.meshes[0].releaseHostData();
+    return result;
+}
+
+// Queues a mesh build, superseding any earlier one. Main thread only.
+void Application::submitMeshBuild(MeshBuildFn build, NormalMapFn normalMapFn, bool withNormalMap) {
+    const uint64_t buildId = ++latestBuildId;
+
+    // A map still being evaluated is for the graph this build replaces.
+    normalMapQueue.cancel();
+    heldNormalMap.reset();
+    latestNormalMapFn  = std::move(normalMapFn);
+    latestHasNormalMap = withNormalMap;
+
+    meshBuildQueue.submit([this, buildId, build = std::move(build)](const jobs::CancellationToken &token) {
+        auto start = std::chrono::high_resolution_clock::now();
+
+        auto send = [this, buildId, start, &token](MeshBuildResult &&result, bool preview) {
+            result.buildId   = buildId;
+            result.preview   = preview;
+            result.buildTime = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::high_resolution_clock::now() - start);
+            sendMeshResult(std::move(result), token);
+        };
+
+        MeshBuildResult result = build(token, [&send](MeshBuildResult &&preview) {
+            send(std::move(preview), true);
+        });
+        send(std::move(result), false);
+    });
+}
+
+// Forwards mesh previews to the render thread as build results.
+template <typename Mesh>
+typename Mesh::ProgressFn Application::meshPreviewSender(const MeshPreviewFn &sendPreview) {
+    return [this, &sendPreview](typename Mesh::VerticesAndIndices &&preview) {
+        sendPreview(makeMeshResult(std::move(preview.vertices), std::move(preview.indices)));
+    };
+}
+
+// Uploads each tile of a function mesh as soon as it is packed.
+template <typename Mesh>
+static typename Mesh::TileFn meshTileUploader(MeshUpload &upload) {
+    return [&upload](const typename Mesh::MeshTile &tile) {
+        upload.writeVertices(tile.firstVertex, tile.vertices);
+        upload.writeIndices(tile.firstIndex, tile.indices);
+    };
+}
+
+// Uploads a finished function mesh. Where the device buffers are host
+// visible the mesh is packed straight into them, with no staging copy and
+// no CPU arrays; otherwise its tiles go through the transfer queue.
+template <typename Mesh>
+MeshBuildResult Application::uploadFunctionMesh(Mesh &mesh) {
+    MeshUpload upload{vulkan.getGeometryArena(), mesh.numVertices(), mesh.numIndices()};
+    if (upload.mappedVertices() != nullptr && upload.mappedIndices() != nullptr) {
+        mesh.writeFunctionMesh(upload.mappedVertices(), upload.mappedIndices());
+        upload.finish();
+
+        MeshBuildResult result    = makeMeshResult({}, {}, std::move(upload));
+        result.meshes[0].metadata = mesh.metadata();
+        return result;
+    }
+
+    auto funcMesh = mesh.functionMeshOutput(meshTileUploader<Mesh>(upload));
+    upload.finish();
+
+    MeshBuildResult result =
+        makeMeshResult(std::move(funcMesh.vertices), std::move(funcMesh.indices), std::move(upload));
+    // Keeps the mesh's clusters, which its arrays alone don't record.
+    result.meshes[0].metadata = mesh.metadata();
+    return result;
+}
+
+// Evaluates a function for a graph drawn as a tessellated surface, which
+// is neither meshed nor uploaded here; see HeightField.
+template <typename Func>
+MeshBuildResult Application::makeSurfaceResult(Func &func, const jobs::CancellationToken &token) {
+    MeshBuildResult result;
+    result.heightField = HeightField::evaluate(func, token);
+
+    auto floorMesh = FunctionMesh::simpleFloorMesh();
+    result.meshes  = {IndexedMesh{{}, {}}, IndexedMesh{std::move(floorMesh.vertices), std::move(floorMesh.indices)}};
+    result.meshes[0].metadata.boundsMin = result.heightField->boundsMin;
+    result.meshes[0].metadata.boundsMax = result.heightField->boundsMax;
+    return result;
 }
 
-void Application::meshBuilderThreadUser(std::shared_ptr<UserFunction> func) {
-    FunctionMesh mesh{*func};
-    auto floorMesh      = FunctionMesh::simpleFloorMesh();
-    meshesToRender      = {IndexedMesh{std::move(mesh.functionVertices()), std::move(mesh.meshIndices())},
-                           IndexedMesh{std::move(floorMesh.vertices), std::move(floorMesh.indices)}};
-    backgroundWorkReady = true;
+MeshBuildResult Application::meshBuilderTaskBuiltIn(TestFunc func, bool surface, const NormalMapFn &normalMapFn,
+                                                    const jobs::CancellationToken &token,
+                                                    const MeshPreviewFn &sendPreview) {
+    MeshBuildResult result;
+
+    // Instantiates the mesh for the concrete function object type.
+    builtin_functions::visit(func, [this, surface, &token, &sendPreview, &result](auto builtinFunc) {
+        if (surface) {
+            result = makeSurfaceResult(builtinFunc, token);
+        } else {
+            using Mesh = BasicFunctionMesh<decltype(builtinFunc)>;
+            Mesh mesh{std::move(builtinFunc), meshWorkspace, token, meshPreviewSender<Mesh>(sendPreview)};
+            result = uploadFunctionMesh(mesh);
+            meshWorkspace.endBuild();
+        }
+    });
+    // After the mesh, so that its previews aren't held back.
+    if (normalMapFn != nullptr) {
+        result.normalMap = normalMapFn(token);
+    }
+    return result;
 }
 
-void Application::meshBuilderThreadExternal(std::string funcExpression) {
-    // Call into Gmsh wrapper; this version blocks main thread, for initial testing.
+MeshBuildResult Application::meshBuilderTaskUser(std::shared_ptr<UserFunction> func, bool surface,
+                                                 const NormalMapFn &normalMapFn, const jobs::CancellationToken &token,
+                                                 const MeshPreviewFn &sendPreview) {
+    MeshBuildResult result;
+    if (surface) {
+        result = makeSurfaceResult(*func, token);
+    } else {
+        FunctionMesh mesh{*func, meshWorkspace, token, meshPreviewSender<FunctionMesh>(sendPreview)};
+        result = uploadFunctionMesh(mesh);
+        // Only completed mesh builds count toward the workspace's trimming.
+        meshWorkspace.endBuild();
+    }
+    if (normalMapFn != nullptr) {
+        result.normalMap = normalMapFn(token);
+    }
+    return result;
+}
+
+MeshBuildResult Application::meshBuilderTaskExternal(std::string funcExpression,
+                                                     [[maybe_unused]] const jobs::CancellationToken &token) {
+    // Gmsh cannot be interrupted, so a superseded run is only dropped once it returns.
     gmsh_wrapper::VertsAndIndices vertsAndInds{};
     try {
         vertsAndInds = gmsh_wrapper::runGmsh(funcExpression);
     } catch (const std::exception &e) {
         spdlog::debug("Gmsh error: {}", e.what());
+        MeshBuildResult result;
+        result.error = e.what();
+        return result;
+    }
+    return makeMeshResult(std::move(vertsAndInds.vertices), std::move(vertsAndInds.indices));
+}
+
+void Application::sendMeshResult(MeshBuildResult &&result, const jobs::CancellationToken &token) {
+    // The main thread drains the channel every frame, so it is rarely full.
+    // If closed, the app is shutting down and the result is dropped.
+    meshResults.push(std::move(result), token);
+}
+
+void Application::receiveMeshResults() {
+    // Only the newest result of the latest request matters. Results of a
+    // build arrive coarsest first, so a final mesh replaces its previews.
+    std::optional<MeshBuildResult> newest = std::nullopt;
+    // Copies into a dropped result may still be running; freeing it here
+    // would wait for them.
+    auto drop = [this](MeshBuildResult &result) {
+        if (result.graphUpload.has_value()) {
+            vulkan.retireUpload(std::move(result.graphUpload.value()));
+        }
+    };
+    while (std::optional<MeshBuildResult> result = meshResults.tryPop()) {
+        if (result->buildId != latestBuildId) {
+            drop(*result);
+            continue;
+        }
+        if (newest.has_value()) {
+            drop(*newest);
+        }
+        newest = std::move(result);
+    }
+    if (!newest.has_value()) {
+        return;
+    }
+
+    if (newest->failed()) {
         appState.functionParseError = true;
-        backgroundWorkReady         = true;
         return;
     }
-    auto floorMesh      = FunctionMesh::simpleFloorMesh();
-    meshesToRender      = {IndexedMesh{std::move(vertsAndInds.vertices), std::move(vertsAndInds.indices)},
-                           IndexedMesh{std::move(floorMesh.vertices), std::move(floorMesh.indices)}};
-    backgroundWorkReady = true;
+
+    auto numVerts = fmt::format(std::locale(), "{:L}", newest->numVertices);
+    auto numInds  = fmt::format(std::locale(), "{:L}", newest->numIndices);
+    spdlog::debug(" - # function mesh vertices: {}", numVerts);
+    spdlog::debug(" - # function mesh indices:  {}", numInds);
+    spdlog::debug(" - mesh build time: {} ms", newest->buildTime.count());
+
+    shownBuildTime   = newest->buildTime;
+    shownNumVertices = newest->numVertices;
+    shownPreview     = newest->preview;
+
+    if (!newest->preview) {
+        shownFinalBuildId = newest->buildId;
+        if (!latestHasNormalMap) {
+            // Switched off while the build ran.
+            newest->normalMap.reset();
+        } else if (!newest->normalMap.has_value()) {
+            newest->normalMap = std::exchange(heldNormalMap, std::nullopt);
+        }
+    }
+
+    // Moves out of the result's meshes, and takes the uploaded buffers; the
+    // new graph is shown once its upload completes.
+    if (newest->heightField.has_value()) {
+        vulkan.updateGraphAndFloorMeshes(newest->meshes, newest->heightField.value(), newest->normalMap);
+        return;
+    }
+    assert(newest->graphUpload.has_value());
+    vulkan.updateGraphAndFloorMeshes(newest->meshes, std::move(newest->graphUpload.value()), newest->normalMap);
+}
+
+void Application::receiveNormalMaps() {
+    while (std::optional<NormalMapResult> result = normalMapResults.tryPop()) {
+        // Maps of replaced graphs, or switched off since, are dropped.
+        if (result->buildId != latestBuildId || !latestHasNormalMap) {
+            continue;
+        }
+        if (shownFinalBuildId == result->buildId) {
+            vulkan.attachGraphNormalMap(result->normalMap);
+        } else {
+            // The final graph takes it when it arrives.
+            heldNormalMap = std::move(result->normalMap);
+        }
+    }
 }
 
 bool Application::backgroundInProgress() {
-    return meshBuilder.has_value();
+    return !meshBuildQueue.idle();
 }
 
 void Application::populateFunctionMeshes() {
@@ -163,21 +392,32 @@ void Application::populateFunctionMeshes() {
 }
 
 void Application::populateMeshesBuiltIn() {
-    using namespace math_util;
-
     spdlog::debug("Building function meshes.");
 
+    const bool surface = appState.tessellatedSurface && vulkan.supportsTessellation();
+    // The tessellated surface has its own pipeline, which shades without a
+    // normal map. Otherwise the build evaluates one only if it is sampled;
+    // see handleNormalMapChange.
+    const bool withNormalMap = !surface && appState.normalMapSampled();
+
     switch (appState.testFunc) {
-        case TestFunc::Parabolic: {
-            meshBuilder = std::thread(&Application::meshBuilderThreadPtr, this, TEST_FUNCTION_PARABOLIC);
-            break;
-        }
-        case TestFunc::ShiftedSinc: {
-            meshBuilder = std::thread(&Application::meshBuilderThreadPtr, this, TEST_FUNCTION_SHIFTED_SCALED_SINC_USER);
-            break;
-        }
+        case TestFunc::Parabolic:
+        case TestFunc::ShiftedSinc:
         case TestFunc::ExpSine: {
-            meshBuilder = std::thread(&Application::meshBuilderThreadPtr, this, TEST_FUNCTION_SHIFTED_SCALED_EXP_SINE);
+            NormalMapFn normalMapFn = nullptr;
+            if (!surface) {
+                normalMapFn = [func = appState.testFunc](const jobs::CancellationToken &token) {
+                    return builtin_functions::visit(func, [&token](auto builtinFunc) {
+                        return NormalMap::evaluate(builtinFunc, token);
+                    });
+                };
+            }
+            submitMeshBuild(
+                [this, func = appState.testFunc, surface, buildMapFn = withNormalMap ? normalMapFn : nullptr](
+                    const jobs::CancellationToken &token, const MeshPreviewFn &sendPreview) {
+                    return meshBuilderTaskBuiltIn(func, surface, buildMapFn, token, sendPreview);
+                },
+                normalMapFn, withNormalMap);
             break;
         }
         case TestFunc::UserInput: {
@@ -189,7 +429,18 @@ void Application::populateMeshesBuiltIn() {
             if (userFunction == nullptr) {
                 return;
             }
-            meshBuilder  = std::thread(&Application::meshBuilderThreadUser, this, std::move(userFunction));
+            NormalMapFn normalMapFn = nullptr;
+            if (!surface) {
+                normalMapFn = [func = userFunction](const jobs::CancellationToken &token) {
+                    return NormalMap::evaluate(*func, token);
+                };
+            }
+            submitMeshBuild(
+                [this, func = std::move(userFunction), surface, buildMapFn = withNormalMap ? normalMapFn : nullptr](
+                    const jobs::CancellationToken &token, const MeshPreviewFn &sendPreview) {
+                    return meshBuilderTaskUser(func, surface, buildMapFn, token, sendPreview);
+                },
+                normalMapFn, withNormalMap);
             userFunction = nullptr;
             break;
         }
@@ -229,11 +480,14 @@ void Application::populateMeshesExternal() {
         }
     }
 
-    meshBuilder = std::thread(&Application::meshBuilderThreadExternal, this, std::move(functionExpression));
+    // Gmsh runs in one piece, so external builds send no previews.
+    submitMeshBuild([this, expression = std::move(functionExpression)](const jobs::CancellationToken &token,
+                                                                       const MeshPreviewFn &) {
+        return meshBuilderTaskExternal(expression, token);
+    });
 }
 
 void Application::initVulkan() {
-    populateFunctionMeshes();
     vulkan.init(window, INITIAL_WINDOW_WIDTH, INITIAL_WINDOW_HEIGHT);
 }
 
@@ -280,24 +534,8 @@ void Application::run() {
         auto sleepTime        = std::max(std::chrono::nanoseconds(0), target - elapsed);
         std::this_thread::sleep_for(sleepTime);
 
-        if (backgroundWorkReady) {
-            if (!appState.functionParseError) {
-                auto numVerts = fmt::format(std::locale(), "{:L}", meshesToRender[0].vertices.size());
-                auto numInds  = fmt::format(std::locale(), "{:L}", meshesToRender[0].indices.size());
-                spdlog::debug(" - # function mesh vertices: {}", numVerts);
-                spdlog::debug(" - # function mesh indices:  {}", numInds);
-
-                // Moves out of meshesToRender.
-                vulkan.updateGraphAndFloorMeshes(meshesToRender);
-            }
-
-            if (meshBuilder.has_value()) {
-                meshBuilder->join();
-                meshBuilder = std::nullopt;
-            }
-            meshesToRender      = {};
-            backgroundWorkReady = false;
-        }
+        receiveMeshResults();
+        receiveNormalMaps();
     }
 }
 
@@ -316,12 +554,38 @@ void Application::tryGetUserFunction() {
     }
 }
 
-void Application::handleMeshGeneratorChange() {
-    if (meshBuilder.has_value()) {
-        spdlog::warn("Mesh generator change while mesh generation is in progress.");
+// Brings the graph's normal map in line with the settings without
+// rebuilding the graph: evaluates one once the pipeline samples it, and
+// drops it when switched off. A map the pipeline stops sampling is kept, in
+// case it is sampled again.
+void Application::handleNormalMapChange() {
+    // Gmsh meshes and tessellated surfaces are not normal mapped.
+    if (latestNormalMapFn == nullptr) {
+        return;
+    }
+
+    if (!appState.normalMap) {
+        if (latestHasNormalMap) {
+            latestHasNormalMap = false;
+            normalMapQueue.cancel();
+            heldNormalMap.reset();
+            vulkan.detachGraphNormalMap();
+        }
+        return;
+    }
+    if (!appState.normalMapSampled() || latestHasNormalMap) {
         return;
     }
 
+    latestHasNormalMap = true;
+    normalMapQueue.submit(
+        [this, buildId = latestBuildId, evaluate = latestNormalMapFn](const jobs::CancellationToken &token) {
+            // If closed, the app is shutting down and the map is dropped.
+            normalMapResults.push(NormalMapResult{buildId, evaluate(token)}, token);
+        });
+}
+
+void Application::handleMeshGeneratorChange() {
     switch (appState.meshGenerator) {
         case MeshGenerator::BuiltIn: {
             if (appState.testFunc == TestFunc::UserInput) {
@@ -349,7 +613,7 @@ bool Application::handleUserInput() {
         glfwSetWindowShouldClose(window, GLFW_TRUE);
         return true;
     }
-    if (appState.testFunc == TestFunc::UserInput && userInput.enterPressed && meshBuilder == std::nullopt) {
+    if (appState.testFunc == TestFunc::UserInput && userInput.enterPressed) {
         appState.trimFunctionInput();
         appState.functionInputCursorReset = true;
         tryGetUserFunction();
@@ -374,6 +638,10 @@ void Application::drawUI() {
     ImGui::Begin("Settings");
     ImGui::Text("Average framerate: %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate,
                 ImGui::GetIO().Framerate);
+    if (shownNumVertices > 0) {
+        ImGui::Text("Function mesh: %zu vertices, built in %lld ms%s", shownNumVertices,
+                    static_cast<long long>(shownBuildTime.count()), shownPreview ? " (refining)" : "");
+    }
     // Add some vertical space.
     ImGui::Dummy(ImVec2(0.0f, 5.0f));
 
@@ -382,34 +650,32 @@ void Application::drawUI() {
     }
     if (ImGui::Button("Toggle Wireframe Graph")) {
         appState.wireframe = !appState.wireframe;
+        handleNormalMapChange();
     }
     if (ImGui::Button("Toggle PBR in Vertex")) {
         appState.pbrFragPipeline = !appState.pbrFragPipeline;
+        handleNormalMapChange();
     }
     if (ImGui::Button("Toggle Draw Floor")) {
         appState.drawFloor = !appState.drawFloor;
     }
     ImGui::Dummy(ImVec2(0.0f, 5.0f));
 
-    ImGui::BeginDisabled(backgroundInProgress());
-    {
 #ifdef INCLUDE_EXTERNAL_BACKENDS
-        static int selectedMeshGenIndex = appState.meshGeneratorIndex();
-        if (ImGui::Combo("Mesh generator", &selectedMeshGenIndex, generatorNames.data(), generatorNames.size())) {
-            appState.meshGenerator = static_cast<MeshGenerator>(selectedMeshGenIndex);
-            handleMeshGeneratorChange();
-        }
-        ImGui::Dummy(ImVec2(0.0f, 5.0f));
+    static int selectedMeshGenIndex = appState.meshGeneratorIndex();
+    if (ImGui::Combo("Mesh generator", &selectedMeshGenIndex, generatorNames.data(), generatorNames.size())) {
+        appState.meshGenerator = static_cast<MeshGenerator>(selectedMeshGenIndex);
+        handleMeshGeneratorChange();
+    }
+    ImGui::Dummy(ImVec2(0.0f, 5.0f));
 #endif
 
-        static int selectedFuncIndex = appState.selectedFuncIndex();
-        if (ImGui::Combo("Function", &selectedFuncIndex, funcNames.data(), funcNames.size())) {
-            appState.testFunc = static_cast<TestFunc>(selectedFuncIndex);
-            populateFunctionMeshes();
-        }
-        ImGui::Dummy(ImVec2(0.0f, 5.0f));
+    static int selectedFuncIndex = appState.selectedFuncIndex();
+    if (ImGui::Combo("Function", &selectedFuncIndex, funcNames.data(), funcNames.size())) {
+        appState.testFunc = static_cast<TestFunc>(selectedFuncIndex);
+        populateFunctionMeshes();
     }
-    ImGui::EndDisabled();
+    ImGui::Dummy(ImVec2(0.0f, 5.0f));
 
     static int colorEffectIndex = appState.colorEffectIndex();
     if (ImGui::Combo("Color effect", &colorEffectIndex, colorEffectNames.data(), colorEffectNames.size())) {
@@ -420,6 +686,14 @@ void Application::drawUI() {
     if (ImGui::Button("Reset position")) {
         appState.resetPosition = true;
     }
+    // Pinned graphs stay in the scene when the function changes.
+    if (ImGui::Button("Pin graph")) {
+        appState.pinGraph = true;
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Clear pinned graphs")) {
+        appState.clearPinnedGraphs = true;
+    }
     ImGui::Dummy(ImVec2(0.0f, 5.0f));
 
     // PBR graph color.
@@ -431,6 +705,17 @@ void Application::drawUI() {
     // PBR material parameters.
     ImGui::SliderFloat("Metallic", &appState.metallic, 0.0f, 1.0f, "%.2f");
     ImGui::SliderFloat("Roughness", &appState.roughness, 0.0f, 1.0f, "%.2f");
+    ImGui::Dummy(ImVec2(0.0f, 5.0f));
+
+    ImGui::SliderInt("Lights", &appState.numLights, 1, AppState::MAX_LIGHTS);
+    ImGui::SliderFloat("LOD error (px)", &appState.lodPixelError, 0.0f, 8.0f, "%.1f");
+    // Rebuilds the graph either way, as a switch of generator does.
+    if (vulkan.supportsTessellation() && ImGui::Checkbox("Tessellated surface", &appState.tessellatedSurface)) {
+        handleMeshGeneratorChange();
+    }
+    if (ImGui::Checkbox("Normal map", &appState.normalMap)) {
+        handleNormalMapChange();
+    }
 
     ImGui::End();
 
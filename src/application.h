@@ -2,20 +2,23 @@
 #define APPLICATION_H_
 
 #include "app_state.h"
+#include "function_mesh.h"
 #include "imgui_vulkan_data.h"
+#include "latest_job_queue.h"
+#include "mesh_build_result.h"
+#include "spsc_channel.h"
 #include "user_function.h"
 #include "vulkan_wrapper.h"
 
 #include <GLFW/glfw3.h>
 
 #include <array>
-#include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <cstring>
+#include <functional>
+#include <memory>
 #include <optional>
-#include <thread>
-
-using FuncXZPtr = double (*)(double, double);
 
 class Application {
     friend void framebufferResizeCallback(GLFWwindow *window, int width, int height);
@@ -37,15 +40,41 @@ private:
     bool handleUserInput();
     void tryGetUserFunction();
     void handleMeshGeneratorChange();
+    void handleNormalMapChange();
 
     void drawFrame();
     void populateFunctionMeshes();
     void populateMeshesBuiltIn();
     void populateMeshesExternal();
 
-    void meshBuilderThreadPtr(const FuncXZPtr func);
-    void meshBuilderThreadUser(std::shared_ptr<UserFunction> func);
-    void meshBuilderThreadExternal(std::string funcExpression);
+    // Sends a preview of a build that is still running.
+    using MeshPreviewFn = std::function<void(MeshBuildResult &&)>;
+    using MeshBuildFn   = std::function<MeshBuildResult(const jobs::CancellationToken &, const MeshPreviewFn &)>;
+    // Evaluates a normal map of the function a build graphs.
+    using NormalMapFn = std::function<NormalMap(const jobs::CancellationToken &)>;
+
+    // normalMapFn is set if the build's graph can be normal mapped, and
+    // withNormalMap if the build evaluates the map itself.
+    void submitMeshBuild(MeshBuildFn build, NormalMapFn normalMapFn = nullptr, bool withNormalMap = false);
+    // With surface set, these evaluate a height field instead of a mesh.
+    // With normalMapFn set, the final graph also gets its NormalMap.
+    MeshBuildResult meshBuilderTaskBuiltIn(TestFunc func, bool surface, const NormalMapFn &normalMapFn,
+                                           const jobs::CancellationToken &token, const MeshPreviewFn &sendPreview);
+    MeshBuildResult meshBuilderTaskUser(std::shared_ptr<UserFunction> func, bool surface,
+                                        const NormalMapFn &normalMapFn, const jobs::CancellationToken &token,
+                                        const MeshPreviewFn &sendPreview);
+    MeshBuildResult meshBuilderTaskExternal(std::string funcExpression, const jobs::CancellationToken &token);
+    MeshBuildResult makeMeshResult(std::vector<Vertex> &&vertices, std::vector<uint32_t> &&indices,
+                                   std::optional<MeshUpload> upload = std::nullopt);
+    template <typename Mesh>
+    typename Mesh::ProgressFn meshPreviewSender(const MeshPreviewFn &sendPreview);
+    template <typename Mesh>
+    MeshBuildResult uploadFunctionMesh(Mesh &mesh);
+    template <typename Func>
+    MeshBuildResult makeSurfaceResult(Func &func, const jobs::CancellationToken &token);
+    void sendMeshResult(MeshBuildResult &&result, const jobs::CancellationToken &token);
+    void receiveMeshResults();
+    void receiveNormalMaps();
     bool backgroundInProgress();
 
 private:
@@ -66,12 +95,38 @@ private:
     WindowEvents windowEvents;
 
     std::shared_ptr<UserFunction> userFunction = nullptr;
-    // The main thread only touches these while backgroundWorkReady is true.
-    std::array<IndexedMesh, 2> meshesToRender;
 
-    std::optional<std::thread> meshBuilder = std::nullopt;
-    // Set by mesh builder thread, cleared by main thread.
-    std::atomic_bool backgroundWorkReady = false;
+    // Results waiting to be taken by the main thread.
+    static constexpr size_t MESH_RESULT_CAPACITY = 4;
+    jobs::SpscChannel<MeshBuildResult, MESH_RESULT_CAPACITY> meshResults;
+
+    // Main thread only. Results from older builds are dropped.
+    uint64_t latestBuildId = 0;
+    // Stats of the mesh currently shown, for the UI.
+    std::chrono::milliseconds shownBuildTime = {};
+    size_t shownNumVertices                  = 0;
+    bool shownPreview                        = false;
+
+    // The latest build's normal map, if its graph can have one, and
+    // whether the graph has or is getting one. Main thread only.
+    NormalMapFn latestNormalMapFn = nullptr;
+    bool latestHasNormalMap       = false;
+    // Id of the build whose final graph was last handed to the renderer.
+    uint64_t shownFinalBuildId = 0;
+    // A map of the latest build that arrived before the build's final graph.
+    std::optional<NormalMap> heldNormalMap = std::nullopt;
+
+    static constexpr size_t NORMAL_MAP_RESULT_CAPACITY = 2;
+    jobs::SpscChannel<NormalMapResult, NORMAL_MAP_RESULT_CAPACITY> normalMapResults;
+
+    // Reused by each mesh build; builds run one at a time.
+    MeshBuildWorkspace meshWorkspace;
+
+    // Mesh builds; a new request cancels the one in flight. Declared last so
+    // that builds are stopped before the members they write are destroyed.
+    jobs::LatestJobQueue meshBuildQueue;
+    // Normal maps for graphs built without one; they run alongside builds.
+    jobs::LatestJobQueue normalMapQueue;
 };
 
 #endif // APPLICATION_H_
@@ -0,0 +1,346 @@
+// Checks the job system against straightforward serial code. Returns
+// nonzero if any check fails.
+
+#include <latest_job_queue.h>
+#include <scheduler.h>
+#include <spsc_channel.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+static int failures = 0;
+
+static void check(bool condition, const char *what) {
+    if (condition) {
+        spdlog::info("ok: {}", what);
+        return;
+    }
+    spdlog::error("FAILED: {}", what);
+    failures++;
+}
+
+// Counts that are a multiple of the grain size, that leave a partial last
+// block, and that fit in a single block.
+static void testParallelFor() {
+    for (uint32_t count : {0u, 1u, 999u, 64000u, 100003u}) {
+        constexpr uint32_t GRAIN_SIZE = 1000;
+
+        std::vector<uint64_t> expected(count);
+        for (uint32_t i = 0; i < count; i++) {
+            expected[i] = static_cast<uint64_t>(i) * i;
+        }
+
+        std::vector<uint64_t> values(count, 0);
+        std::vector<uint32_t> visits(count, 0);
+        jobs::parallelFor(count, GRAIN_SIZE, [&values, &visits](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; i++) {
+                values[i] = static_cast<uint64_t>(i) * i;
+                visits[i]++;
+            }
+        });
+
+        bool once = true;
+        for (uint32_t visit : visits) {
+            once = once && visit == 1;
+        }
+        spdlog::info("parallelFor over {} elements:", count);
+        check(values == expected, "values match a serial loop");
+        check(once, "each element is visited once");
+    }
+}
+
+// Inner loops run on workers, which run their own loop's blocks while they
+// wait as other workers steal the rest.
+static void testNestedParallelFor() {
+    constexpr uint32_t ROWS = 64;
+    constexpr uint32_t COLS = 5000;
+
+    std::vector<uint32_t> cells(ROWS * COLS, 0);
+    jobs::parallelFor(ROWS, 1, [&cells](uint32_t rowBegin, uint32_t rowEnd) {
+        for (uint32_t row = rowBegin; row < rowEnd; row++) {
+            jobs::parallelFor(COLS, 256, [&cells, row](uint32_t begin, uint32_t end) {
+                for (uint32_t col = begin; col < end; col++) {
+                    cells[row * COLS + col] += row + col;
+                }
+            });
+        }
+    });
+
+    bool matches = true;
+    for (uint32_t row = 0; row < ROWS; row++) {
+        for (uint32_t col = 0; col < COLS; col++) {
+            matches = matches && cells[row * COLS + col] == row + col;
+        }
+    }
+    spdlog::info("Nested parallelFor over {} x {} elements:", ROWS, COLS);
+    check(matches, "values match a serial loop");
+}
+
+// Polls, as the render thread does.
+static bool waitUntil(const std::function<bool()> &condition) {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!condition()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+// A waiting worker only helps with its own group. With one worker, an
+// unrelated task queued behind the group's task would otherwise run first.
+static void testTaskGroupWait() {
+    jobs::Scheduler single({.numWorkers = 1});
+    std::atomic<bool> unrelatedRan        = false;
+    std::atomic<bool> ranBeforeWaitReturn = true;
+
+    jobs::TaskGroup outer(single);
+    outer.run([&single, &unrelatedRan, &ranBeforeWaitReturn] {
+        jobs::TaskGroup inner(single);
+        inner.run([] {});
+        single.submit([&unrelatedRan] {
+            unrelatedRan = true;
+        });
+        inner.wait();
+        ranBeforeWaitReturn = unrelatedRan.load();
+    });
+    outer.wait();
+    const bool unrelatedFinished = waitUntil([&unrelatedRan] { return unrelatedRan.load(); });
+
+    spdlog::info("TaskGroup::wait on a single worker:");
+    check(!ranBeforeWaitReturn, "a waiting worker does not run unrelated tasks");
+    check(unrelatedFinished, "the unrelated task still runs afterwards");
+}
+
+// Values in no particular order.
+static uint64_t scrambled(uint32_t i) {
+    return (static_cast<uint64_t>(i) * 2654435761u) % 1000033;
+}
+
+static void testParallelReduce() {
+    constexpr uint32_t COUNT      = 1000003;
+    constexpr uint32_t GRAIN_SIZE = 4096;
+
+    uint64_t expectedSum = 0;
+    uint64_t expectedMax = 0;
+    for (uint32_t i = 0; i < COUNT; i++) {
+        const uint64_t value = scrambled(i);
+        expectedSum += value;
+        expectedMax = std::max(expectedMax, value);
+    }
+
+    const uint64_t sum = jobs::parallelReduce(
+        COUNT, GRAIN_SIZE, uint64_t{0},
+        [](uint32_t begin, uint32_t end) {
+            uint64_t partial = 0;
+            for (uint32_t i = begin; i < end; i++) {
+                partial += scrambled(i);
+            }
+            return partial;
+        },
+        [](uint64_t a, uint64_t b) { return a + b; });
+
+    const uint64_t max = jobs::parallelReduce(
+        COUNT, GRAIN_SIZE, uint64_t{0},
+        [](uint32_t begin, uint32_t end) {
+            uint64_t partial = 0;
+            for (uint32_t i = begin; i < end; i++) {
+                partial = std::max(partial, scrambled(i));
+            }
+            return partial;
+        },
+        [](uint64_t a, uint64_t b) { return std::max(a, b); });
+
+    // Blocks are folded in order, so even a non-commutative combine gives
+    // the serial result.
+    std::vector<uint32_t> blockOrder = jobs::parallelReduce(
+        COUNT, GRAIN_SIZE, std::vector<uint32_t>{},
+        [](uint32_t begin, uint32_t) { return std::vector<uint32_t>{begin / GRAIN_SIZE}; },
+        [](std::vector<uint32_t> a, const std::vector<uint32_t> &b) {
+            a.insert(a.end(), b.begin(), b.end());
+            return a;
+        });
+    bool ordered = blockOrder.size() == (COUNT + GRAIN_SIZE - 1) / GRAIN_SIZE;
+    for (uint32_t i = 0; ordered && i < blockOrder.size(); i++) {
+        ordered = blockOrder[i] == i;
+    }
+
+    spdlog::info("parallelReduce over {} elements:", COUNT);
+    check(sum == expectedSum, "sum matches a serial loop");
+    check(max == expectedMax, "max matches a serial loop");
+    check(ordered, "partial results are combined in block order");
+}
+
+static void testLatestJobQueue() {
+    enum Outcome : int { NOT_RUN = 0, CANCELLED = 1, COMPLETED = 2 };
+
+    std::atomic<int> outcomes[3] = {NOT_RUN, NOT_RUN, NOT_RUN};
+    std::atomic<int> running     = 0;
+    std::atomic<int> maxRunning  = 0;
+    std::atomic<bool> started    = false;
+
+    // Jobs 0 and 1 run until cancelled; job 2 finishes on its own.
+    auto makeJob = [&](int index) {
+        return [&, index](const jobs::CancellationToken &token) {
+            const int nowRunning = ++running;
+            int seen = maxRunning.load();
+            while (nowRunning > seen && !maxRunning.compare_exchange_weak(seen, nowRunning)) {
+            }
+            started = true;
+            try {
+                for (int step = 0; index < 2 || step < 10; step++) {
+                    token.throwIfCancelled();
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+            } catch (const jobs::OperationCancelled &) {
+                outcomes[index] = CANCELLED;
+                running--;
+                throw;
+            }
+            outcomes[index] = COMPLETED;
+            running--;
+        };
+    };
+
+    jobs::LatestJobQueue queue;
+    queue.submit(makeJob(0));
+    const bool firstStarted = waitUntil([&started] { return started.load(); });
+    // Job 1 is superseded before or just after it starts.
+    queue.submit(makeJob(1));
+    queue.submit(makeJob(2));
+    const bool finished = waitUntil([&queue] { return queue.idle(); });
+
+    spdlog::info("LatestJobQueue:");
+    check(firstStarted && finished, "jobs start and the queue drains");
+    check(outcomes[0] == CANCELLED, "a new submission cancels the running job");
+    check(outcomes[1] != COMPLETED, "a superseded job does not complete");
+    check(outcomes[2] == COMPLETED, "the latest job completes");
+    check(maxRunning == 1, "jobs run one at a time");
+}
+
+// A small channel wraps around many times. Values are move-only, as mesh
+// results are.
+static void testSpscChannel() {
+    constexpr uint32_t COUNT  = 100000;
+    constexpr size_t CAPACITY = 3;
+    using Channel             = jobs::SpscChannel<std::unique_ptr<uint32_t>, CAPACITY>;
+    const jobs::CancellationToken neverCancelled;
+
+    Channel channel;
+    std::thread producer([&channel, &neverCancelled] {
+        for (uint32_t i = 0; i < COUNT; i++) {
+            // Alternates waiting and failing pushes.
+            auto value = std::make_unique<uint32_t>(i);
+            if (i % 2 == 0) {
+                channel.push(std::move(value), neverCancelled);
+                continue;
+            }
+            while (!channel.tryPush(std::move(value))) {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    uint32_t received = 0;
+    bool inOrder      = true;
+    while (received < COUNT) {
+        if (std::optional<std::unique_ptr<uint32_t>> value = channel.tryPop()) {
+            inOrder = inOrder && *value != nullptr && **value == received;
+            received++;
+        } else {
+            // Spinning would starve the producer on small machines.
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+
+    spdlog::info("SpscChannel with {} slots and {} values:", CAPACITY, COUNT);
+    check(inOrder, "values arrive once each, in order");
+    check(!channel.tryPop().has_value(), "the channel is empty afterwards");
+
+    // A full channel keeps what a failed push was given.
+    for (size_t i = 0; i < CAPACITY; i++) {
+        channel.tryPush(std::make_unique<uint32_t>(0));
+    }
+    auto extra          = std::make_unique<uint32_t>(1);
+    const bool accepted = channel.tryPush(std::move(extra));
+    check(!accepted && extra != nullptr, "tryPush on a full channel fails without moving");
+
+    // Still full, so a cancelled push gives up rather than wait.
+    jobs::CancellationSource cancelSource;
+    cancelSource.cancel();
+    auto cancelledValue = std::make_unique<uint32_t>(2);
+    bool threw          = false;
+    try {
+        channel.push(std::move(cancelledValue), cancelSource.token());
+    } catch (const jobs::OperationCancelled &) {
+        threw = true;
+    }
+    check(threw && cancelledValue != nullptr, "a cancelled push on a full channel throws without moving");
+
+    // Close wakes a producer waiting for room, as the app's shutdown needs.
+    std::atomic<bool> waitingPushResult = true;
+    std::thread waiting([&channel, &neverCancelled, &waitingPushResult] {
+        waitingPushResult = channel.push(std::make_unique<uint32_t>(2), neverCancelled);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    channel.close();
+    waiting.join();
+    check(!waitingPushResult, "close releases a waiting push");
+    check(!channel.push(std::make_unique<uint32_t>(3), neverCancelled), "pushes fail once closed");
+}
+
+static void testConfigFromEnvironment() {
+    setenv("VG_WORKERS", "3", 1);
+    setenv("VG_PIN_THREADS", "0", 1);
+    const jobs::SchedulerConfig valid = jobs::SchedulerConfig::fromEnvironment();
+
+    setenv("VG_WORKERS", "3x", 1);
+    setenv("VG_PIN_THREADS", "2", 1);
+    const jobs::SchedulerConfig invalid = jobs::SchedulerConfig::fromEnvironment();
+
+    setenv("VG_WORKERS", "0", 1);
+    const jobs::SchedulerConfig zero = jobs::SchedulerConfig::fromEnvironment();
+
+    unsetenv("VG_WORKERS");
+    unsetenv("VG_PIN_THREADS");
+    const jobs::SchedulerConfig unset = jobs::SchedulerConfig::fromEnvironment();
+
+    spdlog::info("SchedulerConfig::fromEnvironment:");
+    check(valid.numWorkers == 3 && !valid.pinWorkers, "valid values are read");
+    check(invalid.numWorkers == 0 && !invalid.pinWorkers, "invalid values keep the defaults");
+    check(zero.numWorkers == 0, "a worker count of zero is rejected");
+    check(unset.numWorkers == 0 && !unset.pinWorkers, "unset variables keep the defaults");
+}
+
+int main() {
+    spdlog::set_level(spdlog::level::info);
+    // More workers than most machines have cores, to shake out races.
+    jobs::init({.numWorkers = 8});
+    spdlog::info("Testing the job system on {} workers.", jobs::scheduler().numWorkers());
+
+    testParallelFor();
+    testNestedParallelFor();
+    testTaskGroupWait();
+    testParallelReduce();
+    testLatestJobQueue();
+    testSpscChannel();
+    testConfigFromEnvironment();
+
+    if (failures > 0) {
+        spdlog::error("{} checks failed.", failures);
+        return 1;
+    }
+    spdlog::info("All checks passed.");
+    return 0;
+}
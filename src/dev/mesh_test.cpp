@@ -31,9 +31,9 @@ int main() {
 
     float maxY = std::numeric_limits<float>::lowest();
     float minY = std::numeric_limits<float>::max();
-    for (const auto &vertex : mesh.functionVertices()) {
-        maxY = std::max(maxY, vertex.pos.y);
-        minY = std::min(minY, vertex.pos.y);
+    for (float y : mesh.vertexHeights()) {
+        maxY = std::max(maxY, y);
+        minY = std::min(minY, y);
     }
 
     spdlog::info("Function mesh max y: {}", std::to_string(maxY));
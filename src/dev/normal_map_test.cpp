@@ -0,0 +1,63 @@
+// Checks that functions with poles and undefined regions give finite
+// normal maps and height fields. Returns nonzero if any check fails.
+
+#include <height_field.h>
+#include <normal_map.h>
+#include <user_function.h>
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+
+#include <glm/glm.hpp>
+#include <spdlog/spdlog.h>
+
+static int failures = 0;
+
+static void check(bool condition, const std::string &what) {
+    if (condition) {
+        spdlog::info("ok: {}", what);
+        return;
+    }
+    spdlog::error("FAILED: {}", what);
+    failures++;
+}
+
+static void testSingularFunction(const std::string &expression) {
+    const jobs::CancellationToken neverCancelled;
+    UserFunction func{expression};
+
+    const NormalMap map = NormalMap::evaluate(func, neverCancelled);
+    bool finiteGradients = map.gradients.size() == NormalMap::RESOLUTION * NormalMap::RESOLUTION;
+    for (uint32_t packed : map.gradients) {
+        const glm::vec2 gradient = glm::unpackHalf2x16(packed);
+        finiteGradients          = finiteGradients && std::isfinite(gradient.x) && std::isfinite(gradient.y);
+    }
+
+    const HeightField field = HeightField::evaluate(func, neverCancelled);
+    bool finiteField        = std::isfinite(field.boundsMin.y) && std::isfinite(field.boundsMax.y);
+    for (float curvature : field.patchCurvature) {
+        finiteField = finiteField && std::isfinite(curvature);
+    }
+
+    spdlog::info("f(u, v) = {}:", expression);
+    check(finiteGradients, "the normal map's gradients are finite");
+    check(finiteField, "the height field's bounds and curvature are finite");
+}
+
+int main() {
+    spdlog::set_level(spdlog::level::info);
+
+    // Undefined on half the square, beyond the reach of UserFunction's
+    // approximation of singular points.
+    testSingularFunction("sqrt(u - 0.5)");
+    // A pole along a column of texel centers, next to undefined values.
+    testSingularFunction("1 / (u - 0.50048828125) + sqrt(v - 0.75)");
+
+    if (failures > 0) {
+        spdlog::error("{} checks failed.", failures);
+        return 1;
+    }
+    spdlog::info("All checks passed.");
+    return 0;
+}
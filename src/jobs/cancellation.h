@@ -0,0 +1,66 @@
+#ifndef CANCELLATION_H_
+#define CANCELLATION_H_
+
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+// Cooperative cancellation. Long-running jobs take a CancellationToken and
+// poll it at convenient points, throwing OperationCancelled to unwind.
+
+namespace jobs {
+
+class OperationCancelled : public std::runtime_error {
+public:
+    OperationCancelled()
+        : std::runtime_error("Operation was cancelled.") {
+    }
+};
+
+class CancellationToken {
+    friend class CancellationSource;
+
+public:
+    // A token that is never cancelled.
+    CancellationToken() = default;
+
+    bool cancelled() const {
+        return mFlag != nullptr && mFlag->load(std::memory_order_relaxed);
+    }
+
+    void throwIfCancelled() const {
+        if (cancelled()) {
+            throw OperationCancelled();
+        }
+    }
+
+private:
+    explicit CancellationToken(std::shared_ptr<const std::atomic_bool> flag)
+        : mFlag(std::move(flag)) {
+    }
+
+    std::shared_ptr<const std::atomic_bool> mFlag = nullptr;
+};
+
+class CancellationSource {
+public:
+    CancellationSource()
+        : mFlag(std::make_shared<std::atomic_bool>(false)) {
+    }
+
+    void cancel() {
+        mFlag->store(true, std::memory_order_relaxed);
+    }
+
+    CancellationToken token() const {
+        return CancellationToken(mFlag);
+    }
+
+private:
+    std::shared_ptr<std::atomic_bool> mFlag;
+};
+
+} // namespace jobs
+
+#endif // CANCELLATION_H_
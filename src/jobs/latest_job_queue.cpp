@@ -0,0 +1,65 @@
+#include "latest_job_queue.h"
+
+#include <spdlog/spdlog.h>
+
+#include <exception>
+#include <mutex>
+#include <utility>
+
+namespace jobs {
+
+LatestJobQueue::~LatestJobQueue() {
+    cancelAll();
+}
+
+void LatestJobQueue::cancel() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mPendingJob = nullptr;
+    mRunningCancel.cancel();
+}
+
+void LatestJobQueue::cancelAll() {
+    cancel();
+    mTasks.wait();
+}
+
+void LatestJobQueue::submit(Job job) {
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    if (mRunning) {
+        // The running task picks this up when the cancelled job unwinds.
+        mRunningCancel.cancel();
+        mPendingJob = std::move(job);
+        return;
+    }
+
+    mRunning       = true;
+    mRunningCancel = CancellationSource{};
+    mTasks.run([this, job = std::move(job), token = mRunningCancel.token()]() {
+        runJobs(job, token);
+    });
+}
+
+void LatestJobQueue::runJobs(Job job, CancellationToken token) {
+    while (true) {
+        try {
+            job(token);
+        } catch (const OperationCancelled &) {
+            spdlog::trace("Job was cancelled.");
+        } catch (const std::exception &e) {
+            spdlog::error("Job failed: {}", e.what());
+        }
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mPendingJob == nullptr) {
+            mRunning = false;
+            return;
+        }
+        job            = std::move(mPendingJob);
+        mPendingJob    = nullptr;
+        mRunningCancel = CancellationSource{};
+        token          = mRunningCancel.token();
+    }
+}
+
+} // namespace jobs
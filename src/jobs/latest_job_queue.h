@@ -0,0 +1,63 @@
+#ifndef LATEST_JOB_QUEUE_H_
+#define LATEST_JOB_QUEUE_H_
+
+#include "cancellation.h"
+#include "scheduler.h"
+
+#include <functional>
+#include <mutex>
+
+namespace jobs {
+
+// Runs submitted jobs one at a time on the scheduler, keeping only the
+// latest request: submitting cancels the running job and replaces any job
+// still waiting to start. A burst of submissions is thus coalesced, and the
+// time until the latest job finishes does not depend on stale ones.
+//
+// Submitting never blocks, so it is safe from the render thread.
+class LatestJobQueue {
+public:
+    using Job = std::function<void(const CancellationToken &)>;
+
+    explicit LatestJobQueue(Scheduler &scheduler = jobs::scheduler())
+        : mTasks(scheduler) {
+    }
+
+    // Cancels any running job and waits for it to unwind.
+    ~LatestJobQueue();
+
+    LatestJobQueue(const LatestJobQueue &)            = delete;
+    LatestJobQueue &operator=(const LatestJobQueue &) = delete;
+
+    void submit(Job job);
+
+    // Cancels any running job and drops any waiting one, without waiting
+    // for the running job to unwind. Jobs submitted later run as usual.
+    void cancel();
+
+    // As cancel, then waits for the running job to unwind.
+    void cancelAll();
+
+    // True when no job is running or waiting.
+    bool idle() const {
+        return mTasks.done();
+    }
+
+private:
+    // Runs jobs until none are waiting.
+    void runJobs(Job job, CancellationToken token);
+
+private:
+    std::mutex mMutex;
+    // Job waiting for the running one to finish; empty if none.
+    Job mPendingJob = nullptr;
+    // Cancels the running job.
+    CancellationSource mRunningCancel;
+    bool mRunning = false;
+
+    TaskGroup mTasks;
+};
+
+} // namespace jobs
+
+#endif // LATEST_JOB_QUEUE_H_
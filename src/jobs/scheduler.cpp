@@ -0,0 +1,303 @@
+#include "scheduler.h"
+
+#include "cancellation.h"
+
+#include <spdlog/spdlog.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+namespace jobs {
+
+// Set on worker threads, so spawned tasks go to the spawning worker's deque.
+static thread_local const Scheduler *tlsScheduler = nullptr;
+static thread_local uint32_t tlsWorkerIndex       = UINT32_MAX;
+
+static void pinThread(std::thread &thread, uint32_t cpu) {
+#ifdef __linux__
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(cpu, &cpuSet);
+    if (pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &cpuSet) != 0) {
+        spdlog::warn("Unable to pin worker thread to CPU {}.", cpu);
+    }
+#else
+    (void)thread;
+    (void)cpu;
+    spdlog::warn("Worker CPU affinity is not supported on this platform.");
+#endif
+}
+
+static uint32_t defaultNumWorkers() {
+    return std::max(std::thread::hardware_concurrency(), 2u) - 1;
+}
+
+// The value of environment variable name if it is a whole number in
+// [min, max]; logs and ignores anything else.
+static std::optional<uint32_t> readEnvUint(const char *name, uint32_t min, uint32_t max) {
+    const char *text = std::getenv(name);
+    if (text == nullptr || *text == '\0') {
+        return std::nullopt;
+    }
+
+    uint32_t value    = 0;
+    const char *end   = text + std::strlen(text);
+    const auto result = std::from_chars(text, end, value);
+    if (result.ec != std::errc{} || result.ptr != end || value < min || value > max) {
+        spdlog::warn("Ignoring {}={}; expected a whole number from {} to {}.", name, text, min, max);
+        return std::nullopt;
+    }
+    return value;
+}
+
+// SchedulerConfig implementations.
+
+SchedulerConfig SchedulerConfig::fromEnvironment() {
+    SchedulerConfig config;
+    if (std::optional<uint32_t> numWorkers = readEnvUint("VG_WORKERS", 1, MAX_WORKERS)) {
+        config.numWorkers = numWorkers.value();
+    }
+    if (std::optional<uint32_t> pinWorkers = readEnvUint("VG_PIN_THREADS", 0, 1)) {
+        config.pinWorkers = pinWorkers.value() == 1;
+    }
+
+    // Pinning more workers than there are CPUs would fail for the extra ones.
+    const uint32_t numWorkers = config.numWorkers != 0 ? config.numWorkers : defaultNumWorkers();
+    const uint32_t numCpus    = std::thread::hardware_concurrency();
+    if (config.pinWorkers && numCpus != 0 && config.firstCpu + numWorkers > numCpus) {
+        spdlog::warn("Not pinning {} workers to {} CPUs.", numWorkers, numCpus);
+        config.pinWorkers = false;
+    }
+    return config;
+}
+
+// Scheduler implementations.
+
+Scheduler::Scheduler(const SchedulerConfig &config) {
+    uint32_t numWorkers = config.numWorkers;
+    if (numWorkers == 0) {
+        numWorkers = defaultNumWorkers();
+    }
+    spdlog::debug("Starting {} scheduler worker threads.", numWorkers);
+
+    mWorkers.reserve(numWorkers);
+    for (uint32_t i = 0; i < numWorkers; i++) {
+        mWorkers.push_back(std::make_unique<Worker>());
+    }
+    // Start threads only once all deques exist, since workers steal from each other.
+    for (uint32_t i = 0; i < numWorkers; i++) {
+        mWorkers[i]->thread = std::thread(&Scheduler::workerLoop, this, i);
+        if (config.pinWorkers) {
+            pinThread(mWorkers[i]->thread, config.firstCpu + i);
+        }
+    }
+}
+
+Scheduler::~Scheduler() {
+    {
+        std::lock_guard<std::mutex> lock(mWakeMutex);
+        mStopping = true;
+    }
+    mWakeCondition.notify_all();
+
+    for (auto &worker : mWorkers) {
+        worker->thread.join();
+    }
+}
+
+void Scheduler::submit(Task task) {
+    uint32_t target = currentWorker();
+    if (target == UINT32_MAX) {
+        target = mNextWorker.fetch_add(1) % numWorkers();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mWorkers[target]->mutex);
+        mWorkers[target]->tasks.push_back(std::move(task));
+    }
+    mNumQueued.fetch_add(1);
+
+    {
+        // Taking the lock orders this with the sleep check in workerLoop.
+        std::lock_guard<std::mutex> lock(mWakeMutex);
+    }
+    mWakeCondition.notify_one();
+}
+
+bool Scheduler::tryRunOne() {
+    Task task;
+    if (!takeTask(task)) {
+        return false;
+    }
+
+    try {
+        task();
+    } catch (const OperationCancelled &) {
+        // Cancellation is not an error.
+    } catch (const std::exception &e) {
+        spdlog::error("Uncaught exception in background task: {}", e.what());
+    } catch (...) {
+        spdlog::error("Uncaught exception of unknown type in background task.");
+    }
+    return true;
+}
+
+void Scheduler::workerLoop(uint32_t index) {
+    tlsScheduler   = this;
+    tlsWorkerIndex = index;
+
+    while (true) {
+        if (tryRunOne()) {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mWakeMutex);
+        mWakeCondition.wait(lock, [this]() {
+            return mStopping || mNumQueued.load() > 0;
+        });
+        if (mStopping) {
+            return;
+        }
+    }
+}
+
+bool Scheduler::takeTask(Task &task) {
+    if (mNumQueued.load() == 0) {
+        return false;
+    }
+
+    const uint32_t self = currentWorker();
+    if (self != UINT32_MAX) {
+        Worker &worker = *mWorkers[self];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (!worker.tasks.empty()) {
+            task = std::move(worker.tasks.back());
+            worker.tasks.pop_back();
+            mNumQueued.fetch_sub(1);
+            return true;
+        }
+    }
+
+    // Steal the oldest task from the next worker that has one.
+    const uint32_t start = self != UINT32_MAX ? self + 1 : 0;
+    for (uint32_t i = 0; i < numWorkers(); i++) {
+        Worker &victim = *mWorkers[(start + i) % numWorkers()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            mNumQueued.fetch_sub(1);
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t Scheduler::currentWorker() const {
+    return tlsScheduler == this ? tlsWorkerIndex : UINT32_MAX;
+}
+
+// Shared scheduler.
+
+static std::mutex gSchedulerMutex;
+static std::unique_ptr<Scheduler> gScheduler = nullptr;
+
+void init(const SchedulerConfig &config) {
+    std::lock_guard<std::mutex> lock(gSchedulerMutex);
+    if (gScheduler != nullptr) {
+        throw std::runtime_error("Scheduler was already initialized.");
+    }
+    gScheduler = std::make_unique<Scheduler>(config);
+}
+
+Scheduler &scheduler() {
+    std::lock_guard<std::mutex> lock(gSchedulerMutex);
+    if (gScheduler == nullptr) {
+        gScheduler = std::make_unique<Scheduler>();
+    }
+    return *gScheduler;
+}
+
+// TaskGroup implementations.
+
+TaskGroup::~TaskGroup() {
+    try {
+        wait();
+    } catch (const OperationCancelled &) {
+        // Cancellation is not an error.
+    } catch (const std::exception &e) {
+        spdlog::error("Unhandled exception in task group: {}", e.what());
+    }
+}
+
+void TaskGroup::run(Task task) {
+    mState->pending.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(mState->taskMutex);
+        mState->tasks.push_back(std::move(task));
+    }
+
+    mScheduler.submit([state = mState]() {
+        state->runOne();
+    });
+}
+
+void TaskGroup::wait() {
+    // Help with our own queued tasks, then sleep until the rest finish elsewhere.
+    const bool help = mScheduler.onWorkerThread();
+    for (uint32_t pending = mState->pending.load(); pending > 0; pending = mState->pending.load()) {
+        if (!help || !mState->runOne()) {
+            mState->pending.wait(pending);
+        }
+    }
+
+    std::exception_ptr error = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mState->errorMutex);
+        std::swap(error, mState->error);
+    }
+    if (error != nullptr) {
+        std::rethrow_exception(error);
+    }
+}
+
+bool TaskGroup::State::runOne() {
+    Task task;
+    {
+        std::lock_guard<std::mutex> lock(taskMutex);
+        if (tasks.empty()) {
+            return false;
+        }
+        // Newest first, like a worker's own deque.
+        task = std::move(tasks.back());
+        tasks.pop_back();
+    }
+
+    try {
+        task();
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        if (error == nullptr) {
+            error = std::current_exception();
+        }
+    }
+    if (pending.fetch_sub(1) == 1) {
+        pending.notify_all();
+    }
+    return true;
+}
+
+} // namespace jobs
@@ -0,0 +1,199 @@
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool shared by all background work.
+//
+// Each worker owns a deque of tasks. Tasks spawned on a worker go to the
+// back of its own deque and are popped from there, so nested work stays
+// cache-local; idle workers steal from the front of other deques. Tasks
+// submitted from other threads are dealt round-robin to the workers.
+//
+// The render thread only ever submits tasks and polls TaskGroup::done,
+// apart from waits at startup and shutdown, which block it.
+
+namespace jobs {
+
+using Task = std::function<void()>;
+
+struct SchedulerConfig {
+    // Number of worker threads; 0 uses one per hardware thread,
+    // less one that is left for the render thread.
+    uint32_t numWorkers = 0;
+
+    // Pin worker i to CPU firstCpu + i. Only supported on Linux.
+    bool pinWorkers   = false;
+    uint32_t firstCpu = 0;
+
+    // The defaults, overridden by the environment variables VG_WORKERS, a
+    // worker count from 1 to MAX_WORKERS, and VG_PIN_THREADS, 1 to pin
+    // workers or 0 not to. Invalid values are logged and ignored.
+    static SchedulerConfig fromEnvironment();
+
+    static constexpr uint32_t MAX_WORKERS = 256;
+};
+
+class Scheduler {
+public:
+    explicit Scheduler(const SchedulerConfig &config = {});
+    ~Scheduler();
+
+    Scheduler(const Scheduler &)            = delete;
+    Scheduler &operator=(const Scheduler &) = delete;
+
+    uint32_t numWorkers() const {
+        return static_cast<uint32_t>(mWorkers.size());
+    }
+
+    // Queues a task; safe to call from any thread. Exceptions thrown
+    // by the task are logged and dropped; use a TaskGroup to keep them.
+    void submit(Task task);
+
+    // Runs one queued task on the calling thread, if there is one.
+    bool tryRunOne();
+
+    // True on this scheduler's worker threads.
+    bool onWorkerThread() const {
+        return currentWorker() != UINT32_MAX;
+    }
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::thread thread;
+    };
+
+    void workerLoop(uint32_t index);
+
+    // Pops from this thread's own deque, else steals from another.
+    bool takeTask(Task &task);
+
+    // Index of the calling thread if it is one of our workers.
+    uint32_t currentWorker() const;
+
+private:
+    std::vector<std::unique_ptr<Worker>> mWorkers;
+
+    // Queued tasks across all deques.
+    std::atomic<uint32_t> mNumQueued  = 0;
+    std::atomic<uint32_t> mNextWorker = 0;
+
+    std::mutex mWakeMutex;
+    std::condition_variable mWakeCondition;
+    bool mStopping = false;
+};
+
+// Configures the shared scheduler. Call once, before any background work.
+// Throws if the scheduler has already been created.
+void init(const SchedulerConfig &config);
+
+// The shared scheduler; created with the default config if init was not called.
+Scheduler &scheduler();
+
+// A set of tasks that can be waited on together.
+class TaskGroup {
+public:
+    explicit TaskGroup(Scheduler &scheduler = jobs::scheduler())
+        : mScheduler(scheduler),
+          mState(std::make_shared<State>()) {
+    }
+
+    // Waits for outstanding tasks, dropping any exception they threw.
+    ~TaskGroup();
+
+    TaskGroup(const TaskGroup &)            = delete;
+    TaskGroup &operator=(const TaskGroup &) = delete;
+
+    void run(Task task);
+
+    // Non-blocking; safe to poll from the render thread.
+    bool done() const {
+        return mState->pending.load() == 0;
+    }
+
+    // Waits until the group is done, then rethrows the first exception
+    // thrown by one of its tasks. On a worker, runs the group's own queued
+    // tasks meanwhile, never unrelated ones, so the wait is not held up by
+    // other work and nested waits only go as deep as the nested groups.
+    // Other threads just block.
+    void wait();
+
+private:
+    // Shared with running tasks, so they can signal after the group is gone.
+    struct State {
+        std::atomic<uint32_t> pending = 0;
+
+        // Tasks not yet started. Each has a matching scheduler task that
+        // runs one of them, unless a waiter got to it first.
+        std::mutex taskMutex;
+        std::deque<Task> tasks;
+
+        std::mutex errorMutex;
+        std::exception_ptr error = nullptr;
+
+        // Runs one of the group's queued tasks, if there is one.
+        bool runOne();
+    };
+
+    Scheduler &mScheduler;
+    std::shared_ptr<State> mState;
+};
+
+// Calls fn(begin, end) for blocks of [0, count) of at most grainSize
+// elements, in parallel, returning when all blocks are done.
+template <typename Fn>
+void parallelFor(uint32_t count, uint32_t grainSize, Fn &&fn) {
+    const uint32_t numBlocks = (count + grainSize - 1) / grainSize;
+    if (numBlocks <= 1) {
+        if (count > 0) {
+            fn(0, count);
+        }
+        return;
+    }
+
+    TaskGroup group;
+    for (uint32_t block = 1; block < numBlocks; block++) {
+        const uint32_t begin = block * grainSize;
+        const uint32_t end   = std::min(begin + grainSize, count);
+        group.run([&fn, begin, end]() {
+            fn(begin, end);
+        });
+    }
+    fn(0, grainSize);
+    group.wait();
+}
+
+// Maps blocks of [0, count) to partial results with map(begin, end) in
+// parallel, then folds them in block order with combine. The result does
+// not depend on the number of workers.
+template <typename T, typename Map, typename Combine>
+T parallelReduce(uint32_t count, uint32_t grainSize, T identity, Map &&map, Combine &&combine) {
+    const uint32_t numBlocks = (count + grainSize - 1) / grainSize;
+
+    std::vector<T> partials(numBlocks, identity);
+    parallelFor(count, grainSize, [&](uint32_t begin, uint32_t end) {
+        partials[begin / grainSize] = map(begin, end);
+    });
+
+    T result = identity;
+    for (const T &partial : partials) {
+        result = combine(result, partial);
+    }
+    return result;
+}
+
+} // namespace jobs
+
+#endif // SCHEDULER_H_
@@ -0,0 +1,114 @@
+#ifndef SPSC_CHANNEL_H_
+#define SPSC_CHANNEL_H_
+
+#include "cancellation.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <utility>
+
+namespace jobs {
+
+// Bounded lock-free queue from one producer thread to one consumer thread.
+//
+// The consumer never blocks: tryPop returns nothing when the channel is
+// empty. The producer either fails with tryPush when it is full, or waits
+// in push for the consumer to make room. Several threads may take turns
+// as the producer (or consumer) as long as each hand-over is ordered by
+// some other synchronization, such as a job queue running one job at a time.
+template <typename T, size_t Capacity>
+class SpscChannel {
+    static_assert(Capacity > 0);
+
+public:
+    SpscChannel() = default;
+
+    SpscChannel(const SpscChannel &)            = delete;
+    SpscChannel &operator=(const SpscChannel &) = delete;
+
+    // Producer only. Moves from value only if it was queued.
+    bool tryPush(T &&value) {
+        const size_t tail = mTail.load(std::memory_order_relaxed);
+        const size_t next = (tail + 1) % NUM_SLOTS;
+        if (next == mHead.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        mSlots[tail] = std::move(value);
+        mTail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // Producer only. Waits while the channel is full, without polling, for
+    // a pop. Throws OperationCancelled if cancel is triggered and there is
+    // still no room when the producer wakes, and returns false once the
+    // channel is closed; either way value is left as it was.
+    bool push(T &&value, const CancellationToken &cancel) {
+        while (true) {
+            // Read before trying, so a pop in between ends the wait at once.
+            const uint32_t wakeups = mProducerWakeups.load(std::memory_order_acquire);
+            if (mClosed.load(std::memory_order_acquire)) {
+                return false;
+            }
+            if (tryPush(std::move(value))) {
+                return true;
+            }
+            cancel.throwIfCancelled();
+            mProducerWakeups.wait(wakeups, std::memory_order_acquire);
+        }
+    }
+
+    // Consumer only.
+    std::optional<T> tryPop() {
+        const size_t head = mHead.load(std::memory_order_relaxed);
+        if (head == mTail.load(std::memory_order_acquire)) {
+            return std::nullopt;
+        }
+
+        std::optional<T> value = std::move(mSlots[head]);
+        mSlots[head].reset();
+        mHead.store((head + 1) % NUM_SLOTS, std::memory_order_release);
+        wakeProducer();
+        return value;
+    }
+
+    // Makes push fail from now on, including a push already waiting. For
+    // shutdown, when the consumer stops popping; may be called from any
+    // thread.
+    void close() {
+        mClosed.store(true, std::memory_order_release);
+        wakeProducer();
+    }
+
+private:
+    void wakeProducer() {
+        mProducerWakeups.fetch_add(1, std::memory_order_release);
+        mProducerWakeups.notify_one();
+    }
+
+private:
+    // One slot is always left empty to tell full from empty.
+    static constexpr size_t NUM_SLOTS = Capacity + 1;
+    // Keeps the two indices from sharing a cache line.
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+
+    std::array<std::optional<T>, NUM_SLOTS> mSlots = {};
+
+    // Next slot to pop; written by the consumer.
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> mHead = 0;
+    // Next slot to push; written by the producer.
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> mTail = 0;
+
+    // Bumped by pops and close, to wake a producer waiting in push. Unlike
+    // mHead it never returns to a value the producer has already seen.
+    alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> mProducerWakeups = 0;
+    // Set by close.
+    std::atomic<bool> mClosed = false;
+};
+
+} // namespace jobs
+
+#endif // SPSC_CHANNEL_H_
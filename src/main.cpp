@@ -1,4 +1,5 @@
 #include "application.h"
+#include "scheduler.h"
 
 #include <spdlog/spdlog.h>
 
@@ -6,6 +7,11 @@ int main() {
     std::locale::global(std::locale(""));
     spdlog::set_level(spdlog::level::trace);
 
+    // Background work runs on the shared scheduler; the defaults leave
+    // one hardware thread for rendering and do not pin workers. See the
+    // README for overriding them.
+    jobs::init(jobs::SchedulerConfig::fromEnvironment());
+
     Application app;
     try {
         app.run();
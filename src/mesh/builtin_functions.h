@@ -0,0 +1,81 @@
+#ifndef BUILTIN_FUNCTIONS_H_
+#define BUILTIN_FUNCTIONS_H_
+
+#include "app_state.h"
+#include "util.h"
+
+#include <stdexcept>
+#include <utility>
+
+// Compile-time registry of the built-in test functions.
+//
+// Each function is its own empty function object type, so meshing it
+// through BasicFunctionMesh<T> lets the compiler inline the evaluation
+// into the mesh loops instead of calling through a function pointer.
+
+namespace builtin_functions {
+
+struct Parabolic {
+    double operator()(double x, double z) const {
+        return math_util::TEST_FUNCTION_PARABOLIC(x, z);
+    }
+};
+
+struct ShiftedSinc {
+    double operator()(double x, double z) const {
+        return math_util::TEST_FUNCTION_SHIFTED_SCALED_SINC(x, z);
+    }
+};
+
+struct ExpSine {
+    double operator()(double x, double z) const {
+        return math_util::TEST_FUNCTION_SHIFTED_SCALED_EXP_SINE(x, z);
+    }
+};
+
+// Maps a TestFunc value to its function object type.
+template <TestFunc F>
+struct Builtin;
+
+template <>
+struct Builtin<TestFunc::Parabolic> {
+    using type = Parabolic;
+};
+
+template <>
+struct Builtin<TestFunc::ShiftedSinc> {
+    using type = ShiftedSinc;
+};
+
+template <>
+struct Builtin<TestFunc::ExpSine> {
+    using type = ExpSine;
+};
+
+inline bool isBuiltin(TestFunc func) {
+    return func == TestFunc::Parabolic || func == TestFunc::ShiftedSinc || func == TestFunc::ExpSine;
+}
+
+// Calls visitor with an instance of the function object for func.
+// Precondition: isBuiltin(func).
+template <typename Visitor>
+decltype(auto) visit(TestFunc func, Visitor &&visitor) {
+    switch (func) {
+        case TestFunc::Parabolic: {
+            return std::forward<Visitor>(visitor)(Builtin<TestFunc::Parabolic>::type{});
+        }
+        case TestFunc::ShiftedSinc: {
+            return std::forward<Visitor>(visitor)(Builtin<TestFunc::ShiftedSinc>::type{});
+        }
+        case TestFunc::ExpSine: {
+            return std::forward<Visitor>(visitor)(Builtin<TestFunc::ExpSine>::type{});
+        }
+        default: {
+            throw std::runtime_error("Test function is not a built-in function.");
+        }
+    }
+}
+
+} // namespace builtin_functions
+
+#endif // BUILTIN_FUNCTIONS_H_
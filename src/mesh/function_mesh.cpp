@@ -1,7 +1,9 @@
 #include "function_mesh.h"
 
+#include "builtin_functions.h"
 #include "mesh.h"
 #include "mesh_util.h"
+#include "scheduler.h"
 #include "util.h"
 
 #include <glm/fwd.hpp>
@@ -9,84 +11,100 @@
 #include <spdlog/spdlog.h>
 
 #include <algorithm>
+#include <array>
 #include <cassert>
 #include <cmath>
 #include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <iostream>
-#include <memory>
 #include <ostream>
 #include <string>
 #include <vector>
 
 // Square implementations.
 
-// Postcondition: Edge refinments vectors will be populated in appropriate
-//                order for the orientation of each edge.
-const Square::EdgeRefinements &Square::populateRefinements() {
-    if (!hasChildren()) {
-        edgeRefinements = {
-            .north = {topLeftIdx, topRightIdx},
-            .west  = {topLeftIdx, bottomLeftIdx},
-            .south = {bottomLeftIdx, bottomRightIdx},
-            .east  = {topRightIdx, bottomRightIdx},
-        };
-        return edgeRefinements;
+Square *Square::edgeNeighbor(Edge edge) const {
+    Square *directNb = nullptr;
+    switch (edge) {
+        case Edge::North: {
+            directNb = northNeighbor;
+            break;
+        }
+        case Edge::East: {
+            directNb = eastNeighbor;
+            break;
+        }
+        case Edge::South: {
+            directNb = southNeighbor;
+            break;
+        }
+        case Edge::West: {
+            directNb = westNeighbor;
+            break;
+        }
     }
-    // Invariant: A square has 0 or 4 children.
-    assert(children.size() == 4);
-
-    // Absorb refinements from children.
-
-    SharedSquare &topLeftChild              = children[0];
-    const EdgeRefinements *childRefinements = &topLeftChild->populateRefinements();
-    for (uint32_t i = 0; i < childRefinements->north.size() - 1; i++) {
-        edgeRefinements.north.push_back(childRefinements->north[i]);
+    if (directNb != nullptr) {
+        return directNb;
     }
-    for (uint32_t i = 0; i < childRefinements->west.size() - 1; i++) {
-        edgeRefinements.west.push_back(childRefinements->west[i]);
+    if (parent == nullptr) {
+        return nullptr;
     }
-    // Omit last to avoid duplicates.
 
-    SharedSquare &topRightChild = children[1];
-    childRefinements            = &topRightChild->populateRefinements();
-    for (uint32_t i = 0; i < childRefinements->north.size(); i++) {
-        edgeRefinements.north.push_back(childRefinements->north[i]);
-    }
-    for (uint32_t i = 0; i < childRefinements->east.size() - 1; i++) {
-        edgeRefinements.east.push_back(childRefinements->east[i]);
+    // Edge is on the boundary of parent; look for the parent's neighbor's child.
+    Square *parentNb = parent->edgeNeighbor(edge);
+    if (parentNb == nullptr || !parentNb->hasChildren()) {
+        return parentNb;
     }
 
-    SharedSquare &bottomLeftChild = children[2];
-    childRefinements              = &bottomLeftChild->populateRefinements();
-    for (uint32_t i = 0; i < childRefinements->south.size() - 1; i++) {
-        edgeRefinements.south.push_back(childRefinements->south[i]);
-    }
-    for (uint32_t i = 0; i < childRefinements->west.size(); i++) {
-        edgeRefinements.west.push_back(childRefinements->west[i]);
+    uint32_t childPos = 0;
+    while (parent->children[childPos] != this) {
+        childPos++;
     }
+    // Mirror across the edge: north/south flips the row, east/west the column.
+    bool flipRow = edge == Edge::North || edge == Edge::South;
+    return parentNb->children[childPos ^ (flipRow ? 2u : 1u)];
+}
 
-    SharedSquare &bottomRightChild = children[3];
-    childRefinements               = &bottomRightChild->populateRefinements();
-    for (uint32_t i = 0; i < childRefinements->south.size(); i++) {
-        edgeRefinements.south.push_back(childRefinements->south[i]);
-    }
-    for (uint32_t i = 0; i < childRefinements->east.size(); i++) {
-        edgeRefinements.east.push_back(childRefinements->east[i]);
+uint32_t Square::edgeMidpointIdx(Edge edge) const {
+    assert(hasChildren());
+
+    switch (edge) {
+        case Edge::North: {
+            return children[0]->topRightIdx;
+        }
+        case Edge::East: {
+            return children[1]->bottomRightIdx;
+        }
+        case Edge::South: {
+            return children[2]->bottomRightIdx;
+        }
+        case Edge::West: {
+            return children[0]->bottomLeftIdx;
+        }
     }
+    return UINT32_MAX;
+}
 
-    return edgeRefinements;
+uint32_t Square::neighborMidpointIdx(Edge edge) const {
+    Square *neighbor = edgeNeighbor(edge);
+    if (neighbor == nullptr || neighbor->depth != depth || !neighbor->hasChildren()) {
+        return UINT32_MAX;
+    }
+    return neighbor->edgeMidpointIdx(oppositeEdge(edge));
 }
 
-// FunctionMesh implementations.
+// BasicFunctionMesh implementations.
 
-void FunctionMesh::buildFloorMesh() {
+template <typename Func>
+void BasicFunctionMesh<Func>::buildFloorMesh() {
     mFloorMeshSquares.reserve(NUM_CELLS * NUM_CELLS);
+    mWorkspace.squares.reserve(NUM_CELLS * NUM_CELLS);
     const double width = 1.0 / NUM_CELLS;
 
     for (int i = 1; i <= NUM_CELLS; i++) {
         for (int j = 1; j <= NUM_CELLS; j++) {
-            SharedSquare square = std::make_shared<Square>();
+            Square *square = mWorkspace.squares.allocate();
 
             square->mTopLeft[0] = static_cast<float>((j - 1) * width);
             square->mTopLeft[1] = static_cast<float>((i - 1) * width);
@@ -99,12 +117,12 @@ void FunctionMesh::buildFloorMesh() {
 
             // Assign neighbors in top-level grid.
             if (j >= 2) {
-                SharedSquare westNeighbor  = mFloorMeshSquares.at(mFloorMeshSquares.size() - 2);
+                Square *westNeighbor       = mFloorMeshSquares.at(mFloorMeshSquares.size() - 2);
                 square->westNeighbor       = westNeighbor;
                 westNeighbor->eastNeighbor = square;
             }
             if (i >= 2) {
-                SharedSquare northNeighbor   = mFloorMeshSquares.at((i - 2) * NUM_CELLS + (j - 1));
+                Square *northNeighbor        = mFloorMeshSquares.at((i - 2) * NUM_CELLS + (j - 1));
                 square->northNeighbor        = northNeighbor;
                 northNeighbor->southNeighbor = square;
             }
@@ -112,7 +130,8 @@ void FunctionMesh::buildFloorMesh() {
     }
 }
 
-double FunctionMesh::secondDerivEst(const Square &square) {
+template <typename Func>
+double BasicFunctionMesh<Func>::secondDerivEst(const Square &square) {
     float center[2]      = {0.5f * (square.mTopLeft[0] + square.mBtmRight[0]),
                             0.5f * (square.mTopLeft[1] + square.mBtmRight[1])};
     float topMiddle[2]   = {0.5f * (square.mTopLeft[0] + square.mBtmRight[0]), square.mTopLeft[1]};
@@ -139,23 +158,32 @@ double FunctionMesh::secondDerivEst(const Square &square) {
     return std::sqrt(fxx * fxx + fyy * fyy + fxy * fxy) / 3.0;
 }
 
-double FunctionMesh::secondDerivEstMax(const glm::vec3 &pos) {
-    double x = pos.x;
-    double z = pos.z;
+template <typename Func>
+typename BasicFunctionMesh<Func>::PointDerivs BasicFunctionMesh<Func>::derivsAtPoint(double x, double z) {
+    const double f      = mFunc(x, z);
+    const double fRight = mFunc(x + H, z);
+    const double fLeft  = mFunc(x - H, z);
+    const double fUp    = mFunc(x, z + H);
+    const double fDown  = mFunc(x, z - H);
 
-    double fxx = (mFunc(x + H, z) - 2.0 * mFunc(x, z) + mFunc(x - H, z)) / (H * H);
-    double fzz = (mFunc(x, z + H) - 2.0 * mFunc(x, z) + mFunc(x, z - H)) / (H * H);
+    double fxx = (fRight - 2.0 * f + fLeft) / (H * H);
+    double fzz = (fUp - 2.0 * f + fDown) / (H * H);
 
-    double fxz = (mFunc(x + H, z + H) - mFunc(x + H, z) - mFunc(x, z + H)    //
-                  + 2.0 * mFunc(x, z)                                        //
-                  - mFunc(x - H, z) - mFunc(x, z - H) + mFunc(x - H, z - H)) //
+    double fxz = (mFunc(x + H, z + H) - fRight - fUp      //
+                  + 2.0 * f                               //
+                  - fLeft - fDown + mFunc(x - H, z - H)) //
                  / (2.0 * H * H);
 
-    return std::max({std::abs(fxx), std::abs(fzz), std::abs(fxz)});
+    return {
+        .dydx           = (fRight - fLeft) / (2.0 * H),
+        .dydz           = (fUp - fDown) / (2.0 * H),
+        .secondDerivMax = std::max({std::abs(fxx), std::abs(fzz), std::abs(fxz)}),
+    };
 }
 
 // Precondition: Square vertex indices are valid for function mesh.
-bool FunctionMesh::shouldRefine(Square &square) {
+template <typename Func>
+bool BasicFunctionMesh<Func>::shouldRefine(Square &square) {
     if constexpr (DEBUG_REFINEMENT) {
         std::cout << "Refinement check for square w/ top left corner: ";
         debugVertex(std::cout, square.topLeftIdx) << std::endl;
@@ -191,41 +219,29 @@ bool FunctionMesh::shouldRefine(Square &square) {
     return shouldRefine;
 }
 
-void FunctionMesh::addFloorMeshVertex(float x, float z) {
-    mFloorMeshVertices.push_back(Vertex{
-        .pos       = {x, 0.0f, z},
-        .color     = FLOOR_COLOR,
-        .tangent   = {1.0f, 0.0f, 0.0f},
-        .bitangent = {0.0f, 0.0f, 1.0f},
-        .normal    = {0.0f, 1.0f, 0.0f},
-    });
+template <typename Func>
+uint32_t BasicFunctionMesh<Func>::addVertex(float x, float z, uint8_t flags) {
+    mVertX.push_back(x);
+    mVertZ.push_back(z);
+    mVertFlags.push_back(flags);
+    return static_cast<uint32_t>(mVertX.size() - 1);
 }
 
-void FunctionMesh::refine(SharedSquare square) {
-    glm::vec3 funcColor = FUNCT_COLOR;
+template <typename Func>
+void BasicFunctionMesh<Func>::subdivide(Square *square) {
+    uint8_t colorFlags = 0;
 
     if constexpr (SHOW_REFINEMENT) {
-
-        switch (square->depth) {
-            case 0: {
-                funcColor = REFINE_DEBUG_COLOR1;
-                break;
-            }
-            case 1: {
-                funcColor = REFINE_DEBUG_COLOR2;
-                break;
-            }
-            default: {
-                funcColor = REFINE_DEBUG_COLOR3;
-                break;
-            }
+        // Index into the refinement debug colors; see packVertices.
+        colorFlags = static_cast<uint8_t>(std::min(square->depth + 1, 3u));
+
+        // Shared corners keep the color of the deepest square they belong to,
+        // so the colors do not depend on the order squares are subdivided.
+        for (uint32_t vertIdx : {square->topLeftIdx, square->topRightIdx, square->bottomRightIdx,
+                                 square->bottomLeftIdx, square->centerIdx}) {
+            const uint8_t oldColor = mVertFlags[vertIdx] & REFINE_COLOR_MASK;
+            mVertFlags[vertIdx]    = (mVertFlags[vertIdx] & ~REFINE_COLOR_MASK) | std::max(oldColor, colorFlags);
         }
-
-        mFunctionMeshVertices[square->topLeftIdx].color     = funcColor;
-        mFunctionMeshVertices[square->topRightIdx].color    = funcColor;
-        mFunctionMeshVertices[square->bottomRightIdx].color = funcColor;
-        mFunctionMeshVertices[square->bottomLeftIdx].color  = funcColor;
-        mFunctionMeshVertices[square->centerIdx].color      = funcColor;
     }
 
     float center[2]      = {0.5f * (square->mTopLeft[0] + square->mBtmRight[0]),
@@ -235,19 +251,22 @@ void FunctionMesh::refine(SharedSquare square) {
     float leftMiddle[2]  = {square->mTopLeft[0], 0.5f * (square->mTopLeft[1] + square->mBtmRight[1])};
     float rightMiddle[2] = {square->mBtmRight[0], 0.5f * (square->mTopLeft[1] + square->mBtmRight[1])};
 
-    auto addVert = [this, funcColor](float coords[2]) -> uint32_t {
-        addFloorMeshVertex(coords[0], coords[1]);
-        mFunctionMeshVertices.push_back(Vertex{
-            .pos   = {coords[0], mFunc(coords[0], coords[1]), coords[1]},
-            .color = funcColor,
-        });
-        return mFloorMeshVertices.size() - 1;
+    auto addVert = [this, colorFlags](float coords[2]) -> uint32_t {
+        uint32_t vertIdx = addVertex(coords[0], coords[1], colorFlags);
+        mVertY.push_back(static_cast<float>(mFunc(coords[0], coords[1])));
+        return vertIdx;
     };
 
-    uint32_t topMidIdx   = addVert(topMiddle);
-    uint32_t rightMidIdx = addVert(rightMiddle);
-    uint32_t btmMidIdx   = addVert(btmMiddle);
-    uint32_t leftMidIdx  = addVert(leftMiddle);
+    // Share edge midpoints with same-depth neighbors that are already refined.
+    auto edgeMidpoint = [&square, &addVert](Edge edge, float coords[2]) -> uint32_t {
+        uint32_t midpointIdx = square->neighborMidpointIdx(edge);
+        return midpointIdx != UINT32_MAX ? midpointIdx : addVert(coords);
+    };
+
+    uint32_t topMidIdx   = edgeMidpoint(Edge::North, topMiddle);
+    uint32_t rightMidIdx = edgeMidpoint(Edge::East, rightMiddle);
+    uint32_t btmMidIdx   = edgeMidpoint(Edge::South, btmMiddle);
+    uint32_t leftMidIdx  = edgeMidpoint(Edge::West, leftMiddle);
 
     auto makeCenter = [](float topLeft[2], float btmRight[2]) -> XZCoord {
         return {0.5f * (topLeft[0] + btmRight[0]), 0.5f * (topLeft[1] + btmRight[1])};
@@ -264,7 +283,6 @@ void FunctionMesh::refine(SharedSquare square) {
     float newCenterCoords[3] = {newCenter.x, newCenter.z};
     uint32_t newCenterIdx    = addVert(newCenterCoords);
 
-    square->children.reserve(4);
     {
         Square newSquare{
             .mTopLeft  = {square->mTopLeft[0], square->mTopLeft[1]},
@@ -280,9 +298,9 @@ void FunctionMesh::refine(SharedSquare square) {
             .bottomLeftIdx  = leftMidIdx,
             .centerIdx      = newCenterIdx,
         };
-        square->children.push_back(std::make_shared<Square>(newSquare));
+        square->children[0] = mWorkspace.squares.allocate(newSquare);
     }
-    SharedSquare topLeftChild = square->children.back();
+    Square *topLeftChild = square->children[0];
 
     // Add top right child.
 
@@ -306,9 +324,9 @@ void FunctionMesh::refine(SharedSquare square) {
             .bottomLeftIdx  = square->centerIdx,
             .centerIdx      = newCenterIdx2,
         };
-        square->children.push_back(std::make_shared<Square>(newSquare));
+        square->children[1] = mWorkspace.squares.allocate(newSquare);
     }
-    SharedSquare topRightChild = square->children.back();
+    Square *topRightChild      = square->children[1];
     topLeftChild->eastNeighbor = topRightChild;
 
     // Add bottom left child.
@@ -333,10 +351,10 @@ void FunctionMesh::refine(SharedSquare square) {
             .bottomLeftIdx  = square->bottomLeftIdx,
             .centerIdx      = newCenterIdx3,
         };
-        square->children.push_back(std::make_shared<Square>(newSquare));
+        square->children[2] = mWorkspace.squares.allocate(newSquare);
     }
-    SharedSquare bottomLeftChild = square->children.back();
-    topLeftChild->southNeighbor  = bottomLeftChild;
+    Square *bottomLeftChild     = square->children[2];
+    topLeftChild->southNeighbor = bottomLeftChild;
 
     // Add bottom right child.
 
@@ -361,129 +379,447 @@ void FunctionMesh::refine(SharedSquare square) {
             .bottomLeftIdx  = btmMidIdx,
             .centerIdx      = newCenterIdx4,
         };
-        square->children.push_back(std::make_shared<Square>(newSquare));
+        square->children[3] = mWorkspace.squares.allocate(newSquare);
     }
-    SharedSquare bottomRightChild = square->children.back();
+    Square *bottomRightChild      = square->children[3];
     topRightChild->southNeighbor  = bottomRightChild;
     bottomLeftChild->eastNeighbor = bottomRightChild;
+}
 
-    // Recurse if necessary.
-    for (auto &child : square->children) {
-        if (shouldRefine(*child)) {
-            refine(child);
+template <typename Func>
+bool BasicFunctionMesh<Func>::balance(Square *square) {
+    if (square->hasChildren()) {
+        bool subdivided = false;
+        for (Square *child : square->children) {
+            subdivided |= balance(child);
         }
+        return subdivided;
     }
+
+    // Children of a same-depth neighbor that touch the shared edge,
+    // indexed by the edge as seen from this square.
+    static constexpr uint32_t adjacentChildren[4][2] = {
+        {2, 3}, // North: neighbor's bottom children.
+        {0, 2}, // East: neighbor's left children.
+        {0, 1}, // South: neighbor's top children.
+        {1, 3}, // West: neighbor's right children.
+    };
+
+    for (Edge edge : ALL_EDGES) {
+        Square *neighbor = square->edgeNeighbor(edge);
+        if (neighbor == nullptr || neighbor->depth != square->depth || !neighbor->hasChildren()) {
+            continue;
+        }
+        for (uint32_t childPos : adjacentChildren[static_cast<uint8_t>(edge)]) {
+            if (neighbor->children[childPos]->hasChildren()) {
+                subdivide(square);
+                return true;
+            }
+        }
+    }
+    return false;
 }
 
 constexpr bool DEV_DEBUG = false;
 
-void FunctionMesh::addSquareTris(const SharedSquare &square) {
-    // If square has children, instead recurse into them.
-    if (square->hasChildren()) {
-        for (const SharedSquare &child : square->children) {
-            addSquareTris(child);
+template <typename Func>
+uint32_t BasicFunctionMesh<Func>::countSquareTris(const Square &square, uint32_t lod) {
+    if (!isLodLeaf(square, lod)) {
+        uint32_t numTris = 0;
+        for (const Square *child : square.children) {
+            numTris += countSquareTris(*child, lod);
         }
-        return;
+        return numTris;
+    }
+
+    uint8_t mask = 0;
+    for (Edge edge : ALL_EDGES) {
+        if (lodMidpointIdx(square, edge, lod) != UINT32_MAX) {
+            mask |= 1u << static_cast<uint8_t>(edge);
+        }
+    }
+    return stencils::STENCIL_TABLE[mask].numTris;
+}
+
+template <typename Func>
+uint32_t *BasicFunctionMesh<Func>::emitSquareTris(const Square &square, uint32_t *out, uint32_t lod) {
+    // If square has children drawn at this level of detail, instead
+    // recurse into them.
+    if (!isLodLeaf(square, lod)) {
+        for (const Square *child : square.children) {
+            out = emitSquareTris(*child, out, lod);
+        }
+        return out;
     }
     if constexpr (DEV_DEBUG) {
-        logIndices(*square);
+        logIndices(square);
         uint32_t square_i = 0;
-        std::cout << debugSquareCell(*square, square_i, false);
+        std::cout << debugSquareCell(square, square_i, false);
     }
 
-    auto addTri = [this](uint32_t idx1, uint32_t idx2, uint32_t idx3) {
-        Triangle newTri = {.vert1Idx = idx1, .vert2Idx = idx2, .vert3Idx = idx3};
-        mFunctionMeshTriangles.push_back(newTri);
-        size_t newTriIdx = mFunctionMeshTriangles.size() - 1;
-        mVertexTriangles[idx1].insert(newTriIdx);
-        mVertexTriangles[idx2].insert(newTriIdx);
-        mVertexTriangles[idx3].insert(newTriIdx);
-        if constexpr (DEV_DEBUG) {
-            debugTriangle(mFunctionMeshTriangles.back());
-        }
+    // Ordered to match stencils::LocalVertex.
+    std::array<uint32_t, stencils::NUM_LOCAL_VERTICES> localVerts = {
+        square.centerIdx,
+        square.topLeftIdx,
+        square.topRightIdx,
+        square.bottomRightIdx,
+        square.bottomLeftIdx,
+        lodMidpointIdx(square, Edge::North, lod),
+        lodMidpointIdx(square, Edge::East, lod),
+        lodMidpointIdx(square, Edge::South, lod),
+        lodMidpointIdx(square, Edge::West, lod),
     };
 
-    // Top triangles.
-    const auto &northRefinements = square->edgeRefinements.north;
-    for (uint32_t i = 0; i < northRefinements.size() - 1; i++) {
-        addTri(square->centerIdx, northRefinements[i + 1], northRefinements[i]);
+    uint8_t mask = 0;
+    for (Edge edge : ALL_EDGES) {
+        if (localVerts[stencils::NORTH_MID + static_cast<uint8_t>(edge)] != UINT32_MAX) {
+            mask |= 1u << static_cast<uint8_t>(edge);
+        }
     }
 
-    // Left triangles.
-    const auto &westRefinements = square->edgeRefinements.west;
-    for (uint32_t i = 0; i < westRefinements.size() - 1; i++) {
-        addTri(square->centerIdx, westRefinements[i], westRefinements[i + 1]);
+    const stencils::Stencil &stencil = stencils::STENCIL_TABLE[mask];
+    const uint32_t numIndices        = 3 * stencil.numTris;
+    for (uint32_t i = 0; i < numIndices; i++) {
+        out[i] = localVerts[stencil.indices[i]];
     }
+    return out + numIndices;
+}
 
-    // Bottom triangles.
-    const auto &southRefinements = square->edgeRefinements.south;
-    for (uint32_t i = 0; i < southRefinements.size() - 1; i++) {
-        addTri(square->centerIdx, southRefinements[i], southRefinements[i + 1]);
+template <typename Func>
+uint8_t BasicFunctionMesh<Func>::lodMaxDepth(const Square &square, uint32_t lod) {
+    if (lod == 0) {
+        return MAX_REFINEMENT_DEPTH;
+    }
+    const Square *root = &square;
+    while (root->parent != nullptr) {
+        root = root->parent;
     }
 
-    // Right triangles.
-    const auto &eastRefinements = square->edgeRefinements.east;
-    for (uint32_t i = 0; i < eastRefinements.size() - 1; i++) {
-        addTri(square->centerIdx, eastRefinements[i + 1], eastRefinements[i]);
+    // Ring of the top-level square in its cluster, 0 on the cluster's edge.
+    const int row         = static_cast<int>(std::lround(root->mTopLeft[1] * NUM_CELLS));
+    const int col         = static_cast<int>(std::lround(root->mTopLeft[0] * NUM_CELLS));
+    const int tileRow     = row % TILE_ROWS;
+    const int tileRows    = std::min(TILE_ROWS, NUM_CELLS - (row - tileRow));
+    const int clusterCol  = col % CLUSTER_COLS;
+    const int clusterCols = std::min(CLUSTER_COLS, NUM_CELLS - (col - clusterCol));
+    const int ring        = std::min({tileRow, tileRows - 1 - tileRow, clusterCol, clusterCols - 1 - clusterCol});
+
+    return static_cast<uint8_t>(MAX_REFINEMENT_DEPTH - std::min(static_cast<int>(lod), ring));
+}
+
+template <typename Func>
+bool BasicFunctionMesh<Func>::isLodLeaf(const Square &square, uint32_t lod) {
+    return !square.hasChildren() || square.depth >= lodMaxDepth(square, lod);
+}
+
+template <typename Func>
+uint32_t BasicFunctionMesh<Func>::lodMidpointIdx(const Square &square, Edge edge, uint32_t lod) {
+    if (lod == 0) {
+        return square.neighborMidpointIdx(edge);
+    }
+    Square *neighbor = square.edgeNeighbor(edge);
+    if (neighbor == nullptr || neighbor->depth != square.depth || isLodLeaf(*neighbor, lod)) {
+        return UINT32_MAX;
+    }
+    return neighbor->edgeMidpointIdx(oppositeEdge(edge));
+}
+
+template <typename Func>
+float BasicFunctionMesh<Func>::lodError(const Square &square, uint32_t lod) {
+    if (!square.hasChildren()) {
+        return 0.0f;
+    }
+    if (isLodLeaf(square, lod)) {
+        return coarseningError(square, square);
+    }
+    float error = 0.0f;
+    for (const Square *child : square.children) {
+        error = std::max(error, lodError(*child, lod));
+    }
+    return error;
+}
+
+template <typename Func>
+float BasicFunctionMesh<Func>::coarseningError(const Square &leaf, const Square &square) {
+    float error = 0.0f;
+    for (const Square *child : square.children) {
+        for (uint32_t vertex : {child->topLeftIdx, child->topRightIdx, child->bottomRightIdx, child->bottomLeftIdx,
+                                child->centerIdx}) {
+            const float coarseHeight = fanHeight(leaf, mVertX[vertex], mVertZ[vertex]);
+            error                    = std::max(error, std::abs(mVertY[vertex] - coarseHeight));
+        }
+        if (child->hasChildren()) {
+            error = std::max(error, coarseningError(leaf, *child));
+        }
     }
+    return error;
 }
 
-void FunctionMesh::addTriIndices(const Triangle &tri) {
-    mMeshIndices.push_back(tri.vert1Idx);
-    mMeshIndices.push_back(tri.vert2Idx);
-    mMeshIndices.push_back(tri.vert3Idx);
+template <typename Func>
+float BasicFunctionMesh<Func>::fanHeight(const Square &square, float x, float z) {
+    const float halfWidth = 0.5f * (square.mBtmRight[0] - square.mTopLeft[0]);
+    // Offsets from the center, in half widths; z grows southward.
+    const float u = (x - square.mTopLeft[0]) / halfWidth - 1.0f;
+    const float v = (z - square.mTopLeft[1]) / halfWidth - 1.0f;
+
+    // In the fan triangle over (x, z), s runs from the center to the edge
+    // and t along the edge, from corner a to corner b.
+    float s = 0.0f, t = 0.0f;
+    uint32_t a = 0, b = 0;
+    if (std::abs(u) >= std::abs(v)) {
+        s = std::abs(u);
+        t = v;
+        a = u >= 0.0f ? square.topRightIdx : square.topLeftIdx;
+        b = u >= 0.0f ? square.bottomRightIdx : square.bottomLeftIdx;
+    } else {
+        s = std::abs(v);
+        t = u;
+        a = v >= 0.0f ? square.bottomLeftIdx : square.topLeftIdx;
+        b = v >= 0.0f ? square.bottomRightIdx : square.topRightIdx;
+    }
+    return (1.0f - s) * mVertY[square.centerIdx] + 0.5f * (s - t) * mVertY[a] + 0.5f * (s + t) * mVertY[b];
 }
 
-void FunctionMesh::setFuncVertTBNs() {
-    // Assign normal and area to each triangle.
-    for (Triangle &tri : mFunctionMeshTriangles) {
-        mesh_util::assignTriangleNormalArea(tri, mFunctionMeshVertices);
+// Precondition: mMeshIndices holds the final triangle list.
+template <typename Func>
+void BasicFunctionMesh<Func>::buildVertexTriangles() {
+    const size_t numVerts = mVertX.size();
+
+    // Count triangles per vertex, shifted by one for the prefix sum.
+    mVertexTriOffsets.assign(numVerts + 1, 0);
+    for (uint32_t vertIdx : mMeshIndices) {
+        mVertexTriOffsets[vertIdx + 1]++;
+    }
+    for (size_t i = 1; i <= numVerts; i++) {
+        mVertexTriOffsets[i] += mVertexTriOffsets[i - 1];
     }
 
-    constexpr glm::dvec3 xDir = {1.0f, 0.0f, 0.0f};
-    constexpr glm::dvec3 zDir = {0.0f, 0.0f, 1.0f};
+    // Fill rows, using each row's start offset as its write cursor.
+    mVertexTriangles.resize(mMeshIndices.size());
+    for (uint32_t i = 0; i < mMeshIndices.size(); i++) {
+        mVertexTriangles[mVertexTriOffsets[mMeshIndices[i]]++] = i / 3;
+    }
 
-    // Now compute TBN basis for each vertex by averaging tri normals.
-    for (uint32_t i = 0; i < mFloorMeshVertices.size(); i++) {
-        Vertex &funcVert = mFunctionMeshVertices[i];
+    // Cursors now hold the next row's start; shift them back.
+    for (size_t i = numVerts; i > 0; i--) {
+        mVertexTriOffsets[i] = mVertexTriOffsets[i - 1];
+    }
+    mVertexTriOffsets[0] = 0;
+}
 
-        glm::dvec3 avgNormal = {0.0f, 0.0f, 0.0f};
-        for (uint32_t vertTriIdx : mVertexTriangles[i]) {
-            const Triangle &vertTri = mFunctionMeshTriangles[vertTriIdx];
-            avgNormal += vertTri.area * glm::dvec3(vertTri.normal);
+template <typename Func>
+typename BasicFunctionMesh<Func>::VerticesAndIndices BasicFunctionMesh<Func>::functionMeshOutput(
+    const TileFn &onTile) {
+    VerticesAndIndices output{
+        .vertices = std::vector<Vertex>(mVertX.size()),
+        .indices  = std::vector<uint32_t>(numIndices()),
+    };
+    std::copy(mLodIndices.begin(), mLodIndices.end(),
+              std::copy(mMeshIndices.begin(), mMeshIndices.end(), output.indices.begin()));
+    prepareTriangleNormals();
+
+    for (int tile = 0; tile < NUM_TILES; tile++) {
+        const uint32_t firstVertex = mTileVertexOffsets[tile];
+        const uint32_t endVertex   = mTileVertexOffsets[tile + 1];
+        packVertexRange(firstVertex, endVertex, output.vertices.data(), true);
+
+        if (onTile) {
+            const int endRow          = std::min((tile + 1) * TILE_ROWS, NUM_CELLS);
+            const uint32_t firstIndex = 3 * mFloorTriOffsets[tile * TILE_ROWS * NUM_CELLS];
+            // The last tile also carries the levels of detail.
+            const uint32_t endIndex = tile + 1 < NUM_TILES ? 3 * mFloorTriOffsets[endRow * NUM_CELLS]
+                                                           : static_cast<uint32_t>(output.indices.size());
+            onTile(MeshTile{
+                .firstVertex = firstVertex,
+                .vertices    = std::span<const Vertex>(output.vertices).subspan(firstVertex, endVertex - firstVertex),
+                .firstIndex  = firstIndex,
+                .indices     = std::span<const uint32_t>(output.indices).subspan(firstIndex, endIndex - firstIndex),
+            });
+        }
+    }
+    return output;
+}
+
+template <typename Func>
+void BasicFunctionMesh<Func>::writeFunctionMesh(Vertex *vertices, uint32_t *indices) {
+    prepareTriangleNormals();
+    packVertexRange(0, static_cast<uint32_t>(mVertX.size()), vertices, true);
+    std::copy(mLodIndices.begin(), mLodIndices.end(), std::copy(mMeshIndices.begin(), mMeshIndices.end(), indices));
+}
+
+template <typename Func>
+MeshMetadata BasicFunctionMesh<Func>::metadata() const {
+    MeshMetadata metadata;
+    metadata.numVertices = static_cast<uint32_t>(mVertX.size());
+    metadata.numIndices  = static_cast<uint32_t>(numIndices());
+    metadata.color       = FUNCT_COLOR;
+    if (mVertX.empty()) {
+        return metadata;
+    }
+
+    const auto [minX, maxX] = std::ranges::minmax(mVertX);
+    const auto [minY, maxY] = std::ranges::minmax(mVertY);
+    const auto [minZ, maxZ] = std::ranges::minmax(mVertZ);
+    metadata.boundsMin      = {minX, minY, minZ};
+    metadata.boundsMax      = {maxX, maxY, maxZ};
+    metadata.clusters.assign(mClusters.begin(), mClusters.end());
+    return metadata;
+}
+
+template <typename Func>
+void BasicFunctionMesh<Func>::prepareTriangleNormals() {
+    constexpr uint32_t TRI_BLOCK_SIZE = 4096;
+
+    const auto numTris = static_cast<uint32_t>(mMeshIndices.size() / 3);
+    mTriNormalX.resize(numTris);
+    mTriNormalY.resize(numTris);
+    mTriNormalZ.resize(numTris);
+    jobs::parallelFor(numTris, TRI_BLOCK_SIZE, [this](uint32_t begin, uint32_t end) {
+        mCancel.throwIfCancelled();
+        computeTriangleNormals(begin, end);
+    });
+}
+
+template <typename Func>
+void BasicFunctionMesh<Func>::packVertexRange(uint32_t begin, uint32_t end, Vertex *vertices,
+                                              bool numericalNormals) {
+    jobs::parallelFor(end - begin, PACK_BLOCK_SIZE, [=, this](uint32_t blockBegin, uint32_t blockEnd) {
+        mCancel.throwIfCancelled();
+        packVertexBlock(begin + blockBegin, begin + blockEnd, vertices + begin + blockBegin, numericalNormals);
+    });
+}
+
+template <typename Func>
+void BasicFunctionMesh<Func>::computeTriangleNormals(uint32_t begin, uint32_t end) {
+    // The cross product of two edges has length twice the area, so these
+    // are already weighted by area for averaging at the vertices.
+    for (uint32_t t = begin; t < end; t++) {
+        const uint32_t i1 = mMeshIndices[3 * t];
+        const uint32_t i2 = mMeshIndices[3 * t + 1];
+        const uint32_t i3 = mMeshIndices[3 * t + 2];
+
+        const float e1x = mVertX[i2] - mVertX[i1];
+        const float e1y = mVertY[i2] - mVertY[i1];
+        const float e1z = mVertZ[i2] - mVertZ[i1];
+        const float e2x = mVertX[i3] - mVertX[i1];
+        const float e2y = mVertY[i3] - mVertY[i1];
+        const float e2z = mVertZ[i3] - mVertZ[i1];
+
+        mTriNormalX[t] = e1y * e2z - e1z * e2y;
+        mTriNormalY[t] = e1z * e2x - e1x * e2z;
+        mTriNormalZ[t] = e1x * e2y - e1y * e2x;
+    }
+}
+
+template <typename Func>
+void BasicFunctionMesh<Func>::packVertexBlock(uint32_t begin, uint32_t end, Vertex *out, bool numericalNormals) {
+    assert(end - begin <= PACK_BLOCK_SIZE);
+    const uint32_t count = end - begin;
+
+    // Block-local parallel arrays, so the orthonormalization below is a
+    // branch-free loop over contiguous floats that the compiler vectorizes.
+    alignas(64) std::array<float, PACK_BLOCK_SIZE> nx, ny, nz;
+    alignas(64) std::array<float, PACK_BLOCK_SIZE> tx, ty, tz;
+    alignas(64) std::array<float, PACK_BLOCK_SIZE> bx, by, bz;
+
+    // Blend the averaged triangle normal with the numerical normal, using
+    // the second derivative estimate to decide how much of each to use.
+    // (See the note below.)
+    for (uint32_t k = 0; k < count; k++) {
+        const uint32_t i = begin + k;
+
+        glm::dvec3 avgNormal = {0.0, 0.0, 0.0};
+        for (uint32_t j = mVertexTriOffsets[i]; j < mVertexTriOffsets[i + 1]; j++) {
+            const uint32_t tri = mVertexTriangles[j];
+            avgNormal += glm::dvec3(mTriNormalX[tri], mTriNormalY[tri], mTriNormalZ[tri]);
         }
         avgNormal = glm::normalize(avgNormal);
 
-        glm::dvec3 numNormal = normalAtPoint(funcVert.pos);
-        double secondDeriv   = secondDerivEstMax(funcVert.pos);
-        double t             = mSecondDerivCutoff(secondDeriv);
-        glm::dvec3 normal    = glm::normalize(t * numNormal + (1.0 - t) * avgNormal);
+        glm::dvec3 normal = avgNormal;
+        if (numericalNormals) {
+            PointDerivs derivs   = derivsAtPoint(mVertX[i], mVertZ[i]);
+            glm::dvec3 numNormal = glm::normalize(glm::dvec3(-derivs.dydx, 1.0, -derivs.dydz));
+            double t             = DIRECT_NORMALS ? 1.0 : mSecondDerivCutoff(derivs.secondDerivMax);
+            normal               = t * numNormal + (1.0 - t) * avgNormal;
 
-        if constexpr (DEV_DEBUG) {
-            spdlog::trace("Vertex pos 2nd deriv est: {}", secondDeriv);
-            spdlog::trace("- t = : {}", t);
+            if constexpr (DEV_DEBUG) {
+                spdlog::trace("Vertex pos 2nd deriv est: {}", derivs.secondDerivMax);
+                spdlog::trace("- t = : {}", t);
+            }
         }
 
-        // Here we use the second derivate estimate to deicde how much
-        // to interpolate this averaged triangle normal with the directly-
-        // computed normal. (See the note below.)
+        nx[k] = static_cast<float>(normal.x);
+        ny[k] = static_cast<float>(normal.y);
+        nz[k] = static_cast<float>(normal.z);
+    }
+
+    // Gram-Schmidt on normal, x-axis and z-axis to get an ONB.
+    for (uint32_t k = 0; k < count; k++) {
+        const float nInv = 1.0f / std::sqrt(nx[k] * nx[k] + ny[k] * ny[k] + nz[k] * nz[k]);
+        const float n0   = nx[k] * nInv;
+        const float n1   = ny[k] * nInv;
+        const float n2   = nz[k] * nInv;
+
+        // t = x - (x . n) n
+        float t0         = 1.0f - n0 * n0;
+        float t1         = -n0 * n1;
+        float t2         = -n0 * n2;
+        const float tInv = 1.0f / std::sqrt(t0 * t0 + t1 * t1 + t2 * t2);
+        t0 *= tInv;
+        t1 *= tInv;
+        t2 *= tInv;
+
+        // b = z - (z . n) n - (z . t) t
+        float b0         = -n2 * n0 - t2 * t0;
+        float b1         = -n2 * n1 - t2 * t1;
+        float b2         = 1.0f - n2 * n2 - t2 * t2;
+        const float bInv = 1.0f / std::sqrt(b0 * b0 + b1 * b1 + b2 * b2);
+
+        nx[k] = n0;
+        ny[k] = n1;
+        nz[k] = n2;
+        tx[k] = t0;
+        ty[k] = t1;
+        tz[k] = t2;
+        bx[k] = b0 * bInv;
+        by[k] = b1 * bInv;
+        bz[k] = b2 * bInv;
+    }
 
-        // Use Gram-Schmidt to get ONB.
-        glm::dvec3 tangent = glm::normalize(xDir - glm::dot(xDir, normal) * normal);
-        glm::dvec3 bitangent =
-            glm::normalize(zDir - glm::dot(zDir, normal) * normal - glm::dot(zDir, tangent) * tangent);
+#ifndef NDEBUG
+    // Verify orientation and orthonormality.
+    constexpr float TRIPLE_ERROR_TOLERANCE = 0.01f;
+    for (uint32_t k = 0; k < count; k++) {
+        glm::vec3 normal    = {nx[k], ny[k], nz[k]};
+        glm::vec3 tangent   = {tx[k], ty[k], tz[k]};
+        glm::vec3 bitangent = {bx[k], by[k], bz[k]};
 
-        // Verify orientation and orthonormality.
-        constexpr float TRIPLE_ERROR_TOLERANCE = 0.01f;
-        float scalarTriple                     = glm::dot(normal, glm::cross(bitangent, tangent));
+        float scalarTriple = glm::dot(normal, glm::cross(bitangent, tangent));
         if (std::abs(scalarTriple - 1.0f) >= TRIPLE_ERROR_TOLERANCE) {
             std::cout << "TBN scalar triple product: " << std::to_string(scalarTriple) << std::endl;
         }
         assert(std::abs(scalarTriple - 1.0f) < TRIPLE_ERROR_TOLERANCE);
+    }
+#endif
+
+    // Indexed by the REFINE_COLOR_MASK bits of the vertex flags.
+    static constexpr glm::vec3 vertexColors[] = {
+        FUNCT_COLOR,
+        REFINE_DEBUG_COLOR1,
+        REFINE_DEBUG_COLOR2,
+        REFINE_DEBUG_COLOR3,
+    };
+
+    for (uint32_t k = 0; k < count; k++) {
+        const uint32_t i = begin + k;
 
-        funcVert.tangent   = glm::vec3(tangent);
-        funcVert.bitangent = glm::vec3(bitangent);
-        funcVert.normal    = glm::vec3(normal);
+        out[k] = Vertex{
+            .pos       = {mVertX[i], mVertY[i], mVertZ[i]},
+            .color     = vertexColors[mVertFlags[i] & REFINE_COLOR_MASK],
+            .tangent   = {tx[k], ty[k], tz[k]},
+            .bitangent = {bx[k], by[k], bz[k]},
+            .normal    = {nx[k], ny[k], nz[k]},
+        };
     }
 }
 
@@ -500,62 +836,26 @@ void FunctionMesh::setFuncVertTBNs() {
 // which may be due to averaging with normal computed from farther-away
 // vertices.
 //
-// The setFuncVertTBNs function now tries to interpolate between each
+// The packVertexBlock function now tries to interpolate between each
 // version of the normals based on the magnitude of the second
 // derivative of the function as a measure of the surface curvature.
 //
 // Either way, there is a limit to how much accuracy we can get when the
 // features of the function are changing fast compared to the distance
-// between vertices, due to the effect of fragment interpolation. Another
-// idea is to compute the normals at a higher-resolution grid of points
-// and put them into a multidimensional texture that the fragment shader
-// can sample.
-
-glm::dvec3 FunctionMesh::normalAtPoint(const glm::vec3 &pos) {
-    double x = pos.x;
-    double z = pos.z;
-
-    double dydx = (mFunc(x + H, z) - mFunc(x - H, z)) / (2.0 * H);
-    double dydz = (mFunc(x, z + H) - mFunc(x, z - H)) / (2.0 * H);
-
-    return glm::normalize(glm::dvec3(-dydx, 1.0, -dydz));
-}
-
-void FunctionMesh::setFuncVertTBNsDirect() {
-    spdlog::trace("Setting vertex TBN vectors using direct method...");
-
-    for (Vertex &vert : mFunctionMeshVertices) {
-        // Convert to double precision for computation.
-        double x = vert.pos.x;
-        double z = vert.pos.z;
-
-        double dydx = (mFunc(x + H, z) - mFunc(x - H, z)) / (2.0 * H);
-        double dydz = (mFunc(x, z + H) - mFunc(x, z - H)) / (2.0 * H);
-
-        glm::dvec3 tx     = glm::normalize(glm::dvec3(1.0, dydx, 0.0));
-        glm::dvec3 tz     = glm::normalize(glm::dvec3(0.0, dydz, 1.0));
-        glm::dvec3 normal = glm::normalize(glm::dvec3(-dydx, 1.0, -dydz));
-
-        // Sanity check.
-        constexpr float ORTHO_ERROR_TOLERANCE = 1e-8;
-        double txDotN                         = glm::dot(tx, normal);
-        double tzDotN                         = glm::dot(tz, normal);
-        if (std::abs(txDotN) > ORTHO_ERROR_TOLERANCE || std::abs(tzDotN) > ORTHO_ERROR_TOLERANCE) {
-            spdlog::debug("Vertex TBN vectors failed orthogonality check.");
-        }
-
-        vert.tangent   = glm::vec3(tx);
-        vert.bitangent = glm::vec3(tz);
-        vert.normal    = glm::vec3(normal);
-    }
-}
+// between vertices, due to the effect of fragment interpolation. So the
+// graph is now also given a NormalMap, gradients on a much finer grid
+// that pbr2.frag samples for its normals; see normal_map.h.
 
 // New method. Once complete will replace old methods.
-void FunctionMesh::computeVerticesAndIndices() {
-    mFloorMeshVertices.clear();
-    mFloorMeshVertices.reserve((NUM_CELLS + 1) * (NUM_CELLS + 1) + NUM_CELLS * NUM_CELLS);
-
-    for (auto &square : mFloorMeshSquares) {
+template <typename Func>
+void BasicFunctionMesh<Func>::computeVerticesAndIndices() {
+    constexpr size_t numGridVerts = (NUM_CELLS + 1) * (NUM_CELLS + 1) + NUM_CELLS * NUM_CELLS;
+    mVertX.reserve(numGridVerts);
+    mVertZ.reserve(numGridVerts);
+    mVertY.reserve(numGridVerts);
+    mVertFlags.reserve(numGridVerts);
+
+    for (Square *square : mFloorMeshSquares) {
         float centerX = 0.5 * (square->mTopLeft[0] + square->mBtmRight[0]);
         float centerZ = 0.5 * (square->mTopLeft[1] + square->mBtmRight[1]);
 
@@ -571,210 +871,317 @@ void FunctionMesh::computeVerticesAndIndices() {
 
         // Add remaining unassigned vertices and indices.
         if (square->topLeftIdx == UINT32_MAX) {
-            addFloorMeshVertex(square->mTopLeft[0], square->mTopLeft[1]);
-            square->topLeftIdx = mFloorMeshVertices.size() - 1;
+            square->topLeftIdx = addVertex(square->mTopLeft[0], square->mTopLeft[1]);
         }
         if (square->topRightIdx == UINT32_MAX) {
-            addFloorMeshVertex(square->mBtmRight[0], square->mTopLeft[1]);
-            square->topRightIdx = mFloorMeshVertices.size() - 1;
+            square->topRightIdx = addVertex(square->mBtmRight[0], square->mTopLeft[1]);
         }
         if (square->bottomRightIdx == UINT32_MAX) {
-            addFloorMeshVertex(square->mBtmRight[0], square->mBtmRight[1]);
-            square->bottomRightIdx = mFloorMeshVertices.size() - 1;
+            square->bottomRightIdx = addVertex(square->mBtmRight[0], square->mBtmRight[1]);
         }
         if (square->bottomLeftIdx == UINT32_MAX) {
-            addFloorMeshVertex(square->mTopLeft[0], square->mBtmRight[1]);
-            square->bottomLeftIdx = mFloorMeshVertices.size() - 1;
+            square->bottomLeftIdx = addVertex(square->mTopLeft[0], square->mBtmRight[1]);
         }
 
         // Add center vertex and index.
-        addFloorMeshVertex(centerX, centerZ);
-        square->centerIdx = mFloorMeshVertices.size() - 1;
+        square->centerIdx = addVertex(centerX, centerZ);
     }
     spdlog::trace("Added floor mesh squares.");
 
-    // Copy vertex data
-    mFunctionMeshVertices = mFloorMeshVertices;
-    for (auto &vertex : mFunctionMeshVertices) {
-        vertex.color = FUNCT_COLOR;
-        vertex.pos.y = static_cast<float>(mFunc(vertex.pos.x, vertex.pos.z));
-    }
+    // Evaluate the function over the grid vertices in one pass.
+    constexpr uint32_t EVAL_BLOCK_SIZE = 2048;
 
-    // Refine squares and populate initial edge refinements.
-    for (auto &square : mFloorMeshSquares) {
-        if (shouldRefine(*square)) {
-            refine(square);
+    mVertY.resize(mVertX.size());
+    jobs::parallelFor(static_cast<uint32_t>(mVertX.size()), EVAL_BLOCK_SIZE, [this](uint32_t begin, uint32_t end) {
+        mCancel.throwIfCancelled();
+        for (uint32_t i = begin; i < end; i++) {
+            mVertY[i] = static_cast<float>(mFunc(mVertX[i], mVertZ[i]));
         }
-        [[maybe_unused]] auto &_ = square->populateRefinements();
-    }
-    spdlog::trace("Populated refinements.");
-
-    // Update edge refinements from neighbors to make mesh water tight.
-    for (auto &square : mFloorMeshSquares) {
-        syncEdgeRefinements(square);
-    }
-
-    mMeshIndices.clear();
-    // NOTE: This size will not be accurate if refinement happens, but it
-    //       is okay if this reallocates as nothing references its data.
-    mMeshIndices.reserve(mFloorMeshSquares.size() * 12);
-    mFunctionMeshTriangles.clear();
-    mVertexTriangles.resize(mFunctionMeshVertices.size());
+    });
 
-    // Create triangles for squares.
-    for (auto &square : mFloorMeshSquares) {
-        addSquareTris(square);
-    }
+    // Refine one level at a time, so that a complete mesh exists after each
+    // level. Only squares created by refinement are candidates for the next
+    // level, which gives the same tree as refining each square depth-first.
+    mRefineFrontier.assign(mFloorMeshSquares.begin(), mFloorMeshSquares.end());
+    publishProgress();
+
+    for (uint8_t level = 1; level <= MAX_REFINEMENT_DEPTH && !mRefineFrontier.empty(); level++) {
+        mNextRefineFrontier.clear();
+        for (Square *square : mRefineFrontier) {
+            mCancel.throwIfCancelled();
+            if (shouldRefine(*square)) {
+                subdivide(square);
+                mNextRefineFrontier.insert(mNextRefineFrontier.end(), square->children.begin(),
+                                           square->children.end());
+            }
+        }
+        mRefineFrontier.swap(mNextRefineFrontier);
+        balanceTree();
+        spdlog::trace("Refined and balanced squares to level {}.", level);
 
-    // Create indices for triangles.
-    for (const Triangle &tri : mFunctionMeshTriangles) {
-        addTriIndices(tri);
+        if (level < MAX_REFINEMENT_DEPTH && !mRefineFrontier.empty()) {
+            publishProgress();
+        }
     }
 
-    if constexpr (DIRECT_NORMALS) {
-        setFuncVertTBNsDirect();
-    } else {
-        setFuncVertTBNs();
-    }
+    emitTriangles();
+    orderVerticesByTile();
+    computeClusters();
+    buildClusterLods();
+    // Record triangle adjacency for vertex normals, computed when packing.
+    buildVertexTriangles();
 }
 
-static SharedSquare getNorthNeighbor(SharedSquare &square) {
-    SharedSquare *localSquare = &square;
-    while (localSquare != nullptr && *localSquare != nullptr) {
-        if ((*localSquare)->northNeighbor != nullptr) {
-            return (*localSquare)->northNeighbor;
-        } else {
-            localSquare = &(*localSquare)->parent;
+template <typename Func>
+void BasicFunctionMesh<Func>::balanceTree() {
+    bool subdivided = true;
+    while (subdivided) {
+        mCancel.throwIfCancelled();
+        subdivided = false;
+        for (auto &square : mFloorMeshSquares) {
+            subdivided |= balance(square);
         }
     }
-    return nullptr;
 }
-static SharedSquare getSouthNeighbor(SharedSquare &square) {
-    SharedSquare *localSquare = &square;
-    while (localSquare != nullptr && *localSquare != nullptr) {
-        if ((*localSquare)->southNeighbor != nullptr) {
-            return (*localSquare)->southNeighbor;
-        } else {
-            localSquare = &(*localSquare)->parent;
+
+template <typename Func>
+void BasicFunctionMesh<Func>::emitTriangles() {
+    // Write leaf stencil triangles straight into the index buffer. Each
+    // top-level square gets its own range, so they are written in parallel.
+    constexpr uint32_t SQUARE_BLOCK_SIZE = 512;
+    const auto numSquares                = static_cast<uint32_t>(mFloorMeshSquares.size());
+
+    mFloorTriOffsets.resize(numSquares + 1);
+    mFloorTriOffsets[0] = 0;
+    jobs::parallelFor(numSquares, SQUARE_BLOCK_SIZE, [this](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+            mFloorTriOffsets[i + 1] = countSquareTris(*mFloorMeshSquares[emittedSquare(i)]);
         }
+    });
+    for (uint32_t i = 1; i <= numSquares; i++) {
+        mFloorTriOffsets[i] += mFloorTriOffsets[i - 1];
     }
-    return nullptr;
-}
-static SharedSquare getEastNeighbor(SharedSquare &square) {
-    SharedSquare *localSquare = &square;
-    while (localSquare != nullptr && *localSquare != nullptr) {
-        if ((*localSquare)->eastNeighbor != nullptr) {
-            return (*localSquare)->eastNeighbor;
-        } else {
-            localSquare = &(*localSquare)->parent;
+    mMeshIndices.resize(3 * static_cast<size_t>(mFloorTriOffsets[numSquares]));
+
+    jobs::parallelFor(numSquares, SQUARE_BLOCK_SIZE, [this](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+            [[maybe_unused]] uint32_t *indicesEnd =
+                emitSquareTris(*mFloorMeshSquares[emittedSquare(i)], mMeshIndices.data() + 3 * mFloorTriOffsets[i]);
+            assert(indicesEnd == mMeshIndices.data() + 3 * mFloorTriOffsets[i + 1]);
         }
-    }
-    return nullptr;
+    });
 }
-static SharedSquare getWestNeighbor(SharedSquare &square) {
-    SharedSquare *localSquare = &square;
-    while (localSquare != nullptr && *localSquare != nullptr) {
-        if ((*localSquare)->westNeighbor != nullptr) {
-            return (*localSquare)->westNeighbor;
-        } else {
-            localSquare = &(*localSquare)->parent;
-        }
-    }
-    return nullptr;
+
+template <typename Func>
+uint32_t BasicFunctionMesh<Func>::clusterStart(int tile, int column) {
+    const int tileRows = std::min(TILE_ROWS, NUM_CELLS - tile * TILE_ROWS);
+    return static_cast<uint32_t>(tile * TILE_ROWS * NUM_CELLS + std::min(column * CLUSTER_COLS, NUM_CELLS) * tileRows);
 }
 
-// Precondition: to and from are sorted left-to-right.
-void FunctionMesh::syncRefmtsHoriz(std::vector<uint32_t> &to, std::vector<uint32_t> &from) {
-    assert(!to.empty());
+template <typename Func>
+uint32_t BasicFunctionMesh<Func>::emittedSquare(uint32_t position) {
+    const int tile     = static_cast<int>(position) / (TILE_ROWS * NUM_CELLS);
+    const int tileRows = std::min(TILE_ROWS, NUM_CELLS - tile * TILE_ROWS);
+    const int inTile   = static_cast<int>(position) - tile * TILE_ROWS * NUM_CELLS;
 
-    auto getX = [this](size_t index) -> float {
-        return mFloorMeshVertices[index].pos.x; //
-    };
+    // Every cluster before the last in a tile is full width.
+    const int column      = inTile / (CLUSTER_COLS * tileRows);
+    const int clusterCols = std::min(CLUSTER_COLS, NUM_CELLS - column * CLUSTER_COLS);
+    const int inCluster   = inTile - column * CLUSTER_COLS * tileRows;
 
-    float leftLim  = getX(to.front());
-    float rightLim = getX(to.back());
+    const int row = tile * TILE_ROWS + inCluster / clusterCols;
+    const int col = column * CLUSTER_COLS + inCluster % clusterCols;
+    return static_cast<uint32_t>(row * NUM_CELLS + col);
+}
 
-    for (uint32_t fromIdx : from) {
-        float fromX = getX(fromIdx);
-        if (leftLim < fromX && fromX < rightLim) {
-            to.push_back(fromIdx);
+template <typename Func>
+void BasicFunctionMesh<Func>::orderVerticesByTile() {
+    const auto numVerts = static_cast<uint32_t>(mVertX.size());
+
+    // Number vertices by first use. Triangles are emitted tile by tile, so
+    // each tile's new vertices form one range.
+    mVertexRemap.assign(numVerts, UINT32_MAX);
+    mTileVertexOffsets.resize(NUM_TILES + 1);
+    uint32_t nextVertex = 0;
+    for (int tile = 0; tile < NUM_TILES; tile++) {
+        mTileVertexOffsets[tile] = nextVertex;
+
+        const int endRow        = std::min((tile + 1) * TILE_ROWS, NUM_CELLS);
+        const uint32_t endIndex = 3 * mFloorTriOffsets[endRow * NUM_CELLS];
+        for (uint32_t i = 3 * mFloorTriOffsets[tile * TILE_ROWS * NUM_CELLS]; i < endIndex; i++) {
+            if (mVertexRemap[mMeshIndices[i]] == UINT32_MAX) {
+                mVertexRemap[mMeshIndices[i]] = nextVertex++;
+            }
         }
     }
+    // Vertices no triangle uses go in the last tile.
+    for (uint32_t &newIdx : mVertexRemap) {
+        if (newIdx == UINT32_MAX) {
+            newIdx = nextVertex++;
+        }
+    }
+    mTileVertexOffsets[NUM_TILES] = nextVertex;
 
-    // Now re-sort by x-coord and remove duplicates.
-    std::sort(to.begin(), to.end(), [getX](uint32_t a, uint32_t b) {
-        return getX(a) < getX(b); //
-    });
-    auto last = std::unique(to.begin(), to.end(), [getX](uint32_t a, uint32_t b) {
-        return getX(a) == getX(b); //
-    });
-    to.erase(last, to.end());
-}
-
-// Precondition: to and from are sorted by increasing z.
-void FunctionMesh::syncRefmtsVert(std::vector<uint32_t> &to, std::vector<uint32_t> &from) {
-    assert(!to.empty());
-
-    auto getZ = [this](size_t index) -> float {
-        return mFloorMeshVertices[index].pos.z; //
+    auto permute = [this, numVerts](auto &values, auto &scratch) {
+        scratch.resize(numVerts);
+        for (uint32_t i = 0; i < numVerts; i++) {
+            scratch[mVertexRemap[i]] = values[i];
+        }
+        values.swap(scratch);
     };
+    permute(mVertX, mWorkspace.vertScratch);
+    permute(mVertZ, mWorkspace.vertScratch);
+    permute(mVertY, mWorkspace.vertScratch);
+    permute(mVertFlags, mWorkspace.vertFlagsScratch);
+
+    constexpr uint32_t INDEX_BLOCK_SIZE  = 16384;
+    constexpr uint32_t SQUARE_BLOCK_SIZE = 512;
+
+    jobs::parallelFor(static_cast<uint32_t>(mMeshIndices.size()), INDEX_BLOCK_SIZE,
+                      [this](uint32_t begin, uint32_t end) {
+                          for (uint32_t i = begin; i < end; i++) {
+                              mMeshIndices[i] = mVertexRemap[mMeshIndices[i]];
+                          }
+                      });
+    // Keep the squares consistent with the new numbering, for building
+    // levels of detail and for debugging.
+    jobs::parallelFor(static_cast<uint32_t>(mFloorMeshSquares.size()), SQUARE_BLOCK_SIZE,
+                      [this](uint32_t begin, uint32_t end) {
+                          for (uint32_t i = begin; i < end; i++) {
+                              remapSquareIndices(*mFloorMeshSquares[i]);
+                          }
+                      });
+}
 
-    float leftLim  = getZ(to.front());
-    float rightLim = getZ(to.back());
+template <typename Func>
+void BasicFunctionMesh<Func>::computeClusters() {
+    constexpr uint32_t CLUSTER_BLOCK_SIZE = 16;
+
+    mClusters.resize(NUM_TILES * NUM_CLUSTER_COLS);
+    const auto numClusters = static_cast<uint32_t>(mClusters.size());
+    jobs::parallelFor(numClusters, CLUSTER_BLOCK_SIZE, [this](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+            const int tile            = static_cast<int>(i) / NUM_CLUSTER_COLS;
+            const int column          = static_cast<int>(i) % NUM_CLUSTER_COLS;
+            const uint32_t firstIndex = 3 * mFloorTriOffsets[clusterStart(tile, column)];
+            const uint32_t endIndex   = 3 * mFloorTriOffsets[clusterStart(tile, column + 1)];
+
+            MeshCluster &cluster = mClusters[i];
+            cluster              = {};
+            cluster.lods[0]      = {firstIndex, endIndex - firstIndex};
+            if (firstIndex == endIndex) {
+                continue;
+            }
 
-    for (uint32_t fromIdx : from) {
-        float fromX = getZ(fromIdx);
-        if (leftLim < fromX && fromX < rightLim) {
-            to.push_back(fromIdx);
+            const uint32_t first = mMeshIndices[firstIndex];
+            cluster.boundsMin    = {mVertX[first], mVertY[first], mVertZ[first]};
+            cluster.boundsMax    = cluster.boundsMin;
+            for (uint32_t j = firstIndex + 1; j < endIndex; j++) {
+                const uint32_t vertex = mMeshIndices[j];
+                const glm::vec3 pos   = {mVertX[vertex], mVertY[vertex], mVertZ[vertex]};
+                cluster.boundsMin     = glm::min(cluster.boundsMin, pos);
+                cluster.boundsMax     = glm::max(cluster.boundsMax, pos);
+            }
         }
-    }
-
-    // Now re-sort by z-coord and remove duplicates.
-    std::sort(to.begin(), to.end(), [getZ](uint32_t a, uint32_t b) {
-        return getZ(a) < getZ(b); //
     });
-    auto last = std::unique(to.begin(), to.end(), [getZ](uint32_t a, uint32_t b) {
-        return getZ(a) == getZ(b); //
-    });
-    to.erase(last, to.end());
 }
 
-// Precondition: All edge refinments have been populated.
-void FunctionMesh::syncEdgeRefinements(SharedSquare &square) {
-    if (square->hasChildren()) {
-        for (auto &child : square->children) {
-            syncEdgeRefinements(child);
+template <typename Func>
+void BasicFunctionMesh<Func>::buildClusterLods() {
+    constexpr uint32_t CLUSTER_BLOCK_SIZE = 16;
+    constexpr uint32_t LODS_PER_CLUSTER   = NUM_LODS - 1;
+
+    const auto numClusters = static_cast<uint32_t>(mClusters.size());
+    auto forEachSquare     = [this](uint32_t cluster, auto &&fn) {
+        const int tile   = static_cast<int>(cluster) / NUM_CLUSTER_COLS;
+        const int column = static_cast<int>(cluster) % NUM_CLUSTER_COLS;
+        for (uint32_t i = clusterStart(tile, column); i < clusterStart(tile, column + 1); i++) {
+            fn(*mFloorMeshSquares[emittedSquare(i)]);
         }
-        // This only needs done for leaf cells, which are rendered.
-        return;
-    }
+    };
 
-    SharedSquare northNb = getNorthNeighbor(square);
-    if (northNb != nullptr) {
-        auto &northNbRefs = northNb->edgeRefinements.south;
-        if (northNbRefs.size() > 2) {
-            syncRefmtsHoriz(square->edgeRefinements.north, northNbRefs);
+    // Count each level's triangles, so they can be written in parallel. A
+    // level that drops nothing shares the next finer level's range.
+    std::vector<uint32_t> lodTriOffsets(numClusters * LODS_PER_CLUSTER + 1, 0);
+    jobs::parallelFor(numClusters, CLUSTER_BLOCK_SIZE, [&](uint32_t begin, uint32_t end) {
+        mCancel.throwIfCancelled();
+        for (uint32_t i = begin; i < end; i++) {
+            MeshCluster &cluster = mClusters[i];
+            cluster.numLods      = NUM_LODS;
+            for (uint32_t lod = 1; lod < NUM_LODS; lod++) {
+                uint32_t numTris = 0;
+                float error      = cluster.lods[lod - 1].error;
+                forEachSquare(i, [&](const Square &square) {
+                    numTris += countSquareTris(square, lod);
+                    error = std::max(error, lodError(square, lod));
+                });
+                cluster.lods[lod] = {0, 3 * numTris, error};
+
+                const bool sameAsFiner = cluster.lods[lod].numIndices == cluster.lods[lod - 1].numIndices;
+                lodTriOffsets[i * LODS_PER_CLUSTER + lod] = sameAsFiner ? 0 : numTris;
+            }
         }
+    });
+    for (size_t i = 1; i < lodTriOffsets.size(); i++) {
+        lodTriOffsets[i] += lodTriOffsets[i - 1];
     }
-    SharedSquare southNb = getSouthNeighbor(square);
-    if (southNb != nullptr) {
-        auto &southNbRefs = southNb->edgeRefinements.north;
-        if (southNbRefs.size() > 2) {
-            syncRefmtsHoriz(square->edgeRefinements.south, southNbRefs);
+    mLodIndices.resize(3 * static_cast<size_t>(lodTriOffsets.back()));
+
+    const auto firstLodIndex = static_cast<uint32_t>(mMeshIndices.size());
+    jobs::parallelFor(numClusters, CLUSTER_BLOCK_SIZE, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+            MeshCluster &cluster = mClusters[i];
+            for (uint32_t lod = 1; lod < NUM_LODS; lod++) {
+                if (cluster.lods[lod].numIndices == cluster.lods[lod - 1].numIndices) {
+                    cluster.lods[lod].firstIndex = cluster.lods[lod - 1].firstIndex;
+                    continue;
+                }
+                const uint32_t offset        = 3 * lodTriOffsets[i * LODS_PER_CLUSTER + lod - 1];
+                cluster.lods[lod].firstIndex = firstLodIndex + offset;
+
+                uint32_t *out = mLodIndices.data() + offset;
+                forEachSquare(i, [&](const Square &square) { out = emitSquareTris(square, out, lod); });
+            }
         }
+    });
+}
+
+template <typename Func>
+void BasicFunctionMesh<Func>::remapSquareIndices(Square &square) {
+    for (uint32_t *vertIdx : {&square.topLeftIdx, &square.topRightIdx, &square.bottomRightIdx,
+                              &square.bottomLeftIdx, &square.centerIdx}) {
+        *vertIdx = mVertexRemap[*vertIdx];
     }
-    SharedSquare eastNb = getEastNeighbor(square);
-    if (eastNb != nullptr) {
-        auto &eastNbRefs = eastNb->edgeRefinements.west;
-        if (eastNbRefs.size() > 2) {
-            syncRefmtsVert(square->edgeRefinements.east, eastNbRefs);
+    if (square.hasChildren()) {
+        for (Square *child : square.children) {
+            remapSquareIndices(*child);
         }
     }
-    SharedSquare westNb = getWestNeighbor(square);
-    if (westNb != nullptr) {
-        auto &westNbRefs = westNb->edgeRefinements.east;
-        if (westNbRefs.size() > 2) {
-            syncRefmtsVert(square->edgeRefinements.west, westNbRefs);
-        }
+}
+
+template <typename Func>
+void BasicFunctionMesh<Func>::publishProgress() {
+    if (!mOnProgress) {
+        return;
     }
+    emitTriangles();
+    buildVertexTriangles();
+
+    // Previews skip the numerical normals, which cost several function
+    // evaluations per vertex; the averaged triangle normals are enough
+    // for a mesh that is about to be replaced.
+    VerticesAndIndices preview{
+        .vertices = std::vector<Vertex>(mVertX.size()),
+        .indices  = std::vector<uint32_t>(mMeshIndices.begin(), mMeshIndices.end()),
+    };
+    prepareTriangleNormals();
+    packVertexRange(0, static_cast<uint32_t>(preview.vertices.size()), preview.vertices.data(), false);
+    mOnProgress(std::move(preview));
 }
+
+// Explicit instantiations.
+
+template class BasicFunctionMesh<std::function<FuncXZ>>;
+template class BasicFunctionMesh<builtin_functions::Parabolic>;
+template class BasicFunctionMesh<builtin_functions::ShiftedSinc>;
+template class BasicFunctionMesh<builtin_functions::ExpSine>;
@@ -1,30 +1,45 @@
 #ifndef FUNCTION_MESH_H_
 #define FUNCTION_MESH_H_
 
+#include "builtin_functions.h"
+#include "cancellation.h"
 #include "mesh.h"
 #include "mesh_util.h"
+#include "transition_stencils.h"
 #include "util.h"
 
 #include <cstddef>
 #include <glm/fwd.hpp>
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <cstdint>
 #include <functional>
 #include <iomanip>
 #include <iostream>
 #include <memory>
-#include <set>
+#include <span>
 #include <string>
 #include <vector>
 
 // ------------------
 // Geometric helpers.
 
-struct Square;
+// Values double as bit positions in the stencil edge mask.
+enum class Edge : uint8_t {
+    North = 0,
+    East  = 1,
+    South = 2,
+    West  = 3,
+};
+
+inline constexpr std::array<Edge, 4> ALL_EDGES = {Edge::North, Edge::East, Edge::South, Edge::West};
 
-using SharedSquare = std::shared_ptr<Square>;
+constexpr Edge oppositeEdge(Edge edge) {
+    return static_cast<Edge>((static_cast<uint8_t>(edge) + 2) % 4);
+}
 
 struct Square {
     float mTopLeft[2];
@@ -33,15 +48,15 @@ struct Square {
     // Refinement level of this square.
     uint32_t depth = 0;
 
-    // Neighbors in same level of grid.
-    // For sharing vertices via indices.
-    SharedSquare northNeighbor = nullptr;
-    SharedSquare southNeighbor = nullptr;
-    SharedSquare westNeighbor  = nullptr;
-    SharedSquare eastNeighbor  = nullptr;
+    // Neighbors in same level of grid. Only set between siblings
+    // and in the top-level grid; see edgeNeighbor for the general case.
+    Square *northNeighbor = nullptr;
+    Square *southNeighbor = nullptr;
+    Square *westNeighbor  = nullptr;
+    Square *eastNeighbor  = nullptr;
 
     // Parent square, if this is a refinement.
-    SharedSquare parent = nullptr;
+    Square *parent = nullptr;
 
     // Vertex indeices of corners.
     // UINT32_MAX means unassigned.
@@ -51,43 +66,264 @@ struct Square {
     uint32_t bottomLeftIdx  = UINT32_MAX;
     uint32_t centerIdx      = UINT32_MAX;
 
-    // Child squares if this has been refined.
+    // Child squares if this has been refined; all null otherwise.
     // Order is: top-left, top-right, bottom-left, bottom-right.
-    std::vector<SharedSquare> children = {};
-
-    // Indices of triangles for this square.
-    std::vector<uint32_t> triangleIndices = {};
+    std::array<Square *, 4> children = {};
 
     bool hasChildren() const {
-        return !children.empty();
+        return children[0] != nullptr;
+    }
+
+    // Neighbor across edge at the same depth if one exists, otherwise
+    // the smallest coarser square that borders this edge, or nullptr.
+    Square *edgeNeighbor(Edge edge) const;
+
+    // Vertex index of this square's own edge midpoint.
+    // Precondition: hasChildren().
+    uint32_t edgeMidpointIdx(Edge edge) const;
+
+    // Vertex index of the midpoint of edge if the neighbor across
+    // it has been refined; UINT32_MAX if the edge is not split.
+    uint32_t neighborMidpointIdx(Edge edge) const;
+};
+
+// ----------------
+// Build workspace.
+
+// Allocates squares in fixed-size blocks, so pointers between squares
+// stay valid as the pool grows. Reset keeps the blocks for reuse.
+class SquarePool {
+    static constexpr size_t BLOCK_SIZE = 4096;
+
+    std::vector<std::unique_ptr<Square[]>> mBlocks = {};
+    size_t mSize                                   = 0;
+
+public:
+    Square *allocate(const Square &init = {}) {
+        size_t block_i = mSize / BLOCK_SIZE;
+        if (block_i == mBlocks.size()) {
+            mBlocks.push_back(std::make_unique<Square[]>(BLOCK_SIZE));
+        }
+        Square *square = &mBlocks[block_i][mSize % BLOCK_SIZE];
+        *square        = init;
+        mSize++;
+        return square;
+    }
+
+    void reserve(size_t numSquares) {
+        while (capacity() < numSquares) {
+            mBlocks.push_back(std::make_unique<Square[]>(BLOCK_SIZE));
+        }
+    }
+
+    // Frees blocks beyond those needed to hold numSquares.
+    // Precondition: Pool is empty.
+    void trim(size_t numSquares) {
+        assert(mSize == 0);
+        size_t numBlocks = (numSquares + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        if (mBlocks.size() > numBlocks) {
+            mBlocks.resize(numBlocks);
+        }
+    }
+
+    void reset() {
+        mSize = 0;
+    }
+
+    size_t size() const {
+        return mSize;
     }
 
-    struct EdgeRefinements {
-        std::vector<uint32_t> north = {};
-        std::vector<uint32_t> west  = {};
-        std::vector<uint32_t> south = {};
-        std::vector<uint32_t> east  = {};
+    size_t capacity() const {
+        return mBlocks.size() * BLOCK_SIZE;
+    }
+};
+
+// Buffers used while building a function mesh. An application can keep
+// one alive across rebuilds, so repeated builds reuse its allocations
+// instead of growing fresh vectors (and faulting in new pages) each time.
+//
+// Capacity is only released by endBuild, once it has stayed well above
+// what recent builds actually used.
+struct MeshBuildWorkspace {
+    // Builds remembered for the high-water mark.
+    static constexpr size_t TRIM_WINDOW = 8;
+    // Trim when capacity exceeds this multiple of the high-water mark.
+    static constexpr size_t TRIM_FACTOR = 2;
+
+    SquarePool squares = {};
+    // Top-level grid squares, in row-major order.
+    std::vector<Square *> floorSquares = {};
+    // Squares to test at the current and next refinement level.
+    std::vector<Square *> refineFrontier     = {};
+    std::vector<Square *> nextRefineFrontier = {};
+    // First triangle of each top-level square, in the order they are
+    // emitted; one extra entry at the end.
+    std::vector<uint32_t> floorTriOffsets = {};
+    // First vertex of each output tile; one extra entry at the end.
+    std::vector<uint32_t> tileVertexOffsets = {};
+    // Triangle range and bounds of each output cluster.
+    std::vector<MeshCluster> clusters = {};
+
+    // Vertex data as parallel arrays; see BasicFunctionMesh.
+    std::vector<float> vertX       = {};
+    std::vector<float> vertZ       = {};
+    std::vector<float> vertY       = {};
+    std::vector<uint8_t> vertFlags = {};
+
+    // Triangle list; triangle t is indices 3t, 3t + 1, 3t + 2.
+    std::vector<uint32_t> indices = {};
+    // Triangles of the coarser cluster levels of detail, which follow the
+    // full-detail list in the output.
+    std::vector<uint32_t> lodIndices = {};
+
+    // Area-weighted triangle normals as parallel arrays.
+    std::vector<float> triNormalX = {};
+    std::vector<float> triNormalY = {};
+    std::vector<float> triNormalZ = {};
+
+    // New index of each vertex when they are put in tile order, and
+    // scratch space for permuting the vertex arrays.
+    std::vector<uint32_t> vertexRemap     = {};
+    std::vector<float> vertScratch        = {};
+    std::vector<uint8_t> vertFlagsScratch = {};
+
+    // Triangles incident to each vertex in compressed rows: the triangles
+    // of vertex i are vertexTriangles[vertexTriOffsets[i]] up to
+    // vertexTriangles[vertexTriOffsets[i + 1]].
+    std::vector<uint32_t> vertexTriOffsets = {};
+    std::vector<uint32_t> vertexTriangles  = {};
+
+    // Clears contents but keeps capacity.
+    void reset() {
+        squares.reset();
+        floorSquares.clear();
+        refineFrontier.clear();
+        nextRefineFrontier.clear();
+        floorTriOffsets.clear();
+        tileVertexOffsets.clear();
+        clusters.clear();
+        vertX.clear();
+        vertZ.clear();
+        vertY.clear();
+        vertFlags.clear();
+        indices.clear();
+        lodIndices.clear();
+        triNormalX.clear();
+        triNormalY.clear();
+        triNormalZ.clear();
+        vertexRemap.clear();
+        vertScratch.clear();
+        vertFlagsScratch.clear();
+        vertexTriOffsets.clear();
+        vertexTriangles.clear();
+    }
+
+    // Records this build's sizes, then resets, trimming any buffers
+    // that are oversized relative to the recent high-water mark.
+    void endBuild() {
+        mRecentBuilds[mBuildCount % TRIM_WINDOW] = {
+            .numSquares  = squares.size(),
+            .numVertices = vertX.size(),
+            .numIndices  = indices.size(),
+        };
+        mBuildCount++;
+        reset();
+
+        BuildSizes highWater = {};
+        for (const BuildSizes &sizes : mRecentBuilds) {
+            highWater.numSquares  = std::max(highWater.numSquares, sizes.numSquares);
+            highWater.numVertices = std::max(highWater.numVertices, sizes.numVertices);
+            highWater.numIndices  = std::max(highWater.numIndices, sizes.numIndices);
+        }
+
+        if (squares.capacity() > TRIM_FACTOR * highWater.numSquares) {
+            squares.trim(highWater.numSquares);
+        }
+        trimVector(floorSquares, highWater.numSquares);
+        trimVector(refineFrontier, highWater.numSquares);
+        trimVector(nextRefineFrontier, highWater.numSquares);
+        trimVector(floorTriOffsets, highWater.numSquares + 1);
+        trimVector(vertX, highWater.numVertices);
+        trimVector(vertZ, highWater.numVertices);
+        trimVector(vertY, highWater.numVertices);
+        trimVector(vertFlags, highWater.numVertices);
+        trimVector(indices, highWater.numIndices);
+        trimVector(lodIndices, highWater.numIndices);
+        trimVector(triNormalX, highWater.numIndices / 3);
+        trimVector(triNormalY, highWater.numIndices / 3);
+        trimVector(triNormalZ, highWater.numIndices / 3);
+        trimVector(vertexRemap, highWater.numVertices);
+        trimVector(vertScratch, highWater.numVertices);
+        trimVector(vertFlagsScratch, highWater.numVertices);
+        trimVector(vertexTriOffsets, highWater.numVertices + 1);
+        trimVector(vertexTriangles, highWater.numIndices);
+    }
+
+private:
+    struct BuildSizes {
+        size_t numSquares  = 0;
+        size_t numVertices = 0;
+        size_t numIndices  = 0;
     };
-    EdgeRefinements edgeRefinements = {};
 
-    const EdgeRefinements &populateRefinements();
+    template <typename T>
+    static void trimVector(std::vector<T> &vec, size_t highWater) {
+        if (vec.capacity() > TRIM_FACTOR * highWater) {
+            std::vector<T> trimmed;
+            trimmed.reserve(highWater);
+            vec.swap(trimmed);
+        }
+    }
+
+    std::array<BuildSizes, TRIM_WINDOW> mRecentBuilds = {};
+    size_t mBuildCount                                = 0;
 };
 
 // --------------------
 // Function mesh class.
 
 // Builds a mesh for graphing a function z = f(x, y).
-// There is some redundancy among the vertices that we
-// will eliminate using indexing in a future version.
+//
+// During the build vertices are kept as parallel x, z, y and flag
+// arrays, and triangles only as the index list. The GPU Vertex layout,
+// including normals, is produced by a final packing pass in
+// functionMeshOutput.
+//
+// Refinement runs one level at a time. If a progress callback is given,
+// it receives a packed preview of the base grid and of each intermediate
+// level, so a caller can show a coarse mesh while detail is still being
+// added. Previews use only averaged triangle normals.
+//
+// The final mesh is ordered in tiles: bands of rows of the top-level grid,
+// each with contiguous ranges of triangles and of the vertices they first
+// use. The output can be packed and handed on one tile at a time, so a
+// caller can upload finished tiles while later ones are still packed.
+// Each tile's triangles are further split into square clusters, whose
+// ranges and bounds are in the metadata for culling.
+//
+// Clusters also get coarser levels of detail, whose index lists follow the
+// full-detail one. Level k draws the squares k or more rings in from the
+// cluster's edge with k fewer refinement levels, and squares nearer the
+// edge with only as many fewer as their ring, so every level keeps the
+// full-detail boundary and neighboring levels never differ by more than
+// one depth. The transition stencils then join them without cracks.
+//
+// The mesh is templated on the callable type so that functions known at
+// compile time (see builtin_functions.h) are inlined into the evaluation
+// loops. Runtime functions use the type-erased FunctionMesh alias below.
+//
+// Parts of the build run on the jobs scheduler, so the function must be
+// safe to call from several threads at once.
 
 using FuncXZ = double(double, double);
 
 class MeshDebug;
 
-class FunctionMesh {
+template <typename Func>
+class BasicFunctionMesh {
     friend class MeshDebug;
 
-    static constexpr bool USE_NEW_MESH     = true;
     static constexpr bool SHOW_REFINEMENT  = true;
     static constexpr bool DEBUG_REFINEMENT = false;
     static constexpr bool DIRECT_NORMALS   = false;
@@ -95,10 +331,22 @@ class FunctionMesh {
     // Number of subdivisions of x,y axes when creating cells.
     static constexpr int NUM_CELLS = 150;
 
+    // Rows of top-level cells in each output tile.
+    static constexpr int TILE_ROWS = 10;
+    static constexpr int NUM_TILES = (NUM_CELLS + TILE_ROWS - 1) / TILE_ROWS;
+
+    // Columns of top-level cells in each cluster of a tile.
+    static constexpr int CLUSTER_COLS     = TILE_ROWS;
+    static constexpr int NUM_CLUSTER_COLS = (NUM_CELLS + CLUSTER_COLS - 1) / CLUSTER_COLS;
+
     // Currently valid values are 0 and 1; we may
     // add code to support deeper refinement later.
     static constexpr uint8_t MAX_REFINEMENT_DEPTH = 2;
 
+    // One cluster level of detail per refinement depth that can be dropped.
+    static constexpr uint32_t NUM_LODS = MAX_REFINEMENT_DEPTH + 1;
+    static_assert(NUM_LODS <= MeshCluster::MAX_LODS);
+
     static constexpr double REFINEMENT_THRESHOLD_VARIATION = 0.5;
     static constexpr double REFINEMENT_THRESHOLD_2ND_DERIV = 30.0;
 
@@ -116,11 +364,53 @@ class FunctionMesh {
     static constexpr glm::vec3 REFINE_DEBUG_COLOR2 = {1.0f, 0.5f, 0.0f};
     static constexpr glm::vec3 REFINE_DEBUG_COLOR3 = {1.0f, 0.0f, 0.0f};
 
+    // Per-vertex build flags.
+    enum VertexFlags : uint8_t {
+        // Low bits: refinement debug color index; 0 uses FUNCT_COLOR.
+        REFINE_COLOR_MASK = 0b11,
+    };
+
+    // Vertices per block of the vertex packing kernel.
+    static constexpr uint32_t PACK_BLOCK_SIZE = 256;
+
     const math_util::LogisticCutoff mSecondDerivCutoff = {SECOND_DERIV_CUTOFF, SECOND_DERIV_CUTOFF_WIDTH};
 
 public:
-    FunctionMesh(std::function<FuncXZ> &&func)
-        : mFunc(std::forward<std::function<FuncXZ>>(func)) {
+    struct VerticesAndIndices {
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+    };
+
+    // Receives mesh previews during the build, on the building thread.
+    using ProgressFn = std::function<void(VerticesAndIndices &&)>;
+
+    // Finished part of the packed output; vertices and indices start at
+    // firstVertex and firstIndex in the full output arrays.
+    struct MeshTile {
+        uint32_t firstVertex;
+        std::span<const Vertex> vertices;
+        uint32_t firstIndex;
+        std::span<const uint32_t> indices;
+    };
+
+    using TileFn = std::function<void(const MeshTile &)>;
+
+    // Builds in a workspace owned by this mesh.
+    BasicFunctionMesh(Func &&func)
+        : mOwnedWorkspace(std::make_unique<MeshBuildWorkspace>()),
+          mWorkspace(*mOwnedWorkspace),
+          mFunc(std::forward<Func>(func)) {
+        init();
+    }
+
+    // Builds in a caller-owned workspace, which must outlive the mesh.
+    // Throws jobs::OperationCancelled if cancel is triggered mid-build.
+    BasicFunctionMesh(Func &&func, MeshBuildWorkspace &workspace, jobs::CancellationToken cancel = {},
+                      ProgressFn onProgress = nullptr)
+        : mWorkspace(workspace),
+          mCancel(std::move(cancel)),
+          mOnProgress(std::move(onProgress)),
+          mFunc(std::forward<Func>(func)) {
         init();
     }
 
@@ -134,37 +424,50 @@ public:
     }
 
     void generateMesh() {
+        mWorkspace.reset();
         buildFloorMesh();
         spdlog::trace("Finished building floor mesh.");
 
-        if constexpr (USE_NEW_MESH) {
-            computeVerticesAndIndices();
-        } else {
-            computeFloorMeshVertices();
-            computeFunctionMeshVertices();
-            buildIndicesList();
-        }
+        computeVerticesAndIndices();
     }
 
-    std::vector<SharedSquare> &tessellationSquare() {
+    std::vector<Square *> &tessellationSquare() {
         return mFloorMeshSquares;
     }
 
-    std::vector<Vertex> &floorVertices() {
-        return mFloorMeshVertices;
+    size_t numVertices() const {
+        return mVertX.size();
     }
-    std::vector<Vertex> &functionVertices() {
-        return mFunctionMeshVertices;
+
+    // Function values at the mesh vertices.
+    const std::vector<float> &vertexHeights() const {
+        return mVertY;
     }
 
     std::vector<uint32_t> &meshIndices() {
         return mMeshIndices;
     }
 
-    struct VerticesAndIndices {
-        std::vector<Vertex> vertices;
-        std::vector<uint32_t> indices;
-    };
+    // Includes the coarser levels of detail.
+    size_t numIndices() const {
+        return mMeshIndices.size() + mLodIndices.size();
+    }
+
+    // Packs the function mesh into GPU vertex layout, computing vertex
+    // TBN bases. Outputs are exact-size, leaving the workspace buffers
+    // in place for the next build.
+    //
+    // Tiles are packed in order, and each is passed to onTile, if given,
+    // as soon as it is finished.
+    VerticesAndIndices functionMeshOutput(const TileFn &onTile = nullptr);
+
+    // Counts, color, bounds and clusters of the function mesh.
+    MeshMetadata metadata() const;
+
+    // Packs the function mesh like functionMeshOutput, but straight into
+    // caller memory, such as mapped device buffers, with room for
+    // numVertices and numIndices elements.
+    void writeFunctionMesh(Vertex *vertices, uint32_t *indices);
 
     static VerticesAndIndices simpleFloorMesh() {
         return VerticesAndIndices{
@@ -208,35 +511,23 @@ public:
     // Mesh debugging methods.
 
     std::basic_ostream<char> &debugVertex(std::basic_ostream<char> &debugStrm, uint32_t vertex_i) {
-        const Vertex &vertex = mFloorMeshVertices[vertex_i];
-        debugStrm << "(" << vertex.pos.x << ", " << vertex.pos.z << ")";
+        debugStrm << "(" << mVertX[vertex_i] << ", " << mVertZ[vertex_i] << ")";
         return debugStrm;
     }
 
     std::basic_ostream<char> &debugRefinements(std::basic_ostream<char> &debugStrm, const Square &square) {
+        static constexpr std::array<const char *, 4> edgeNames = {"North", "East", "South", "West"};
+
         std::string indent(square.depth * 4, ' ');
-        debugStrm << indent << " = North refinements:";
-        for (uint32_t refinmnt : square.edgeRefinements.north) {
-            debugStrm << " ";
-            debugVertex(debugStrm, refinmnt);
-        }
-        debugStrm << std::endl;
-        debugStrm << indent << " = West refinements:";
-        for (uint32_t refinmnt : square.edgeRefinements.west) {
-            debugStrm << " ";
-            debugVertex(debugStrm, refinmnt);
-        }
-        debugStrm << std::endl;
-        debugStrm << indent << " = South refinements:";
-        for (uint32_t refinmnt : square.edgeRefinements.south) {
-            debugStrm << " ";
-            debugVertex(debugStrm, refinmnt);
-        }
-        debugStrm << std::endl;
-        debugStrm << indent << " = East refinements:";
-        for (uint32_t refinmnt : square.edgeRefinements.east) {
-            debugStrm << " ";
-            debugVertex(debugStrm, refinmnt);
+        for (Edge edge : ALL_EDGES) {
+            debugStrm << indent << " = " << edgeNames[static_cast<uint8_t>(edge)] << " midpoint: ";
+            uint32_t midpointIdx = square.neighborMidpointIdx(edge);
+            if (midpointIdx == UINT32_MAX) {
+                debugStrm << "none";
+            } else {
+                debugVertex(debugStrm, midpointIdx);
+            }
+            debugStrm << std::endl;
         }
 
         return debugStrm;
@@ -261,11 +552,11 @@ public:
 
         if (recurse && square.hasChildren()) {
             debugStrm << indent << " + Children:" << std::endl;
-            for (const SharedSquare &child : square.children) {
+            for (const Square *child : square.children) {
                 debugStrm << debugSquareCell(*child, square_i);
             }
         }
-        debugRefinements(debugStrm, square) << std::endl;
+        debugRefinements(debugStrm, square);
 
         square_i++;
         return debugStrm.str();
@@ -274,7 +565,7 @@ public:
     std::string debugMesh() {
         std::stringstream debugStrm;
         uint32_t square_i = 0;
-        for (const SharedSquare &square : mFloorMeshSquares) {
+        for (const Square *square : mFloorMeshSquares) {
             debugStrm << debugSquareCell(*square, square_i);
         }
         return debugStrm.str();
@@ -291,11 +582,12 @@ public:
     }
 
     void logIndices(const Square &square) {
-        auto logRefinements = [](const std::vector<uint32_t> &refinements) {
-            for (uint32_t i = 0; i < refinements.size() - 1; i++) {
-                std::cout << std::to_string(refinements[i]) << ", ";
+        auto logMidpoint = [](uint32_t midpointIdx) {
+            if (midpointIdx == UINT32_MAX) {
+                std::cout << "none" << std::endl;
+            } else {
+                std::cout << std::to_string(midpointIdx) << std::endl;
             }
-            std::cout << std::to_string(refinements.back()) << std::endl;
         };
 
         std::cout << "Square indices:" << std::endl;
@@ -305,35 +597,47 @@ public:
         std::cout << " - Btm left:  " << std::to_string(square.bottomLeftIdx) << std::endl;
         std::cout << " - Btm right: " << std::to_string(square.bottomRightIdx) << std::endl;
 
-        std::cout << " >> north refinements: ";
-        logRefinements(square.edgeRefinements.north);
-        std::cout << " >> west refinements:  ";
-        logRefinements(square.edgeRefinements.west);
-        std::cout << " >> south refinements: ";
-        logRefinements(square.edgeRefinements.south);
-        std::cout << " >> east refinements:  ";
-        logRefinements(square.edgeRefinements.east);
+        std::cout << " >> north midpoint: ";
+        logMidpoint(square.neighborMidpointIdx(Edge::North));
+        std::cout << " >> west midpoint:  ";
+        logMidpoint(square.neighborMidpointIdx(Edge::West));
+        std::cout << " >> south midpoint: ";
+        logMidpoint(square.neighborMidpointIdx(Edge::South));
+        std::cout << " >> east midpoint:  ";
+        logMidpoint(square.neighborMidpointIdx(Edge::East));
     }
 
 private:
     void computeVerticesAndIndices();
 
-    void syncEdgeRefinements(SharedSquare &square);
+    void buildFloorMesh();
 
-    void syncRefmtsHoriz(std::vector<uint32_t> &to, std::vector<uint32_t> &from);
+    // Appends a vertex without a height; returns its index.
+    uint32_t addVertex(float x, float z, uint8_t flags = 0);
 
-    void syncRefmtsVert(std::vector<uint32_t> &to, std::vector<uint32_t> &from);
+    // Fills the triangle normal arrays for the current triangle list.
+    void prepareTriangleNormals();
+    void computeTriangleNormals(uint32_t begin, uint32_t end);
 
-    void buildFloorMesh();
+    // Packs vertices begin to end into their slots in vertices.
+    // Without numericalNormals, vertex normals are the averaged triangle normals.
+    // Precondition: prepareTriangleNormals has run for the current triangles.
+    void packVertexRange(uint32_t begin, uint32_t end, Vertex *vertices, bool numericalNormals);
+    void packVertexBlock(uint32_t begin, uint32_t end, Vertex *out, bool numericalNormals);
 
-    void addFloorMeshVertex(float x, float z);
+    struct PointDerivs {
+        double dydx;
+        double dydz;
+        // Max magnitude of second partial derivatives.
+        double secondDerivMax;
+    };
 
-    void setFuncVertTBNs();
-    void setFuncVertTBNsDirect();
-    glm::dvec3 normalAtPoint(const glm::vec3 &pos);
+    // Central difference estimates at (x, z), sharing function
+    // evaluations between first and second derivatives.
+    PointDerivs derivsAtPoint(double x, double z);
 
     double funcMeshY(uint32_t index) {
-        return mFunctionMeshVertices[index].pos.y;
+        return mVertY[index];
     }
 
     struct SquareFuncEval {
@@ -360,70 +664,84 @@ private:
     };
 
     XZCoord meshXZ(uint32_t index) {
-        return {mFloorMeshVertices[index].pos.x, mFloorMeshVertices[index].pos.z};
+        return {mVertX[index], mVertZ[index]};
     }
 
     double secondDerivEst(const Square &square);
-    double secondDerivEstMax(const glm::vec3 &pos);
 
     // Precondition: Square vertex indices are valid for function mesh.
     bool shouldRefine(Square &square);
 
-    void refine(SharedSquare square);
-
-    void addSquareTris(const SharedSquare &square);
-
-    void addTriIndices(const Triangle &tri);
-
-    // DEPRECATED: Old method of mesh construction.
-
-    void computeFloorMeshVertices() {
-        auto vertices = std::vector<Vertex>{};
-        vertices.reserve(mFloorMeshSquares.size() * 6);
-
-        for (const auto &square : mFloorMeshSquares) {
-            // First triangle.
-            vertices.push_back({glm::vec3{square->mTopLeft[0], 0.0, square->mTopLeft[1]}, FLOOR_COLOR});
-            vertices.push_back({glm::vec3{square->mTopLeft[0], 0.0, square->mBtmRight[1]}, FLOOR_COLOR});
-            vertices.push_back({glm::vec3{square->mBtmRight[0], 0.0, square->mTopLeft[1]}, FLOOR_COLOR});
-
-            // Second triangle.
-            vertices.push_back({glm::vec3{square->mBtmRight[0], 0.0, square->mBtmRight[1]}, FLOOR_COLOR});
-            vertices.push_back({glm::vec3{square->mBtmRight[0], 0.0, square->mTopLeft[1]}, FLOOR_COLOR});
-            vertices.push_back({glm::vec3{square->mTopLeft[0], 0.0, square->mBtmRight[1]}, FLOOR_COLOR});
-        }
-
-        mFloorMeshVertices = std::move(vertices);
-    }
-
-    void computeFunctionMeshVertices() {
-        auto vertices = std::vector<Vertex>{};
-        vertices.reserve(mFloorMeshVertices.size());
-
-        // Now update y-coordinates w/ function values.
-        for (std::size_t i = 0; i < mFloorMeshVertices.size(); i++) {
-            vertices.push_back({mFloorMeshVertices[i].pos, FUNCT_COLOR});
-            Vertex &newVertex = vertices.back();
-            newVertex.pos.y   = static_cast<float>(mFunc(newVertex.pos.x, newVertex.pos.z));
-        }
-
-        mFunctionMeshVertices = std::move(vertices);
-    }
+    // Adds children to square without checking if they need refinement.
+    void subdivide(Square *square);
+
+    // Subdivides leaves until neighboring leaves differ by at most one level.
+    // Returns true if any square was subdivided.
+    bool balance(Square *square);
+    void balanceTree();
+
+    // Precondition: Tree is balanced.
+    uint32_t countSquareTris(const Square &square, uint32_t lod = 0);
+
+    // Writes the stencil triangles of each leaf of square, at the given
+    // cluster level of detail, into out. Returns the position after the
+    // last index written.
+    uint32_t *emitSquareTris(const Square &square, uint32_t *out, uint32_t lod = 0);
+
+    // Deepest refinement drawn in square's top-level square at a level of
+    // detail; squares at that depth are drawn as leaves.
+    static uint8_t lodMaxDepth(const Square &square, uint32_t lod);
+    static bool isLodLeaf(const Square &square, uint32_t lod);
+    // Like Square::neighborMidpointIdx, for the tree cut at a level of detail.
+    static uint32_t lodMidpointIdx(const Square &square, Edge edge, uint32_t lod);
+
+    // Largest height difference between the full-detail surface under
+    // square and the level of detail's surface.
+    float lodError(const Square &square, uint32_t lod);
+    // Largest height difference between the vertices below square and the
+    // fan of leaf, which is drawn in their place.
+    float coarseningError(const Square &leaf, const Square &square);
+    // Height at (x, z) of the four-triangle fan that draws an unsplit square.
+    float fanHeight(const Square &square, float x, float z);
+
+    void buildVertexTriangles();
+
+    // Writes the triangles of the current tree into the index list.
+    void emitTriangles();
+
+    // Top-level squares are emitted tile by tile, and within a tile one
+    // cluster at a time, each in row-major order. These map between that
+    // order and mFloorMeshSquares.
+    static uint32_t clusterStart(int tile, int column);
+    static uint32_t emittedSquare(uint32_t position);
+
+    // Renumbers vertices in the order triangles first use them, so that each
+    // tile's vertices are contiguous; records the tile vertex ranges.
+    // Precondition: mMeshIndices holds the final triangle list.
+    void orderVerticesByTile();
+    void remapSquareIndices(Square &square);
+
+    // Records each cluster's full-detail index range and bounds.
+    // Precondition: vertices are in their final order.
+    void computeClusters();
+    // Writes the coarser levels of detail of each cluster to mLodIndices.
+    void buildClusterLods();
+
+    // Sends a preview of the current tree to mOnProgress, if set.
+    void publishProgress();
 
-    void buildIndicesList() {
-        assert(mFloorMeshVertices.size() % 3 == 0);
-        assert(mFloorMeshVertices.size() == mFunctionMeshVertices.size());
-        mMeshIndices.reserve(mFloorMeshVertices.size());
+private:
+    // Set only when the mesh was not given a workspace.
+    std::unique_ptr<MeshBuildWorkspace> mOwnedWorkspace = nullptr;
+    MeshBuildWorkspace &mWorkspace;
 
-        for (uint32_t i = 0; i < mFunctionMeshVertices.size(); i++) {
-            mMeshIndices.push_back(i);
-        }
-    }
+    // Polled between stages of the build.
+    jobs::CancellationToken mCancel;
+    ProgressFn mOnProgress = nullptr;
 
-private:
     // The function z = mF(x, y) that we will graph.
-    std::function<FuncXZ> mFunc = nullptr;
-    // Used to hold callable user function object or standard function pointer.
+    // Either a built-in function object or a type-erased user function.
+    Func mFunc;
 
     // Ensure we don't overlow our index type: This check is
     // necessary, but not sufficient, because of mesh refinement.
@@ -433,26 +751,47 @@ private:
     // = 1.0 / mNumCells.
     static constexpr double mCellWidth = 1.0 / NUM_CELLS;
 
+    // The members below alias buffers in mWorkspace.
+
     // Squares that make up x,y-plane mesh.
-    std::vector<SharedSquare> mFloorMeshSquares = {};
-    // TODO: We might go back to allocating the squares in sequence,
-    // because this approach is definitely slower. But we'll have to
-    // make it safer than holding refs to vector elements.
-
-    // Vertices of triangular tessellation built from squares.
-    std::vector<Vertex> mFloorMeshVertices = {};
-    // Tessellation vertices with heights from function values.
-    std::vector<Vertex> mFunctionMeshVertices = {};
-
-    // Triangles in the function mesh; also used for floor mesh.
-    std::vector<Triangle> mFunctionMeshTriangles = {};
-    // Indices of triangles this vertex is incident to; for normal calculations.
-    //  -- This is parallel to mFunctionMeshVertices.
-    //  -- It contains indexes into mFunctionMeshTriangles.
-    std::vector<std::set<uint32_t>> mVertexTriangles = {};
-
-    // For now we assume a simple relationship between floor and function meshes.
-    std::vector<uint32_t> mMeshIndices = {};
+    std::vector<Square *> &mFloorMeshSquares   = mWorkspace.floorSquares;
+    std::vector<Square *> &mRefineFrontier     = mWorkspace.refineFrontier;
+    std::vector<Square *> &mNextRefineFrontier = mWorkspace.nextRefineFrontier;
+    std::vector<uint32_t> &mFloorTriOffsets    = mWorkspace.floorTriOffsets;
+    std::vector<uint32_t> &mTileVertexOffsets  = mWorkspace.tileVertexOffsets;
+    std::vector<MeshCluster> &mClusters        = mWorkspace.clusters;
+
+    // Vertex x,z-coordinates in the floor plane, function values
+    // at those points, and VertexFlags; all indexed by vertex.
+    std::vector<float> &mVertX       = mWorkspace.vertX;
+    std::vector<float> &mVertZ       = mWorkspace.vertZ;
+    std::vector<float> &mVertY       = mWorkspace.vertY;
+    std::vector<uint8_t> &mVertFlags = mWorkspace.vertFlags;
+
+    // Triangles incident to each vertex, as compressed rows of triangle
+    // numbers into mMeshIndices; see MeshBuildWorkspace.
+    std::vector<uint32_t> &mVertexTriOffsets = mWorkspace.vertexTriOffsets;
+    std::vector<uint32_t> &mVertexTriangles  = mWorkspace.vertexTriangles;
+    std::vector<uint32_t> &mVertexRemap      = mWorkspace.vertexRemap;
+
+    // Triangle list shared by the floor and function meshes.
+    std::vector<uint32_t> &mMeshIndices = mWorkspace.indices;
+    std::vector<uint32_t> &mLodIndices  = mWorkspace.lodIndices;
+
+    // Area-weighted triangle normals; see computeTriangleNormals.
+    std::vector<float> &mTriNormalX = mWorkspace.triNormalX;
+    std::vector<float> &mTriNormalY = mWorkspace.triNormalY;
+    std::vector<float> &mTriNormalZ = mWorkspace.triNormalZ;
 };
 
+// Type-erased mesh for functions only known at runtime.
+using FunctionMesh = BasicFunctionMesh<std::function<FuncXZ>>;
+
+// Member definitions live in function_mesh.cpp, which instantiates
+// the mesh for these callable types.
+extern template class BasicFunctionMesh<std::function<FuncXZ>>;
+extern template class BasicFunctionMesh<builtin_functions::Parabolic>;
+extern template class BasicFunctionMesh<builtin_functions::ShiftedSinc>;
+extern template class BasicFunctionMesh<builtin_functions::ExpSine>;
+
 #endif // FUNCTION_MESH_H_
@@ -0,0 +1,198 @@
+#include "geometry_arena.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+
+void GeometryArena::init(TransferQueue &inTransfer) {
+    transfer = &inTransfer;
+}
+
+void GeometryArena::destroy() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (Page &page : pages) {
+        if (page.vertexBuffer == VK_NULL_HANDLE) {
+            continue;
+        }
+        // Every mesh should have been freed first; a leftover one is a
+        // lifetime bug in its owner.
+        if (page.numMeshes > 0) {
+            spdlog::error("Geometry page freed with {} meshes still allocated.", page.numMeshes);
+        }
+        assert(page.numMeshes == 0);
+        destroyPage(page);
+    }
+    pages.clear();
+}
+
+MeshGeometry GeometryArena::allocate(uint32_t numVertices, uint32_t numIndices) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    MeshGeometry geometry;
+    geometry.numVertices = numVertices;
+    geometry.numIndices  = numIndices;
+
+    auto takeFrom = [&geometry](Page &page) {
+        std::optional<uint32_t> firstVertex = page.freeVertices.take(geometry.numVertices);
+        if (!firstVertex.has_value()) {
+            return false;
+        }
+        std::optional<uint32_t> firstIndex = page.freeIndices.take(geometry.numIndices);
+        if (!firstIndex.has_value()) {
+            page.freeVertices.give(*firstVertex, geometry.numVertices);
+            return false;
+        }
+        geometry.firstVertex = *firstVertex;
+        geometry.firstIndex  = *firstIndex;
+        page.numMeshes++;
+        return true;
+    };
+
+    if (numVertices > PAGE_VERTICES / 2 || numIndices > PAGE_INDICES / 2) {
+        geometry.page = createPage(std::max(numVertices, 1u), std::max(numIndices, 1u), true);
+        takeFrom(pages[geometry.page]);
+        return geometry;
+    }
+
+    for (uint32_t i = 0; i < pages.size(); ++i) {
+        Page &page = pages[i];
+        if (page.vertexBuffer != VK_NULL_HANDLE && !page.dedicated && takeFrom(page)) {
+            geometry.page = i;
+            return geometry;
+        }
+    }
+    geometry.page = createPage(PAGE_VERTICES, PAGE_INDICES, false);
+    takeFrom(pages[geometry.page]);
+    return geometry;
+}
+
+void GeometryArena::free(MeshGeometry &geometry) {
+    if (!geometry.allocated()) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    Page &page = pages[geometry.page];
+    page.freeVertices.give(geometry.firstVertex, geometry.numVertices);
+    page.freeIndices.give(geometry.firstIndex, geometry.numIndices);
+    page.numMeshes--;
+    if (page.dedicated && page.numMeshes == 0) {
+        destroyPage(page);
+    }
+    geometry = {};
+}
+
+uint64_t GeometryArena::writeVertices(const MeshGeometry &geometry, uint32_t firstVertex,
+                                      std::span<const Vertex> vertices) {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    DeviceAllocation allocation;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        buffer     = pages[geometry.page].vertexBuffer;
+        allocation = pages[geometry.page].vertexAllocation;
+    }
+    return transfer->write(buffer, allocation, sizeof(Vertex) * (geometry.firstVertex + firstVertex),
+                           vertices.data(), vertices.size_bytes());
+}
+
+uint64_t GeometryArena::writeIndices(const MeshGeometry &geometry, uint32_t firstIndex,
+                                     std::span<const uint32_t> indices) {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    DeviceAllocation allocation;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        buffer     = pages[geometry.page].indexBuffer;
+        allocation = pages[geometry.page].indexAllocation;
+    }
+    return transfer->write(buffer, allocation, sizeof(uint32_t) * (geometry.firstIndex + firstIndex), indices.data(),
+                           indices.size_bytes());
+}
+
+Vertex *GeometryArena::mappedVertices(const MeshGeometry &geometry) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto *mapped = static_cast<Vertex *>(pages[geometry.page].vertexAllocation.mapped);
+    return mapped != nullptr ? mapped + geometry.firstVertex : nullptr;
+}
+
+uint32_t *GeometryArena::mappedIndices(const MeshGeometry &geometry) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto *mapped = static_cast<uint32_t *>(pages[geometry.page].indexAllocation.mapped);
+    return mapped != nullptr ? mapped + geometry.firstIndex : nullptr;
+}
+
+VkBuffer GeometryArena::vertexBuffer(uint32_t page) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return pages[page].vertexBuffer;
+}
+
+VkBuffer GeometryArena::indexBuffer(uint32_t page) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return pages[page].indexBuffer;
+}
+
+uint32_t GeometryArena::createPage(uint32_t numVertices, uint32_t numIndices, bool dedicated) {
+    Page page;
+    page.dedicated = dedicated;
+    transfer->createDeviceBuffer(sizeof(Vertex) * numVertices, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, page.vertexBuffer,
+                                 page.vertexAllocation);
+    transfer->createDeviceBuffer(sizeof(uint32_t) * numIndices, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, page.indexBuffer,
+                                 page.indexAllocation);
+    page.freeVertices.give(0, numVertices);
+    page.freeIndices.give(0, numIndices);
+
+    auto emptySlot = std::find_if(pages.begin(), pages.end(),
+                                  [](const Page &slot) { return slot.vertexBuffer == VK_NULL_HANDLE; });
+    if (emptySlot != pages.end()) {
+        *emptySlot = std::move(page);
+        return static_cast<uint32_t>(emptySlot - pages.begin());
+    }
+    pages.push_back(std::move(page));
+    return static_cast<uint32_t>(pages.size() - 1);
+}
+
+void GeometryArena::destroyPage(Page &page) {
+    transfer->destroyDeviceBuffer(page.vertexBuffer, page.vertexAllocation);
+    transfer->destroyDeviceBuffer(page.indexBuffer, page.indexAllocation);
+    page = {};
+}
+
+// Page free lists.
+
+std::optional<uint32_t> GeometryArena::FreeList::take(uint32_t count) {
+    if (count == 0) {
+        return 0;
+    }
+    for (auto it = ranges.begin(); it != ranges.end(); ++it) {
+        const auto [offset, size] = *it;
+        if (size < count) {
+            continue;
+        }
+        ranges.erase(it);
+        if (size > count) {
+            ranges[offset + count] = size - count;
+        }
+        return offset;
+    }
+    return std::nullopt;
+}
+
+void GeometryArena::FreeList::give(uint32_t offset, uint32_t count) {
+    if (count == 0) {
+        return;
+    }
+    auto next = ranges.lower_bound(offset);
+    if (next != ranges.end() && offset + count == next->first) {
+        count += next->second;
+        next = ranges.erase(next);
+    }
+    if (next != ranges.begin()) {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == offset) {
+            prev->second += count;
+            return;
+        }
+    }
+    ranges[offset] = count;
+}
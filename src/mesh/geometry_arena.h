@@ -0,0 +1,91 @@
+#ifndef GEOMETRY_ARENA_H_
+#define GEOMETRY_ARENA_H_
+
+#include "mesh.h"
+#include "transfer_queue.h"
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <vector>
+
+// Vertex and index megabuffers shared by every mesh, so that a whole scene
+// can be drawn with one indirect draw per page instead of a buffer binding
+// and draw call per mesh.
+//
+// A page is one vertex buffer and one index buffer, each sub-allocated
+// first-fit. Pages are created as needed; a mesh too large for a page gets
+// a dedicated one, destroyed when the mesh is freed. All methods may be
+// called from any thread.
+class GeometryArena {
+public:
+    static constexpr uint32_t PAGE_VERTICES = 1u << 19;
+    static constexpr uint32_t PAGE_INDICES  = 3u << 20;
+
+    GeometryArena() = default;
+
+    GeometryArena(const GeometryArena &)            = delete;
+    GeometryArena &operator=(const GeometryArena &) = delete;
+
+    void init(TransferQueue &transfer);
+    // Precondition: no draws from or copies into the arena are in flight.
+    void destroy();
+
+    TransferQueue &transferQueue() const {
+        return *transfer;
+    }
+
+    MeshGeometry allocate(uint32_t numVertices, uint32_t numIndices);
+    // The ranges must no longer be used by frames or copies in flight.
+    void free(MeshGeometry &geometry);
+
+    // Copies into a mesh's ranges; see TransferQueue::write.
+    uint64_t writeVertices(const MeshGeometry &geometry, uint32_t firstVertex, std::span<const Vertex> vertices);
+    uint64_t writeIndices(const MeshGeometry &geometry, uint32_t firstIndex, std::span<const uint32_t> indices);
+
+    // A mesh's ranges if the host can write them directly, else nullptr.
+    Vertex *mappedVertices(const MeshGeometry &geometry);
+    uint32_t *mappedIndices(const MeshGeometry &geometry);
+
+    VkBuffer vertexBuffer(uint32_t page);
+    VkBuffer indexBuffer(uint32_t page);
+
+private:
+    // Free ranges of one buffer, in elements, keyed by offset.
+    struct FreeList {
+        std::map<uint32_t, uint32_t> ranges;
+
+        std::optional<uint32_t> take(uint32_t count);
+        void give(uint32_t offset, uint32_t count);
+    };
+
+    struct Page {
+        VkBuffer vertexBuffer = VK_NULL_HANDLE;
+        DeviceAllocation vertexAllocation;
+        VkBuffer indexBuffer = VK_NULL_HANDLE;
+        DeviceAllocation indexAllocation;
+
+        FreeList freeVertices;
+        FreeList freeIndices;
+        uint32_t numMeshes = 0;
+        bool dedicated     = false;
+    };
+
+    // These expect mutex to be held.
+    uint32_t createPage(uint32_t numVertices, uint32_t numIndices, bool dedicated);
+    void destroyPage(Page &page);
+
+private:
+    TransferQueue *transfer = nullptr;
+
+    // Guards pages. Destroyed dedicated pages leave empty slots, so page
+    // indices stay valid.
+    std::mutex mutex;
+    std::vector<Page> pages;
+};
+
+#endif // GEOMETRY_ARENA_H_
@@ -4,6 +4,7 @@
 
 #include "mesh.h"
 #include "mesh_util.h"
+#include "scheduler.h"
 
 #include <glm/fwd.hpp>
 #include <glm/geometric.hpp>
@@ -140,21 +141,35 @@ VertsAndIndices gmshToIndexed() {
     }
     spdlog::trace("Num triangles:             {}", std::size(triangles));
 
-    // Assign normal and area to triangles and add indices.
-    indexedMesh.indices.reserve(3 * std::size(triangles));
-    for (auto &tri : triangles) {
-        mesh_util::assignTriangleNormalArea(tri, indexedMesh.vertices);
-
-        indexedMesh.indices.push_back(tri.vert1Idx);
-        indexedMesh.indices.push_back(tri.vert2Idx);
-        indexedMesh.indices.push_back(tri.vert3Idx);
-    }
+    constexpr uint32_t TRI_BLOCK_SIZE  = 4096;
+    constexpr uint32_t VERT_BLOCK_SIZE = 1024;
 
-    // Assign TBN vectors to vertices.
-    for (uint32_t vert_i = 0; vert_i < std::size(indexedMesh.vertices); ++vert_i) {
-        Vertex &vert = indexedMesh.vertices[vert_i];
-        mesh_util::assignVertTBNGmsh(vert, vertIndexToTriIndices[vert_i], triangles);
-    }
+    // Assign normal and area to triangles and add indices.
+    const auto numTris = static_cast<uint32_t>(std::size(triangles));
+    indexedMesh.indices.resize(3 * std::size(triangles));
+    jobs::parallelFor(numTris, TRI_BLOCK_SIZE, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t tri_i = begin; tri_i < end; ++tri_i) {
+            Triangle &tri = triangles[tri_i];
+            mesh_util::assignTriangleNormalArea(tri, indexedMesh.vertices);
+
+            indexedMesh.indices[3 * tri_i]     = tri.vert1Idx;
+            indexedMesh.indices[3 * tri_i + 1] = tri.vert2Idx;
+            indexedMesh.indices[3 * tri_i + 2] = tri.vert3Idx;
+        }
+    });
+
+    // Assign TBN vectors to vertices. Lookups must not insert, since
+    // the map is shared between tasks.
+    static const std::vector<uint32_t> NO_TRIANGLES = {};
+    const auto numVerts                             = static_cast<uint32_t>(std::size(indexedMesh.vertices));
+    jobs::parallelFor(numVerts, VERT_BLOCK_SIZE, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t vert_i = begin; vert_i < end; ++vert_i) {
+            auto vertTris = vertIndexToTriIndices.find(vert_i);
+            mesh_util::assignVertTBNGmsh(indexedMesh.vertices[vert_i],
+                                         vertTris != vertIndexToTriIndices.end() ? vertTris->second : NO_TRIANGLES,
+                                         triangles);
+        }
+    });
     return indexedMesh;
 }
 
@@ -0,0 +1,68 @@
+#ifndef GRID_SAMPLES_H_
+#define GRID_SAMPLES_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace grid_samples {
+
+// Far beyond any graph worth viewing, and far from overflowing floats.
+inline constexpr float MAX_HEIGHT = 1.0e6f;
+
+// Replaces function samples at poles and undefined points on a square grid
+// of resolution x resolution, row-major, and clamps the rest, so that sums
+// and differences of samples stay finite. A non-finite sample becomes the
+// mean of its finite neighbors, as UserFunction approximates a singularity
+// from nearby values, or zero if there are none.
+inline void sanitize(std::vector<float> &samples, uint32_t resolution) {
+    std::vector<uint32_t> nonFinite;
+    for (uint32_t k = 0; k < samples.size(); k++) {
+        if (!std::isfinite(samples[k])) {
+            nonFinite.push_back(k);
+        }
+    }
+
+    std::vector<float> replacements(nonFinite.size(), 0.0f);
+    for (size_t n = 0; n < nonFinite.size(); n++) {
+        const uint32_t i = nonFinite[n] % resolution;
+        const uint32_t j = nonFinite[n] / resolution;
+
+        float sum          = 0.0f;
+        uint32_t numFinite = 0;
+        auto add           = [&](uint32_t x, uint32_t z) {
+            const float h = samples[z * resolution + x];
+            if (std::isfinite(h)) {
+                sum += std::clamp(h, -MAX_HEIGHT, MAX_HEIGHT);
+                numFinite++;
+            }
+        };
+        if (i > 0) {
+            add(i - 1, j);
+        }
+        if (i < resolution - 1) {
+            add(i + 1, j);
+        }
+        if (j > 0) {
+            add(i, j - 1);
+        }
+        if (j < resolution - 1) {
+            add(i, j + 1);
+        }
+        if (numFinite > 0) {
+            replacements[n] = sum / static_cast<float>(numFinite);
+        }
+    }
+    for (size_t n = 0; n < nonFinite.size(); n++) {
+        samples[nonFinite[n]] = replacements[n];
+    }
+
+    for (float &h : samples) {
+        h = std::clamp(h, -MAX_HEIGHT, MAX_HEIGHT);
+    }
+}
+
+} // namespace grid_samples
+
+#endif // GRID_SAMPLES_H_
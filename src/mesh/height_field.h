@@ -0,0 +1,113 @@
+#ifndef HEIGHT_FIELD_H_
+#define HEIGHT_FIELD_H_
+
+#include "cancellation.h"
+#include "grid_samples.h"
+#include "scheduler.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Function heights on a regular grid over the unit square, for drawing a
+// graph with GPU tessellation instead of a CPU-built mesh.
+//
+// The grid is split into a coarse grid of patches, each of which the
+// tessellator subdivides as finely as the view needs. Each patch carries a
+// bound on the function's second derivatives over it, which sets how many
+// segments its edges need for linear interpolation to stay close to the
+// surface.
+struct HeightField {
+    // Samples per side, including both edges of the square.
+    static constexpr uint32_t RESOLUTION = 513;
+    // Patches per side; must match PATCHES in the surface shaders.
+    static constexpr uint32_t PATCHES = 32;
+    // Grid intervals along each patch edge. Tessellating a patch edge more
+    // finely than this adds no detail.
+    static constexpr uint32_t CELLS_PER_PATCH = (RESOLUTION - 1) / PATCHES;
+    static_assert(CELLS_PER_PATCH * PATCHES == RESOLUTION - 1);
+
+    // Row-major, with rows along x; sample (i, j) is at (i, j) / (RESOLUTION - 1).
+    std::vector<float> heights;
+    // Row-major like heights: the largest second difference quotient of the
+    // heights within each patch, along x, along z or mixed.
+    std::vector<float> patchCurvature;
+
+    glm::vec3 boundsMin = {};
+    glm::vec3 boundsMax = {};
+
+    // Evaluates func at every grid point and bounds the curvature of each
+    // patch, in parallel. Throws jobs::OperationCancelled if cancel is
+    // triggered.
+    template <typename Func>
+    static HeightField evaluate(Func &func, const jobs::CancellationToken &cancel);
+
+private:
+    float height(uint32_t i, uint32_t j) const {
+        return heights[j * RESOLUTION + i];
+    }
+
+    // Largest second difference quotient at the grid points of a patch.
+    float curvatureBound(uint32_t patchX, uint32_t patchZ) const;
+};
+
+template <typename Func>
+HeightField HeightField::evaluate(Func &func, const jobs::CancellationToken &cancel) {
+    constexpr uint32_t ROW_BLOCK_SIZE = 16;
+    constexpr double SPACING          = 1.0 / (RESOLUTION - 1);
+
+    HeightField field;
+    field.heights.resize(RESOLUTION * RESOLUTION);
+    jobs::parallelFor(RESOLUTION, ROW_BLOCK_SIZE, [&field, &func, &cancel](uint32_t begin, uint32_t end) {
+        cancel.throwIfCancelled();
+        for (uint32_t j = begin; j < end; j++) {
+            float *row = &field.heights[j * RESOLUTION];
+            for (uint32_t i = 0; i < RESOLUTION; i++) {
+                row[i] = static_cast<float>(func(i * SPACING, j * SPACING));
+            }
+        }
+    });
+
+    // Samples at poles and undefined points would poison the bounds and
+    // curvature, and so the surface's culling and tessellation.
+    grid_samples::sanitize(field.heights, RESOLUTION);
+
+    field.patchCurvature.resize(PATCHES * PATCHES);
+    jobs::parallelFor(PATCHES * PATCHES, PATCHES, [&field](uint32_t begin, uint32_t end) {
+        for (uint32_t patch = begin; patch < end; patch++) {
+            field.patchCurvature[patch] = field.curvatureBound(patch % PATCHES, patch / PATCHES);
+        }
+    });
+
+    const auto [minY, maxY] = std::ranges::minmax(field.heights);
+    field.boundsMin         = {0.0f, minY, 0.0f};
+    field.boundsMax         = {1.0f, maxY, 1.0f};
+    return field;
+}
+
+inline float HeightField::curvatureBound(uint32_t patchX, uint32_t patchZ) const {
+    constexpr float INV_SPACING_SQ = static_cast<float>((RESOLUTION - 1) * (RESOLUTION - 1));
+
+    // Second differences need a neighbor on each side, so the grid edges use
+    // the differences one sample in.
+    auto interior = [](uint32_t k) { return std::clamp(k, 1u, RESOLUTION - 2); };
+
+    float bound = 0.0f;
+    for (uint32_t j = patchZ * CELLS_PER_PATCH; j <= (patchZ + 1) * CELLS_PER_PATCH; j++) {
+        for (uint32_t i = patchX * CELLS_PER_PATCH; i <= (patchX + 1) * CELLS_PER_PATCH; i++) {
+            const uint32_t x = interior(i);
+            const uint32_t z = interior(j);
+            const float dxx  = height(x - 1, j) - 2.0f * height(x, j) + height(x + 1, j);
+            const float dzz  = height(i, z - 1) - 2.0f * height(i, z) + height(i, z + 1);
+            // Triangles cut quads diagonally, so the mixed derivative counts too.
+            const float dxz = height(x, z) - height(x - 1, z) - height(x, z - 1) + height(x - 1, z - 1);
+            bound           = std::max({bound, std::abs(dxx), std::abs(dzz), std::abs(dxz)});
+        }
+    }
+    return bound * INV_SPACING_SQ;
+}
+
+#endif // HEIGHT_FIELD_H_
@@ -0,0 +1,193 @@
+#ifndef INDIRECT_DRAWS_H_
+#define INDIRECT_DRAWS_H_
+
+#include "mesh.h"
+#include "uniforms.h"
+#include "vulkan_objects.h"
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+// A cluster level of detail, as read by the culling shader.
+struct DrawLod {
+    uint32_t firstIndex = 0;
+    uint32_t indexCount = 0;
+    // Model-space height error.
+    float error           = 0.0f;
+    uint32_t _paddingWord = 0;
+};
+
+// One mesh cluster's draw, as read by the culling shader.
+struct DrawObject {
+    // The draw's arguments if the mesh is visible; the index range is
+    // replaced by that of the level of detail drawn.
+    VkDrawIndexedIndirectCommand command;
+    uint32_t numLods = 1;
+    // To align the bounds to 16 bytes.
+    uint32_t _paddingWords[2] = {};
+    // Model-space bounding box of the cluster.
+    glm::vec4 boundsMin;
+    glm::vec4 boundsMax;
+    // Finest first; must match MAX_LODS in cull.comp.
+    std::array<DrawLod, MeshCluster::MAX_LODS> lods = {};
+};
+// Must match the std430 layout in cull.comp.
+static_assert(sizeof(DrawObject) == 112);
+
+// Culling shader push constants.
+struct CullConstants {
+    uint32_t numDraws = 0;
+    // Coarsest levels of detail are drawn whose error projects to at most
+    // this many pixels.
+    float maxPixelError  = 1.0f;
+    float viewportHeight = 0.0f;
+};
+
+// GPU culling of the scene's draws, with its buffers and descriptors for
+// each frame in flight.
+//
+// The render thread lists the scene's draws as DrawObjects when the scene
+// changes, one per mesh cluster. Each frame a compute pass tests them
+// against the view frustum, picks each visible one's level of detail by
+// its projected error, and writes their indirect draw commands, giving
+// culled draws no instances. Draws are ordered so that those with the same
+// pipeline and geometry page are adjacent, and each such run is one
+// vkCmdDrawIndexedIndirect, however many meshes and clusters it has.
+struct IndirectDraws {
+    // Enough for the clusters of every mesh the scene can hold.
+    static constexpr uint32_t CAPACITY       = 1u << 15;
+    static constexpr uint32_t WORKGROUP_SIZE = 64;
+
+    // Host-visible DrawObject arrays.
+    UniformInfo objectInfo;
+    // Device-local VkDrawIndexedIndirectCommand arrays, written by culling.
+    std::vector<VkBuffer> commandBuffers;
+    std::vector<DeviceAllocation> commandBufferAllocations;
+
+    VkDescriptorPool descriptorPool           = VK_NULL_HANDLE;
+    VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> descriptorSets;
+
+public:
+    static constexpr VkDeviceSize objectBufferSize() {
+        return sizeof(DrawObject) * CAPACITY;
+    }
+
+    static constexpr VkDeviceSize commandBufferSize() {
+        return sizeof(VkDrawIndexedIndirectCommand) * CAPACITY;
+    }
+
+    static constexpr VkDeviceSize commandOffset(uint32_t draw) {
+        return sizeof(VkDrawIndexedIndirectCommand) * draw;
+    }
+
+    static constexpr uint32_t workgroupCount(uint32_t numDraws) {
+        return (numDraws + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE;
+    }
+
+    // Precondition: frame currentImage is not in flight.
+    void writeObjects(uint32_t currentImage, std::span<const DrawObject> objects) {
+        if (objects.size() > CAPACITY) {
+            throw std::runtime_error("Too many draws for indirect draw buffers!");
+        }
+        memcpy(objectInfo.uniformBuffersMapped[currentImage], objects.data(), objects.size_bytes());
+    }
+
+    // The culling shader reads the camera, model storage and draw objects,
+    // and writes the draw commands.
+    void createDescriptorSetLayout(VkDevice device) {
+        std::array<VkDescriptorSetLayoutBinding, 4> bindings{};
+        for (uint32_t i = 0; i < bindings.size(); ++i) {
+            bindings[i].binding         = i;
+            bindings[i].descriptorCount = 1;
+            bindings[i].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            bindings[i].stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+        bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings    = bindings.data();
+
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create culling descriptor set layout!");
+        }
+    }
+
+    void createDescriptorPool(VkDevice device, uint32_t numDescriptorSets) {
+        std::array<VkDescriptorPoolSize, 2> poolSizes = {};
+        poolSizes[0].type                             = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        poolSizes[0].descriptorCount                  = numDescriptorSets;
+        poolSizes[1].type                             = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        poolSizes[1].descriptorCount                  = 3 * numDescriptorSets;
+
+        VkDescriptorPoolCreateInfo createInfo = {};
+        createInfo.sType                      = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        createInfo.maxSets                    = numDescriptorSets;
+        createInfo.poolSizeCount              = static_cast<uint32_t>(poolSizes.size());
+        createInfo.pPoolSizes                 = poolSizes.data();
+
+        if (vkCreateDescriptorPool(device, &createInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+            throw std::runtime_error("Unable to create descriptor pool!");
+        }
+    }
+
+    void createDescriptorSets(VkDevice device, uint32_t numDescriptorSets, const UniformInfo &cameraInfo,
+                              const UniformInfo &modelInfo) {
+        std::vector<VkDescriptorSetLayout> layouts(numDescriptorSets, descriptorSetLayout);
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool     = descriptorPool;
+        allocInfo.descriptorSetCount = numDescriptorSets;
+        allocInfo.pSetLayouts        = layouts.data();
+
+        descriptorSets.resize(numDescriptorSets);
+        if (vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data()) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate descriptor sets!");
+        }
+
+        for (size_t i = 0; i < numDescriptorSets; i++) {
+            std::array<VkDescriptorBufferInfo, 4> bufferInfos = {{
+                {cameraInfo.uniformBuffers[i], 0, sizeof(CameraUniform)},
+                {modelInfo.uniformBuffers[i], 0, ModelStorage::bufferSize()},
+                {objectInfo.uniformBuffers[i], 0, objectBufferSize()},
+                {commandBuffers[i], 0, commandBufferSize()},
+            }};
+
+            std::array<VkWriteDescriptorSet, 4> descriptorWrites{};
+            for (uint32_t binding = 0; binding < descriptorWrites.size(); ++binding) {
+                descriptorWrites[binding].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                descriptorWrites[binding].dstSet          = descriptorSets[i];
+                descriptorWrites[binding].dstBinding      = binding;
+                descriptorWrites[binding].dstArrayElement = 0;
+                descriptorWrites[binding].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                descriptorWrites[binding].descriptorCount = 1;
+                descriptorWrites[binding].pBufferInfo     = &bufferInfos[binding];
+            }
+            descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+
+            vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0,
+                                   nullptr);
+        }
+    }
+
+    void destroyResources(VkDevice device, DeviceAllocator &allocator) {
+        objectInfo.destroy(device, allocator);
+        for (size_t i = 0; i < commandBuffers.size(); i++) {
+            vkDestroyBuffer(device, commandBuffers[i], nullptr);
+            allocator.free(commandBufferAllocations[i]);
+        }
+        vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+        vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+    }
+};
+
+#endif // INDIRECT_DRAWS_H_
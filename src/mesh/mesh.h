@@ -81,8 +81,8 @@ class MeshController {
     glm::vec3 meshPosition = {0.0f, 0.0f, 0.0f};
 
     bool rotationPaused = true;
-    // TODO: To use this it would have to be per image as in SceneInfo.
-    [[maybe_unused]] bool needsUniformWrite = true;
+    // Bit i is set while frame i's copy of the uniform is out of date.
+    uint32_t staleFrames = ~0u;
 
     using time_point          = decltype(std::chrono::high_resolution_clock::now());
     time_point lastUpdateTime = std::chrono::high_resolution_clock::now();
@@ -94,10 +94,23 @@ public:
 public:
     MeshController() = default;
 
-    ModelUniform &getUbo() {
+    const ModelUniform &getUbo() const {
         return ubo;
     }
 
+    bool needsWrite(uint32_t frame) const {
+        return (staleFrames & (1u << frame)) != 0;
+    }
+
+    void clearNeedsWrite(uint32_t frame) {
+        staleFrames &= ~(1u << frame);
+    }
+
+    // Marks the uniform stale in every frame in flight.
+    void setNeedsWrite() {
+        staleFrames = ~0u;
+    }
+
     void setPauseRotation(bool pause) {
         if (rotationPaused && !pause) {
             lastUpdateTime = std::chrono::high_resolution_clock::now();
@@ -106,13 +119,26 @@ public:
     }
 
     void updateFromAppState(const AppState &appState) {
-        ubo.metallic    = appState.metallic;
-        ubo.roughness   = appState.roughness;
-        ubo.colorEffect = appState.colorEffectIndex();
+        if (ubo.metallic == appState.metallic && ubo.roughness == appState.roughness) {
+            return;
+        }
+        ubo.metallic  = appState.metallic;
+        ubo.roughness = appState.roughness;
+        setNeedsWrite();
     }
 
     void updateColor(glm::vec3 color) {
-        ubo.meshColor = color;
+        if (ubo.meshColor != color) {
+            ubo.meshColor = color;
+            setNeedsWrite();
+        }
+    }
+
+    void setNormalMapped(bool normalMapped) {
+        if ((ubo.normalMapped != 0) != normalMapped) {
+            ubo.normalMapped = normalMapped ? 1 : 0;
+            setNeedsWrite();
+        }
     }
 
     void restartRotation() {
@@ -123,6 +149,14 @@ public:
         yRotRad = inYRotRad;
     }
 
+    // Places the mesh where other's mesh is.
+    void syncModel(const MeshController &other) {
+        if (ubo.model != other.ubo.model) {
+            ubo.model = other.ubo.model;
+            setNeedsWrite();
+        }
+    }
+
     void reset() {
         xRotRad      = 0;
         yRotRad      = 0;
@@ -138,6 +172,7 @@ public:
         ubo.model = glm::rotate(ubo.model, static_cast<float>(-xRotRad), glm::vec3(1.0f, 0.0f, 0.0f));
         ubo.model = glm::translate(ubo.model, DEFAULT_MESH_POSITION);
         // auto inversePosition  = glm::vec3(glm::inverse(ubo.model) * glm::vec4(meshPosition, 0));
+        setNeedsWrite();
     }
 
     void applyUserRotation(const std::pair<double, double> userRot) {
@@ -172,112 +207,121 @@ public:
     }
 };
 
+// One level of detail of a cluster: its triangles' index range, and a
+// bound on their height difference from the full-detail surface.
+struct ClusterLod {
+    uint32_t firstIndex = 0;
+    uint32_t numIndices = 0;
+    float error         = 0.0f;
+};
+
+// A spatially compact part of a mesh, frustum-culled on its own so that a
+// zoomed-in view only draws the clusters it can see. Each frame one of its
+// levels of detail is drawn, chosen by projected error. The levels share
+// the cluster's boundary edges, so any mix of levels is crack-free.
+struct MeshCluster {
+    static constexpr uint32_t MAX_LODS = 3;
+
+    glm::vec3 boundsMin = {};
+    glm::vec3 boundsMax = {};
+    // Finest first; lods[0] is the full-detail range.
+    std::array<ClusterLod, MAX_LODS> lods = {};
+    uint32_t numLods                      = 1;
+};
+
+// What the host keeps of a mesh once its arrays live on the device.
+struct MeshMetadata {
+    uint32_t numVertices = 0;
+    uint32_t numIndices  = 0;
+    glm::vec3 color      = {};
+    glm::vec3 boundsMin  = {};
+    glm::vec3 boundsMax  = {};
+    // Partition the index list. Meshes without a spatial ordering have
+    // a single cluster.
+    std::vector<MeshCluster> clusters;
+
+    static MeshMetadata of(const std::vector<Vertex> &vertices, const std::vector<uint32_t> &indices) {
+        MeshMetadata metadata;
+        metadata.numVertices = static_cast<uint32_t>(vertices.size());
+        metadata.numIndices  = static_cast<uint32_t>(indices.size());
+        if (vertices.empty()) {
+            return metadata;
+        }
+
+        metadata.color     = vertices[0].color;
+        metadata.boundsMin = vertices[0].pos;
+        metadata.boundsMax = vertices[0].pos;
+        for (const Vertex &vertex : vertices) {
+            metadata.boundsMin = glm::min(metadata.boundsMin, vertex.pos);
+            metadata.boundsMax = glm::max(metadata.boundsMax, vertex.pos);
+        }
+        MeshCluster cluster;
+        cluster.boundsMin = metadata.boundsMin;
+        cluster.boundsMax = metadata.boundsMax;
+        cluster.lods[0]   = {0, metadata.numIndices};
+        metadata.clusters = {cluster};
+        return metadata;
+    }
+};
+
+// A mesh's ranges in a GeometryArena. Indices are relative to the mesh,
+// so draws pass firstVertex as their vertex offset.
+struct MeshGeometry {
+    static constexpr uint32_t NO_PAGE = UINT32_MAX;
+
+    uint32_t page        = NO_PAGE;
+    uint32_t firstVertex = 0;
+    uint32_t numVertices = 0;
+    uint32_t firstIndex  = 0;
+    uint32_t numIndices  = 0;
+
+    bool allocated() const {
+        return page != NO_PAGE;
+    }
+};
+
 struct IndexedMesh {
+    // Host copies of the mesh, freed by releaseHostData once uploaded.
     std::vector<Vertex> vertices;
     std::vector<uint32_t> indices;
 
-    VkBuffer vertexBuffer;
-    VkDeviceMemory vertexBufferMemory;
-    VkBuffer indexBuffer;
-    VkDeviceMemory indexBufferMemory;
-    uint32_t numIndices;
+    MeshGeometry geometry;
+    MeshMetadata metadata;
 
-    UniformInfo uniformInfo;
     MeshController controller;
-
-    VkDescriptorPool descriptorPool;
-    DescriptorSetLayout descriptorSetLayout;
-    std::vector<VkDescriptorSet> descriptorSets;
+    // This mesh's slot in the shared ModelStorage.
+    uint32_t uniformSlot = 0;
 
 public:
     IndexedMesh() = default;
 
     IndexedMesh(std::vector<Vertex> &&inVertices, std::vector<uint32_t> &&inIndices)
         : vertices{std::forward<std::vector<Vertex>>(inVertices)},
-          indices{std::forward<std::vector<uint32_t>>(inIndices)} {
+          indices{std::forward<std::vector<uint32_t>>(inIndices)},
+          metadata{MeshMetadata::of(vertices, indices)} {
         controller.updateMatrix();
     }
 
-    glm::vec3 &getVertColor() {
-        assert(!vertices.empty());
-        return vertices[0].color;
-    }
-
-public:
-    void createDescriptorSetLayout(VkDevice device) {
-        descriptorSetLayout.init(device);
-    }
-
-    void createDescriptorPool(VkDevice device, uint32_t numDescriptorSets) {
-        VkDescriptorPoolSize poolSize = {};
-        poolSize.type                 = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        poolSize.descriptorCount      = numDescriptorSets;
-
-        VkDescriptorPoolCreateInfo createInfo = {};
-        createInfo.sType                      = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-        createInfo.maxSets                    = numDescriptorSets;
-        createInfo.poolSizeCount              = 1;
-        createInfo.pPoolSizes                 = &poolSize;
-
-        if (vkCreateDescriptorPool(device, &createInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
-            throw std::runtime_error("Unable to create descriptor pool!");
-        }
-    }
-
-    void createDescriptorSets(VkDevice device, uint32_t numDescriptorSets) {
-        std::vector<VkDescriptorSetLayout> layouts(numDescriptorSets, descriptorSetLayout.layout);
-        VkDescriptorSetAllocateInfo allocInfo{};
-        allocInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-        allocInfo.descriptorPool     = descriptorPool;
-        allocInfo.descriptorSetCount = numDescriptorSets;
-        allocInfo.pSetLayouts        = layouts.data();
-
-        descriptorSets.resize(numDescriptorSets);
-        if (vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data()) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to allocate descriptor sets!");
-        }
-
-        for (size_t i = 0; i < numDescriptorSets; i++) {
-            VkDescriptorBufferInfo bufferInfo{};
-            bufferInfo.buffer = uniformInfo.uniformBuffers[i];
-            bufferInfo.offset = 0;
-            bufferInfo.range  = sizeof(ModelUniform);
-
-            VkWriteDescriptorSet descriptorWrite{};
-            descriptorWrite.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptorWrite.dstSet          = descriptorSets[i];
-            descriptorWrite.dstBinding      = 0;
-            descriptorWrite.dstArrayElement = 0;
-            descriptorWrite.descriptorType  = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-            descriptorWrite.descriptorCount = 1;
-            descriptorWrite.pBufferInfo     = &bufferInfo;
-
-            vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
-        }
-    }
-
-    bool needsUniformBufferWrite() {
-        return true;
+    const glm::vec3 &getVertColor() const {
+        return metadata.color;
     }
 
-    void updateUniformBuffer(uint32_t currentImage) {
-        memcpy(uniformInfo.uniformBuffersMapped[currentImage], &controller.getUbo(), sizeof(ModelUniform));
+    // Frees the host arrays once the device buffers hold the mesh. A mesh
+    // needed on the host again, e.g. for export or picking, is rebuilt
+    // from its function rather than kept around.
+    void releaseHostData() {
+        std::vector<Vertex>().swap(vertices);
+        std::vector<uint32_t>().swap(indices);
     }
 
-    void destroyBuffers(VkDevice device) {
-        vkDestroyBuffer(device, vertexBuffer, nullptr);
-        vkFreeMemory(device, vertexBufferMemory, nullptr);
-
-        vkDestroyBuffer(device, indexBuffer, nullptr);
-        vkFreeMemory(device, indexBufferMemory, nullptr);
+public:
+    bool needsUniformBufferWrite(uint32_t currentImage) const {
+        return controller.needsWrite(currentImage);
     }
 
-    void destroyResources(VkDevice device) {
-        uniformInfo.destroy(device);
-        destroyBuffers(device);
-
-        vkDestroyDescriptorPool(device, descriptorPool, nullptr);
-        descriptorSetLayout.destroy();
+    void updateUniformBuffer(ModelStorage &models, uint32_t currentImage) {
+        models.write(uniformSlot, currentImage, controller.getUbo());
+        controller.clearNeedsWrite(currentImage);
     }
 };
 
@@ -0,0 +1,68 @@
+#ifndef MESH_BUILD_RESULT_H_
+#define MESH_BUILD_RESULT_H_
+
+#include "height_field.h"
+#include "mesh.h"
+#include "mesh_upload.h"
+#include "normal_map.h"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+// Output of one mesh build, sent from the builder job to the render thread.
+// Move-only; the builder does not touch it again once it is sent.
+struct MeshBuildResult {
+    // Identifies the build request this came from; later requests have larger ids.
+    uint64_t buildId = 0;
+
+    // Function mesh then floor mesh; empty if the build failed.
+    std::array<IndexedMesh, 2> meshes = {};
+
+    // Device copy of the function mesh, if the builder uploaded it.
+    std::optional<MeshUpload> graphUpload = std::nullopt;
+
+    // Set instead of graphUpload when the graph is drawn as a tessellated
+    // surface; the function mesh is then empty.
+    std::optional<HeightField> heightField = std::nullopt;
+
+    // Shades the final graph of a build if set; previews have none.
+    std::optional<NormalMap> normalMap = std::nullopt;
+
+    // Reason the build failed; empty on success.
+    std::string error = "";
+
+    // Set on coarse meshes sent while refinement is still running;
+    // the final mesh of the same build follows.
+    bool preview = false;
+
+    // Time from the start of the build until this mesh was ready.
+    std::chrono::milliseconds buildTime = {};
+    size_t numVertices                  = 0;
+    size_t numIndices                   = 0;
+
+    MeshBuildResult() = default;
+
+    MeshBuildResult(MeshBuildResult &&)            = default;
+    MeshBuildResult &operator=(MeshBuildResult &&) = default;
+
+    MeshBuildResult(const MeshBuildResult &)            = delete;
+    MeshBuildResult &operator=(const MeshBuildResult &) = delete;
+
+    bool failed() const {
+        return !error.empty();
+    }
+};
+
+// A normal map evaluated on its own, for the final graph of a build that
+// was made without one, sent from its job to the render thread.
+struct NormalMapResult {
+    // The build whose graph the map shades.
+    uint64_t buildId = 0;
+    NormalMap normalMap;
+};
+
+#endif // MESH_BUILD_RESULT_H_
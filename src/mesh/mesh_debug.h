@@ -72,8 +72,9 @@ public:
                  << std::endl;
         };
 
-        for (const auto &tri : mFuncMesh.mFunctionMeshTriangles) {
-            addTri(tri);
+        const std::vector<uint32_t> &indices = mFuncMesh.mMeshIndices;
+        for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+            addTri(Triangle{.vert1Idx = indices[i], .vert2Idx = indices[i + 1], .vert3Idx = indices[i + 2]});
         }
 
         file << R"(</svg>)" << std::endl;
@@ -0,0 +1,68 @@
+#include "mesh_upload.h"
+
+#include <algorithm>
+#include <cassert>
+#include <utility>
+
+MeshUpload::MeshUpload(GeometryArena &arena, size_t numVertices, size_t numIndices)
+    : mArena(&arena),
+      mGeometry(arena.allocate(static_cast<uint32_t>(numVertices), static_cast<uint32_t>(numIndices))),
+      mNumVertices(numVertices),
+      mNumIndices(numIndices) {
+}
+
+MeshUpload::~MeshUpload() {
+    freeGeometry();
+}
+
+MeshUpload::MeshUpload(MeshUpload &&other) noexcept
+    : mArena(other.mArena),
+      mGeometry(std::exchange(other.mGeometry, {})),
+      mNumVertices(other.mNumVertices),
+      mNumIndices(other.mNumIndices),
+      mReadyValue(other.mReadyValue),
+      mFinished(other.mFinished) {
+}
+
+MeshUpload &MeshUpload::operator=(MeshUpload &&other) noexcept {
+    if (this != &other) {
+        freeGeometry();
+        mArena       = other.mArena;
+        mGeometry    = std::exchange(other.mGeometry, {});
+        mNumVertices = other.mNumVertices;
+        mNumIndices  = other.mNumIndices;
+        mReadyValue  = other.mReadyValue;
+        mFinished    = other.mFinished;
+    }
+    return *this;
+}
+
+void MeshUpload::writeVertices(uint32_t firstVertex, std::span<const Vertex> vertices) {
+    assert(!mFinished);
+    const uint64_t value = mArena->writeVertices(mGeometry, firstVertex, vertices);
+    mReadyValue          = std::max(mReadyValue, value);
+}
+
+void MeshUpload::writeIndices(uint32_t firstIndex, std::span<const uint32_t> indices) {
+    assert(!mFinished);
+    const uint64_t value = mArena->writeIndices(mGeometry, firstIndex, indices);
+    mReadyValue          = std::max(mReadyValue, value);
+}
+
+void MeshUpload::finish() {
+    mFinished = true;
+}
+
+MeshGeometry MeshUpload::release() {
+    assert(mFinished);
+    return std::exchange(mGeometry, {});
+}
+
+void MeshUpload::freeGeometry() {
+    if (!mGeometry.allocated()) {
+        return;
+    }
+    // Copies into the geometry may still be running.
+    mArena->transferQueue().wait(mReadyValue);
+    mArena->free(mGeometry);
+}
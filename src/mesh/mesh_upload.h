@@ -0,0 +1,78 @@
+#ifndef MESH_UPLOAD_H_
+#define MESH_UPLOAD_H_
+
+#include "geometry_arena.h"
+#include "mesh.h"
+#include "transfer_queue.h"
+
+#include <vulkan/vulkan.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+// Space for one mesh in a GeometryArena, sized up front and filled piece by
+// piece through the arena's TransferQueue while the rest of the mesh is
+// still being built.
+//
+// Writes and finish must come from the thread building the mesh. After
+// finish the upload may be passed to another thread, which takes the
+// geometry with release once ready; geometry not released is freed on
+// destruction, after any copies into it have completed.
+class MeshUpload {
+public:
+    MeshUpload(GeometryArena &arena, size_t numVertices, size_t numIndices);
+    ~MeshUpload();
+
+    MeshUpload(MeshUpload &&other) noexcept;
+    MeshUpload &operator=(MeshUpload &&other) noexcept;
+
+    MeshUpload(const MeshUpload &)            = delete;
+    MeshUpload &operator=(const MeshUpload &) = delete;
+
+    size_t numVertices() const {
+        return mNumVertices;
+    }
+    size_t numIndices() const {
+        return mNumIndices;
+    }
+
+    // The mesh's memory if the host can write it directly, else nullptr.
+    // A mesh packed straight into it needs no writeVertices or writeIndices.
+    Vertex *mappedVertices() const {
+        return mArena->mappedVertices(mGeometry);
+    }
+    uint32_t *mappedIndices() const {
+        return mArena->mappedIndices(mGeometry);
+    }
+
+    void writeVertices(uint32_t firstVertex, std::span<const Vertex> vertices);
+    void writeIndices(uint32_t firstIndex, std::span<const uint32_t> indices);
+
+    // Ends the writes without waiting for them; see readyValue.
+    void finish();
+
+    // Transfer timeline value at which all writes have completed.
+    uint64_t readyValue() const {
+        return mReadyValue;
+    }
+    bool ready() const {
+        return mArena->transferQueue().reached(mReadyValue);
+    }
+
+    // Precondition: finish has been called.
+    MeshGeometry release();
+
+private:
+    void freeGeometry();
+
+private:
+    GeometryArena *mArena  = nullptr;
+    MeshGeometry mGeometry = {};
+    size_t mNumVertices    = 0;
+    size_t mNumIndices     = 0;
+    uint64_t mReadyValue   = 0;
+    bool mFinished         = false;
+};
+
+#endif // MESH_UPLOAD_H_
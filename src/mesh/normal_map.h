@@ -0,0 +1,79 @@
+#ifndef NORMAL_MAP_H_
+#define NORMAL_MAP_H_
+
+#include "cancellation.h"
+#include "grid_samples.h"
+#include "scheduler.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// Function gradients on a grid much finer than any mesh, which pbr2.frag
+// samples for its normals. Interpolated vertex normals smear detail that
+// changes fast compared to the distance between vertices, so without this
+// shading accuracy would depend on mesh density; see the note above
+// computeVerticesAndIndices in function_mesh.cpp.
+struct NormalMap {
+    // Texels per side.
+    static constexpr uint32_t RESOLUTION = 1024;
+
+    // Row-major, with rows along x; texel (i, j) is centered at
+    // ((i, j) + 0.5) / RESOLUTION, where a texture sampled at a mesh
+    // position's (x, z) reads it. Each is (dy/dx, dy/dz) as half floats,
+    // packed for an R16G16_SFLOAT image, from which the shader rebuilds the
+    // normal as FunctionMesh does.
+    std::vector<uint32_t> gradients;
+
+    // Evaluates func at every texel center and differentiates, in parallel.
+    // Throws jobs::OperationCancelled if cancel is triggered.
+    template <typename Func>
+    static NormalMap evaluate(Func &func, const jobs::CancellationToken &cancel);
+};
+
+template <typename Func>
+NormalMap NormalMap::evaluate(Func &func, const jobs::CancellationToken &cancel) {
+    constexpr uint32_t ROW_BLOCK_SIZE = 32;
+    constexpr double SPACING          = 1.0 / RESOLUTION;
+    constexpr float MAX_GRADIENT      = 1.0e4f;
+
+    std::vector<float> heights(RESOLUTION * RESOLUTION);
+    jobs::parallelFor(RESOLUTION, ROW_BLOCK_SIZE, [&heights, &func, &cancel](uint32_t begin, uint32_t end) {
+        cancel.throwIfCancelled();
+        for (uint32_t j = begin; j < end; j++) {
+            float *row = &heights[j * RESOLUTION];
+            for (uint32_t i = 0; i < RESOLUTION; i++) {
+                row[i] = static_cast<float>(func((i + 0.5) * SPACING, (j + 0.5) * SPACING));
+            }
+        }
+    });
+
+    // NaNs would pass through the clamp below, and linear filtering would
+    // spread them to the texels around them.
+    grid_samples::sanitize(heights, RESOLUTION);
+
+    // Central differences, one-sided at the edges of the square.
+    NormalMap map;
+    map.gradients.resize(RESOLUTION * RESOLUTION);
+    jobs::parallelFor(RESOLUTION, ROW_BLOCK_SIZE, [&map, &heights](uint32_t begin, uint32_t end) {
+        auto height = [&heights](uint32_t i, uint32_t j) { return heights[j * RESOLUTION + i]; };
+        for (uint32_t j = begin; j < end; j++) {
+            const uint32_t down = j > 0 ? j - 1 : j;
+            const uint32_t up   = j < RESOLUTION - 1 ? j + 1 : j;
+            for (uint32_t i = 0; i < RESOLUTION; i++) {
+                const uint32_t left  = i > 0 ? i - 1 : i;
+                const uint32_t right = i < RESOLUTION - 1 ? i + 1 : i;
+
+                const float dydx = (height(right, j) - height(left, j)) / static_cast<float>((right - left) * SPACING);
+                const float dydz = (height(i, up) - height(i, down)) / static_cast<float>((up - down) * SPACING);
+                // Half floats overflow past 65504; the normal barely turns beyond this.
+                const glm::vec2 gradient          = glm::clamp(glm::vec2(dydx, dydz), -MAX_GRADIENT, MAX_GRADIENT);
+                map.gradients[j * RESOLUTION + i] = glm::packHalf2x16(gradient);
+            }
+        }
+    });
+    return map;
+}
+
+#endif // NORMAL_MAP_H_
@@ -0,0 +1,126 @@
+#ifndef NORMAL_MAP_TEXTURE_H_
+#define NORMAL_MAP_TEXTURE_H_
+
+#include "normal_map.h"
+#include "texture.h"
+#include "transfer_queue.h"
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <stdexcept>
+
+// A NormalMap on the device, read by pbr2.frag through descriptorSet.
+// Gradients rather than normals are filtered, which interpolates the
+// surface's slope the way the shader then uses it.
+struct NormalMapTexture {
+    Texture2D gradients;
+    // Transfer timeline value at which the texture is written.
+    uint64_t readyValue = 0;
+    // Allocated once the map is shown; see NormalMapDescriptors.
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+
+    // Starts the upload without waiting for it.
+    void create(VkDevice device, TransferQueue &transfer, const NormalMap &map) {
+        gradients.create(device, transfer, NormalMap::RESOLUTION, NormalMap::RESOLUTION, VK_FORMAT_R16G16_SFLOAT);
+        readyValue = gradients.upload(map.gradients.data(), sizeof(uint32_t) * map.gradients.size());
+    }
+
+    // A one-texel map of a flat surface, bound for meshes without their
+    // own; their shaders don't sample it.
+    void createFlat(VkDevice device, TransferQueue &transfer) {
+        const uint32_t zeroGradient = 0;
+        gradients.create(device, transfer, 1, 1, VK_FORMAT_R16G16_SFLOAT);
+        readyValue = gradients.upload(&zeroGradient, sizeof(zeroGradient));
+    }
+
+    void destroy() {
+        gradients.destroy();
+    }
+};
+
+// Descriptor set layout of normal maps, and a pool of sets for the flat
+// map, the map shown and those retired while frames in flight may still
+// read them.
+struct NormalMapDescriptors {
+    static constexpr uint32_t MAX_SETS = 4;
+
+    VkDescriptorPool descriptorPool           = VK_NULL_HANDLE;
+    VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+
+public:
+    void createDescriptorSetLayout(VkDevice device) {
+        VkDescriptorSetLayoutBinding binding = {};
+        binding.binding                      = 0;
+        binding.descriptorCount              = 1;
+        binding.descriptorType               = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        binding.stageFlags                   = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = 1;
+        layoutInfo.pBindings    = &binding;
+
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create normal map descriptor set layout!");
+        }
+    }
+
+    void createDescriptorPool(VkDevice device) {
+        VkDescriptorPoolSize poolSize = {};
+        poolSize.type                 = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        poolSize.descriptorCount      = MAX_SETS;
+
+        VkDescriptorPoolCreateInfo createInfo = {};
+        createInfo.sType                      = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        createInfo.flags                      = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+        createInfo.maxSets                    = MAX_SETS;
+        createInfo.poolSizeCount              = 1;
+        createInfo.pPoolSizes                 = &poolSize;
+
+        if (vkCreateDescriptorPool(device, &createInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+            throw std::runtime_error("Unable to create descriptor pool!");
+        }
+    }
+
+    // Sets map's descriptor set, which serves every frame in flight.
+    void allocateSet(VkDevice device, NormalMapTexture &map) {
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool     = descriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts        = &descriptorSetLayout;
+
+        if (vkAllocateDescriptorSets(device, &allocInfo, &map.descriptorSet) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate descriptor sets!");
+        }
+
+        VkDescriptorImageInfo imageInfo = map.gradients.descriptorInfo();
+
+        VkWriteDescriptorSet descriptorWrite = {};
+        descriptorWrite.sType                = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrite.dstSet               = map.descriptorSet;
+        descriptorWrite.dstBinding           = 0;
+        descriptorWrite.dstArrayElement      = 0;
+        descriptorWrite.descriptorType       = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrite.descriptorCount      = 1;
+        descriptorWrite.pImageInfo           = &imageInfo;
+
+        vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+    }
+
+    void freeSet(VkDevice device, NormalMapTexture &map) {
+        if (map.descriptorSet == VK_NULL_HANDLE) {
+            return;
+        }
+        vkFreeDescriptorSets(device, descriptorPool, 1, &map.descriptorSet);
+        map.descriptorSet = VK_NULL_HANDLE;
+    }
+
+    void destroyResources(VkDevice device) {
+        vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+        vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+    }
+};
+
+#endif // NORMAL_MAP_TEXTURE_H_
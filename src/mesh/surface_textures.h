@@ -0,0 +1,150 @@
+#ifndef SURFACE_TEXTURES_H_
+#define SURFACE_TEXTURES_H_
+
+#include "height_field.h"
+#include "texture.h"
+#include "transfer_queue.h"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+
+// Surface pipeline push constants.
+struct SurfaceConstants {
+    // Patch edges are split until their interpolation error projects to at
+    // most this many pixels.
+    float maxPixelError  = 1.0f;
+    float viewportHeight = 0.0f;
+};
+
+// A HeightField on the device: heights and patch curvature bounds as
+// single-channel float textures, read by the surface pipeline's
+// tessellation shaders through descriptorSet.
+struct SurfaceTextures {
+    Texture2D heights;
+    Texture2D curvature;
+    // Transfer timeline value at which both textures are written.
+    uint64_t readyValue = 0;
+    // Allocated once the surface is shown; see SurfaceDescriptors.
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+
+    // Starts the uploads without waiting for them.
+    void create(VkDevice device, TransferQueue &transfer, const HeightField &field) {
+        // Linear filtering of 32-bit floats is optional, so the shaders fetch
+        // texels and interpolate heights themselves.
+        heights.create(device, transfer, HeightField::RESOLUTION, HeightField::RESOLUTION, VK_FORMAT_R32_SFLOAT,
+                       VK_FILTER_NEAREST);
+        curvature.create(device, transfer, HeightField::PATCHES, HeightField::PATCHES, VK_FORMAT_R32_SFLOAT,
+                         VK_FILTER_NEAREST);
+
+        const uint64_t heightsValue = heights.upload(field.heights.data(), sizeof(float) * field.heights.size());
+        const uint64_t curvatureValue =
+            curvature.upload(field.patchCurvature.data(), sizeof(float) * field.patchCurvature.size());
+        readyValue = std::max(heightsValue, curvatureValue);
+    }
+
+    void destroy() {
+        heights.destroy();
+        curvature.destroy();
+    }
+};
+
+// Descriptor set layout of the surface textures, and a pool of sets for the
+// surface shown and those retired while frames in flight may still read
+// them.
+struct SurfaceDescriptors {
+    static constexpr uint32_t MAX_SETS = 4;
+
+    VkDescriptorPool descriptorPool           = VK_NULL_HANDLE;
+    VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+
+public:
+    // Heights are read by the vertex and evaluation shaders, curvature by
+    // tessellation control.
+    void createDescriptorSetLayout(VkDevice device) {
+        std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+        bindings[0].binding         = 0;
+        bindings[0].descriptorCount = 1;
+        bindings[0].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        bindings[0].stageFlags      = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+        bindings[1].binding         = 1;
+        bindings[1].descriptorCount = 1;
+        bindings[1].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        bindings[1].stageFlags      = VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings    = bindings.data();
+
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create surface descriptor set layout!");
+        }
+    }
+
+    void createDescriptorPool(VkDevice device) {
+        VkDescriptorPoolSize poolSize = {};
+        poolSize.type                 = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        poolSize.descriptorCount      = 2 * MAX_SETS;
+
+        VkDescriptorPoolCreateInfo createInfo = {};
+        createInfo.sType                      = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        createInfo.flags                      = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+        createInfo.maxSets                    = MAX_SETS;
+        createInfo.poolSizeCount              = 1;
+        createInfo.pPoolSizes                 = &poolSize;
+
+        if (vkCreateDescriptorPool(device, &createInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+            throw std::runtime_error("Unable to create descriptor pool!");
+        }
+    }
+
+    // Sets surface's descriptor set. The textures never change, so one set
+    // serves every frame in flight.
+    void allocateSet(VkDevice device, SurfaceTextures &surface) {
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool     = descriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts        = &descriptorSetLayout;
+
+        if (vkAllocateDescriptorSets(device, &allocInfo, &surface.descriptorSet) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate descriptor sets!");
+        }
+
+        std::array<VkDescriptorImageInfo, 2> imageInfos = {surface.heights.descriptorInfo(),
+                                                           surface.curvature.descriptorInfo()};
+
+        std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+        for (uint32_t binding = 0; binding < descriptorWrites.size(); ++binding) {
+            descriptorWrites[binding].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[binding].dstSet          = surface.descriptorSet;
+            descriptorWrites[binding].dstBinding      = binding;
+            descriptorWrites[binding].dstArrayElement = 0;
+            descriptorWrites[binding].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            descriptorWrites[binding].descriptorCount = 1;
+            descriptorWrites[binding].pImageInfo      = &imageInfos[binding];
+        }
+
+        vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0,
+                               nullptr);
+    }
+
+    void freeSet(VkDevice device, SurfaceTextures &surface) {
+        if (surface.descriptorSet == VK_NULL_HANDLE) {
+            return;
+        }
+        vkFreeDescriptorSets(device, descriptorPool, 1, &surface.descriptorSet);
+        surface.descriptorSet = VK_NULL_HANDLE;
+    }
+
+    void destroyResources(VkDevice device) {
+        vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+        vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+    }
+};
+
+#endif // SURFACE_TEXTURES_H_
@@ -0,0 +1,94 @@
+#ifndef TRANSITION_STENCILS_H_
+#define TRANSITION_STENCILS_H_
+
+#include <array>
+#include <cstdint>
+
+// Triangulation stencils for leaf squares of the refinement quadtree.
+//
+// The tree is kept balanced, so across each edge a leaf borders either
+// squares no finer than itself, or exactly two squares one level deeper.
+// In the second case the edge midpoint is a mesh vertex that the leaf
+// must use to stay watertight. Leaves are triangulated as a fan about
+// their center, so there are only 16 configurations, indexed by a mask
+// with one bit per refined edge.
+
+namespace stencils {
+
+// Bits of the edge refinement mask.
+enum EdgeBit : uint8_t {
+    NORTH_BIT = 1 << 0,
+    EAST_BIT  = 1 << 1,
+    SOUTH_BIT = 1 << 2,
+    WEST_BIT  = 1 << 3,
+};
+
+// Local vertex ids referenced by stencil indices.
+enum LocalVertex : uint8_t {
+    CENTER       = 0,
+    TOP_LEFT     = 1,
+    TOP_RIGHT    = 2,
+    BOTTOM_RIGHT = 3,
+    BOTTOM_LEFT  = 4,
+    NORTH_MID    = 5,
+    EAST_MID     = 6,
+    SOUTH_MID    = 7,
+    WEST_MID     = 8,
+};
+
+inline constexpr uint32_t NUM_LOCAL_VERTICES = 9;
+inline constexpr uint32_t MAX_STENCIL_TRIS   = 8;
+inline constexpr uint32_t NUM_STENCILS       = 16;
+
+struct Stencil {
+    uint8_t numTris                                   = 0;
+    std::array<uint8_t, 3 * MAX_STENCIL_TRIS> indices = {};
+};
+
+constexpr Stencil makeStencil(uint8_t mask) {
+    // Walk the boundary in the winding order used for all mesh triangles.
+    std::array<uint8_t, MAX_STENCIL_TRIS> perimeter = {};
+    uint8_t numPerimeter                            = 0;
+
+    perimeter[numPerimeter++] = TOP_LEFT;
+    if (mask & WEST_BIT) {
+        perimeter[numPerimeter++] = WEST_MID;
+    }
+    perimeter[numPerimeter++] = BOTTOM_LEFT;
+    if (mask & SOUTH_BIT) {
+        perimeter[numPerimeter++] = SOUTH_MID;
+    }
+    perimeter[numPerimeter++] = BOTTOM_RIGHT;
+    if (mask & EAST_BIT) {
+        perimeter[numPerimeter++] = EAST_MID;
+    }
+    perimeter[numPerimeter++] = TOP_RIGHT;
+    if (mask & NORTH_BIT) {
+        perimeter[numPerimeter++] = NORTH_MID;
+    }
+
+    Stencil stencil{.numTris = numPerimeter};
+    for (uint8_t i = 0; i < numPerimeter; i++) {
+        stencil.indices[3 * i]     = CENTER;
+        stencil.indices[3 * i + 1] = perimeter[i];
+        stencil.indices[3 * i + 2] = perimeter[(i + 1) % numPerimeter];
+    }
+    return stencil;
+}
+
+constexpr std::array<Stencil, NUM_STENCILS> makeStencilTable() {
+    std::array<Stencil, NUM_STENCILS> table = {};
+    for (uint8_t mask = 0; mask < NUM_STENCILS; mask++) {
+        table[mask] = makeStencil(mask);
+    }
+    return table;
+}
+
+inline constexpr std::array<Stencil, NUM_STENCILS> STENCIL_TABLE = makeStencilTable();
+
+static_assert(STENCIL_TABLE[0].numTris == 4);
+static_assert(STENCIL_TABLE[NORTH_BIT | EAST_BIT | SOUTH_BIT | WEST_BIT].numTris == 8);
+
+} // namespace stencils
+
+#endif // TRANSITION_STENCILS_H_
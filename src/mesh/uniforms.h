@@ -12,7 +12,10 @@
 #include <vulkan/vulkan.h>
 #include <vulkan/vulkan_core.h>
 
+#include <cstdint>
 #include <cstring>
+#include <stdexcept>
+#include <vector>
 
 struct ModelUniform {
     glm::mat4 model;
@@ -21,8 +24,10 @@ struct ModelUniform {
     // PBR parameters.
     glm::float32 roughness = 0.0;
     glm::float32 metallic  = 0.0;
-    // See ColorEffect enum.
-    glm::i32 colorEffect = 0;
+    // Nonzero if PBR2 shades with the graph's normal map.
+    glm::uint32 normalMapped = 0;
+    // Pads to the std430 array stride; see ModelStorage.
+    glm::float32 _paddingFloats[2] = {};
 };
 
 static constexpr float DIST_COMP              = 1.5f;
@@ -153,8 +158,117 @@ public:
         needsBufferWrite[currentImage] = false;
     }
 
-    void destroyResources(VkDevice device) {
-        uniformInfo.destroy(device);
+    void destroyResources(VkDevice device, DeviceAllocator &allocator) {
+        uniformInfo.destroy(device, allocator);
+        vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+        descriptorSetLayout.destroy();
+    }
+};
+
+// Model data of all meshes, as an array in one storage buffer per frame in
+// flight. Each mesh owns a slot, which its draws pass as firstInstance so
+// that shaders find its entry at gl_InstanceIndex. Meshes need no buffers
+// or descriptors of their own, and one descriptor set serves every draw.
+struct ModelStorage {
+    static constexpr uint32_t CAPACITY = 256;
+
+    UniformInfo storageInfo;
+    // Unused slots; the last one is handed out next.
+    std::vector<uint32_t> freeSlots;
+
+    VkDescriptorPool descriptorPool;
+    DescriptorSetLayout descriptorSetLayout;
+    std::vector<VkDescriptorSet> descriptorSets;
+
+public:
+    void init() {
+        freeSlots.clear();
+        for (uint32_t slot = CAPACITY; slot > 0; --slot) {
+            freeSlots.push_back(slot - 1);
+        }
+    }
+
+    static constexpr VkDeviceSize bufferSize() {
+        return sizeof(ModelUniform) * CAPACITY;
+    }
+
+    bool full() const {
+        return freeSlots.empty();
+    }
+
+    uint32_t acquireSlot() {
+        if (freeSlots.empty()) {
+            throw std::runtime_error("Out of model storage slots!");
+        }
+        uint32_t slot = freeSlots.back();
+        freeSlots.pop_back();
+        return slot;
+    }
+
+    // The slot must no longer be used by frames in flight.
+    void releaseSlot(uint32_t slot) {
+        freeSlots.push_back(slot);
+    }
+
+    void write(uint32_t slot, uint32_t currentImage, const ModelUniform &ubo) {
+        auto *mapped = static_cast<ModelUniform *>(storageInfo.uniformBuffersMapped[currentImage]);
+        memcpy(mapped + slot, &ubo, sizeof(ModelUniform));
+    }
+
+    void createDescriptorSetLayout(VkDevice device) {
+        descriptorSetLayout.init(device, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    }
+
+    void createDescriptorPool(VkDevice device, uint32_t numDescriptorSets) {
+        VkDescriptorPoolSize poolSize = {};
+        poolSize.type                 = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        poolSize.descriptorCount      = numDescriptorSets;
+
+        VkDescriptorPoolCreateInfo createInfo = {};
+        createInfo.sType                      = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        createInfo.maxSets                    = numDescriptorSets;
+        createInfo.poolSizeCount              = 1;
+        createInfo.pPoolSizes                 = &poolSize;
+
+        if (vkCreateDescriptorPool(device, &createInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+            throw std::runtime_error("Unable to create descriptor pool!");
+        }
+    }
+
+    void createDescriptorSets(VkDevice device, uint32_t numDescriptorSets) {
+        std::vector<VkDescriptorSetLayout> layouts(numDescriptorSets, descriptorSetLayout.layout);
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool     = descriptorPool;
+        allocInfo.descriptorSetCount = numDescriptorSets;
+        allocInfo.pSetLayouts        = layouts.data();
+
+        descriptorSets.resize(numDescriptorSets);
+        if (vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data()) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate descriptor sets!");
+        }
+
+        for (size_t i = 0; i < numDescriptorSets; i++) {
+            VkDescriptorBufferInfo bufferInfo{};
+            bufferInfo.buffer = storageInfo.uniformBuffers[i];
+            bufferInfo.offset = 0;
+            bufferInfo.range  = bufferSize();
+
+            VkWriteDescriptorSet descriptorWrite{};
+            descriptorWrite.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrite.dstSet          = descriptorSets[i];
+            descriptorWrite.dstBinding      = 0;
+            descriptorWrite.dstArrayElement = 0;
+            descriptorWrite.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptorWrite.descriptorCount = 1;
+            descriptorWrite.pBufferInfo     = &bufferInfo;
+
+            vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+        }
+    }
+
+    void destroyResources(VkDevice device, DeviceAllocator &allocator) {
+        storageInfo.destroy(device, allocator);
         vkDestroyDescriptorPool(device, descriptorPool, nullptr);
         descriptorSetLayout.destroy();
     }
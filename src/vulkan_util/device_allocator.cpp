@@ -0,0 +1,264 @@
+#include "device_allocator.h"
+
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+
+void DeviceAllocator::init(VkPhysicalDevice physicalDevice, VkDevice inDevice) {
+    device = inDevice;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+    pools.clear();
+    pools.resize(2 * memoryProperties.memoryTypeCount);
+
+    constexpr VkMemoryPropertyFlags direct = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT |
+                                             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                             VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    directMemoryType           = std::nullopt;
+    VkDeviceSize directHeapSize = 0;
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+        const VkMemoryType &type    = memoryProperties.memoryTypes[i];
+        const VkDeviceSize heapSize = memoryProperties.memoryHeaps[type.heapIndex].size;
+        if ((type.propertyFlags & direct) == direct && heapSize >= MIN_HOST_VISIBLE_HEAP_SIZE &&
+            heapSize > directHeapSize) {
+            directMemoryType = i;
+            directHeapSize   = heapSize;
+        }
+    }
+}
+
+void DeviceAllocator::destroy() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (Pool &pool : pools) {
+        for (Block &block : pool.blocks) {
+            if (block.memory == VK_NULL_HANDLE) {
+                continue;
+            }
+            if (block.used > 0) {
+                std::cerr << "Device memory block freed with " << block.used << " bytes still allocated." << std::endl;
+            }
+            destroyBlock(block);
+        }
+    }
+    pools.clear();
+}
+
+DeviceAllocation DeviceAllocator::allocate(const VkMemoryRequirements &requirements,
+                                           VkMemoryPropertyFlags properties, bool image) {
+    return allocateFromType(requirements, findMemoryType(requirements.memoryTypeBits, properties), image);
+}
+
+DeviceAllocation DeviceAllocator::allocateFromType(const VkMemoryRequirements &requirements, uint32_t memoryType,
+                                                   bool image) {
+    const uint32_t poolIndex = 2 * memoryType + (image ? 1 : 0);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    Pool &pool = pools[poolIndex];
+
+    uint32_t blockIndex                = 0;
+    std::optional<VkDeviceSize> offset = std::nullopt;
+    if (requirements.size > BLOCK_SIZE / 2) {
+        blockIndex = createBlock(pool, memoryType, requirements.size, true);
+        offset     = pool.blocks[blockIndex].take(requirements.size, requirements.alignment);
+    } else {
+        for (uint32_t i = 0; i < pool.blocks.size() && !offset.has_value(); ++i) {
+            Block &block = pool.blocks[i];
+            if (block.memory != VK_NULL_HANDLE && !block.dedicated) {
+                blockIndex = i;
+                offset     = block.take(requirements.size, requirements.alignment);
+            }
+        }
+        if (!offset.has_value()) {
+            blockIndex = createBlock(pool, memoryType, BLOCK_SIZE, false);
+            offset     = pool.blocks[blockIndex].take(requirements.size, requirements.alignment);
+        }
+    }
+
+    Block &block = pool.blocks[blockIndex];
+    block.used += requirements.size;
+
+    DeviceAllocation allocation;
+    allocation.memory = block.memory;
+    allocation.offset = *offset;
+    allocation.size   = requirements.size;
+    allocation.mapped = block.mapped != nullptr ? block.mapped + *offset : nullptr;
+    allocation.pool   = poolIndex;
+    allocation.block  = blockIndex;
+    return allocation;
+}
+
+void DeviceAllocator::free(DeviceAllocation &allocation) {
+    if (allocation.memory == VK_NULL_HANDLE) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    Block &block = pools[allocation.pool].blocks[allocation.block];
+    block.give(allocation.offset, allocation.size);
+    block.used -= allocation.size;
+    if (block.dedicated) {
+        destroyBlock(block);
+    }
+    allocation = {};
+}
+
+DeviceAllocation DeviceAllocator::bindBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties) {
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(device, buffer, &requirements);
+
+    DeviceAllocation allocation = allocate(requirements, properties);
+    vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset);
+    return allocation;
+}
+
+DeviceAllocation DeviceAllocator::bindDeviceBuffer(VkBuffer buffer) {
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(device, buffer, &requirements);
+
+    const bool direct = directMemoryType.has_value() && (requirements.memoryTypeBits & (1u << *directMemoryType));
+    const uint32_t memoryType =
+        direct ? *directMemoryType : findMemoryType(requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    DeviceAllocation allocation = allocateFromType(requirements, memoryType, false);
+    vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset);
+    return allocation;
+}
+
+DeviceAllocation DeviceAllocator::bindImage(VkImage image, VkMemoryPropertyFlags properties) {
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(device, image, &requirements);
+
+    DeviceAllocation allocation = allocate(requirements, properties, true);
+    vkBindImageMemory(device, image, allocation.memory, allocation.offset);
+    return allocation;
+}
+
+std::vector<DeviceAllocator::PoolStats> DeviceAllocator::stats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<PoolStats> result;
+    for (uint32_t i = 0; i < pools.size(); ++i) {
+        PoolStats poolStats{i / 2, i % 2 == 1, 0, 0, 0, 0};
+        for (const Block &block : pools[i].blocks) {
+            if (block.memory == VK_NULL_HANDLE) {
+                continue;
+            }
+            poolStats.blocks++;
+            poolStats.blockBytes += block.size;
+            poolStats.usedBytes += block.used;
+            poolStats.largestFreeRange = std::max(poolStats.largestFreeRange, block.largestFreeRange());
+        }
+        if (poolStats.blocks > 0) {
+            result.push_back(poolStats);
+        }
+    }
+    return result;
+}
+
+void DeviceAllocator::trim() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (Pool &pool : pools) {
+        for (Block &block : pool.blocks) {
+            if (block.memory != VK_NULL_HANDLE && block.used == 0) {
+                destroyBlock(block);
+            }
+        }
+    }
+}
+
+uint32_t DeviceAllocator::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const {
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+        if ((typeFilter & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+            return i;
+        }
+    }
+    throw std::runtime_error("failed to find suitable memory type!");
+}
+
+uint32_t DeviceAllocator::createBlock(Pool &pool, uint32_t memoryType, VkDeviceSize size, bool dedicated) {
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize  = size;
+    allocInfo.memoryTypeIndex = memoryType;
+
+    Block block;
+    block.size      = size;
+    block.dedicated = dedicated;
+    if (vkAllocateMemory(device, &allocInfo, nullptr, &block.memory) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate device memory block!");
+    }
+
+    if (memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        void *data = nullptr;
+        if (vkMapMemory(device, block.memory, 0, VK_WHOLE_SIZE, 0, &data) != VK_SUCCESS) {
+            throw std::runtime_error("failed to map device memory block!");
+        }
+        block.mapped = static_cast<std::byte *>(data);
+    }
+    block.give(0, size);
+
+    auto emptySlot = std::find_if(pool.blocks.begin(), pool.blocks.end(),
+                                  [](const Block &slot) { return slot.memory == VK_NULL_HANDLE; });
+    if (emptySlot != pool.blocks.end()) {
+        *emptySlot = std::move(block);
+        return static_cast<uint32_t>(emptySlot - pool.blocks.begin());
+    }
+    pool.blocks.push_back(std::move(block));
+    return static_cast<uint32_t>(pool.blocks.size() - 1);
+}
+
+void DeviceAllocator::destroyBlock(Block &block) {
+    // Freeing memory also unmaps it.
+    vkFreeMemory(device, block.memory, nullptr);
+    block = {};
+}
+
+// Block free lists.
+
+std::optional<VkDeviceSize> DeviceAllocator::Block::take(VkDeviceSize allocSize, VkDeviceSize alignment) {
+    // The smallest free range that fits, counting alignment padding.
+    for (auto it = freeBySize.lower_bound({allocSize, 0}); it != freeBySize.end(); ++it) {
+        const auto [rangeSize, rangeOffset] = *it;
+        const VkDeviceSize offset           = (rangeOffset + alignment - 1) / alignment * alignment;
+        if (offset + allocSize > rangeOffset + rangeSize) {
+            continue;
+        }
+
+        freeBySize.erase(it);
+        freeRanges.erase(rangeOffset);
+        if (offset > rangeOffset) {
+            freeRanges[rangeOffset] = offset - rangeOffset;
+            freeBySize.insert({offset - rangeOffset, rangeOffset});
+        }
+        const VkDeviceSize end = offset + allocSize;
+        if (end < rangeOffset + rangeSize) {
+            freeRanges[end] = rangeOffset + rangeSize - end;
+            freeBySize.insert({rangeOffset + rangeSize - end, end});
+        }
+        return offset;
+    }
+    return std::nullopt;
+}
+
+void DeviceAllocator::Block::give(VkDeviceSize offset, VkDeviceSize rangeSize) {
+    auto next = freeRanges.lower_bound(offset);
+    if (next != freeRanges.end() && offset + rangeSize == next->first) {
+        rangeSize += next->second;
+        freeBySize.erase({next->second, next->first});
+        next = freeRanges.erase(next);
+    }
+    if (next != freeRanges.begin()) {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == offset) {
+            offset = prev->first;
+            rangeSize += prev->second;
+            freeBySize.erase({prev->second, prev->first});
+            freeRanges.erase(prev);
+        }
+    }
+    freeRanges[offset] = rangeSize;
+    freeBySize.insert({rangeSize, offset});
+}
+
+VkDeviceSize DeviceAllocator::Block::largestFreeRange() const {
+    return freeBySize.empty() ? 0 : freeBySize.rbegin()->first;
+}
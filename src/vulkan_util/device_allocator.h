@@ -0,0 +1,132 @@
+#ifndef DEVICE_ALLOCATOR_H_
+#define DEVICE_ALLOCATOR_H_
+
+#include <vulkan/vulkan.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <utility>
+#include <vector>
+
+// A range of device memory handed out by DeviceAllocator.
+struct DeviceAllocation {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset   = 0;
+    VkDeviceSize size     = 0;
+    // Host address of the range if its memory is host visible.
+    void *mapped = nullptr;
+
+    // Where the range came from, for DeviceAllocator::free.
+    uint32_t pool  = 0;
+    uint32_t block = 0;
+};
+
+// Sub-allocates buffers and images from large device memory blocks, so the
+// number of vkAllocateMemory calls stays far below maxMemoryAllocationCount
+// however many meshes are resident.
+//
+// Each memory type has two pools of blocks, one for buffers and one for
+// optimally tiled images, so neighbors never need bufferImageGranularity
+// padding. Ranges are placed best fit, and freed ranges merge with free
+// neighbors. Requests larger than half a block get a dedicated block.
+// Host-visible blocks stay mapped while they exist.
+//
+// All methods may be called from any thread.
+class DeviceAllocator {
+public:
+    // Free space and use of each pool, for deciding when to compact.
+    struct PoolStats {
+        uint32_t memoryType;
+        bool images;
+        uint32_t blocks;
+        VkDeviceSize blockBytes;
+        VkDeviceSize usedBytes;
+        VkDeviceSize largestFreeRange;
+    };
+
+public:
+    DeviceAllocator() = default;
+
+    DeviceAllocator(const DeviceAllocator &)            = delete;
+    DeviceAllocator &operator=(const DeviceAllocator &) = delete;
+
+    void init(VkPhysicalDevice physicalDevice, VkDevice device);
+    // Frees all blocks; allocations still in use are reported.
+    void destroy();
+
+    DeviceAllocation allocate(const VkMemoryRequirements &requirements, VkMemoryPropertyFlags properties,
+                              bool image = false);
+    // Resets allocation; freeing an empty allocation does nothing.
+    void free(DeviceAllocation &allocation);
+
+    // True if some device-local memory is also host visible, in a heap
+    // large enough for meshes: on integrated GPUs, with resizable BAR, and
+    // on software drivers. Buffers there can be written without staging.
+    bool hasHostVisibleDeviceLocal() const {
+        return directMemoryType.has_value();
+    }
+
+    // Allocate memory for the resource and bind it.
+    DeviceAllocation bindBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties);
+    DeviceAllocation bindImage(VkImage image, VkMemoryPropertyFlags properties);
+    // Binds device-local memory, from the host-visible type found by init
+    // if there is one and buffer can use it, so the allocation is mapped.
+    DeviceAllocation bindDeviceBuffer(VkBuffer buffer);
+
+    // Hooks for defragmentation: stats shows which pools are fragmented, and
+    // trim returns empty blocks to the driver once their ranges have moved.
+    std::vector<PoolStats> stats();
+    void trim();
+
+private:
+    // Blocks are allocated at this size unless a request needs more.
+    static constexpr VkDeviceSize BLOCK_SIZE = 64 * 1024 * 1024;
+    // Without resizable BAR, discrete GPUs expose only a small window of
+    // device memory to the host, which is no place for meshes.
+    static constexpr VkDeviceSize MIN_HOST_VISIBLE_HEAP_SIZE = 512 * 1024 * 1024;
+
+    struct Block {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize size     = 0;
+        std::byte *mapped     = nullptr;
+        bool dedicated        = false;
+        VkDeviceSize used     = 0;
+
+        // Free ranges as offset -> size, for merging with neighbors, and
+        // as (size, offset), for best-fit lookup.
+        std::map<VkDeviceSize, VkDeviceSize> freeRanges;
+        std::set<std::pair<VkDeviceSize, VkDeviceSize>> freeBySize;
+
+        std::optional<VkDeviceSize> take(VkDeviceSize size, VkDeviceSize alignment);
+        void give(VkDeviceSize offset, VkDeviceSize size);
+        VkDeviceSize largestFreeRange() const;
+    };
+
+    struct Pool {
+        // Emptied slots have no memory and are reused by later blocks.
+        std::vector<Block> blocks;
+    };
+
+    DeviceAllocation allocateFromType(const VkMemoryRequirements &requirements, uint32_t memoryType, bool image);
+    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+    uint32_t createBlock(Pool &pool, uint32_t memoryType, VkDeviceSize size, bool dedicated);
+    void destroyBlock(Block &block);
+
+private:
+    VkDevice device = VK_NULL_HANDLE;
+    VkPhysicalDeviceMemoryProperties memoryProperties{};
+    // Host-visible device-local type in the largest heap that qualifies;
+    // see hasHostVisibleDeviceLocal. Not necessarily the first such type,
+    // which on discrete GPUs is usually in the small BAR window.
+    std::optional<uint32_t> directMemoryType = std::nullopt;
+
+    std::mutex mutex;
+    // Indexed by 2 * memory type, plus 1 for images.
+    std::vector<Pool> pools;
+};
+
+#endif // DEVICE_ALLOCATOR_H_
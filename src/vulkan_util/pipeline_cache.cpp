@@ -0,0 +1,107 @@
+#include "pipeline_cache.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+
+void PipelineCache::init(VkPhysicalDevice physicalDevice, VkDevice inDevice) {
+    device = inDevice;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    filePath = cacheFile(properties);
+
+    std::vector<char> data;
+    std::ifstream file(filePath, std::ios::ate | std::ios::binary);
+    if (file.is_open()) {
+        data.resize(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        file.read(data.data(), static_cast<std::streamsize>(data.size()));
+        if (!file || !matchesDevice(data, properties)) {
+            std::cerr << "Ignoring stale pipeline cache " << filePath << "." << std::endl;
+            data.clear();
+        }
+    }
+
+    VkPipelineCacheCreateInfo createInfo{};
+    createInfo.sType           = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    createInfo.initialDataSize = data.size();
+    createInfo.pInitialData    = data.empty() ? nullptr : data.data();
+
+    if (vkCreatePipelineCache(device, &createInfo, nullptr, &cache) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create pipeline cache!");
+    }
+}
+
+void PipelineCache::destroy() {
+    if (cache == VK_NULL_HANDLE) {
+        return;
+    }
+    save();
+    vkDestroyPipelineCache(device, cache, nullptr);
+    cache = VK_NULL_HANDLE;
+}
+
+void PipelineCache::save() {
+    size_t size = 0;
+    if (vkGetPipelineCacheData(device, cache, &size, nullptr) != VK_SUCCESS || size == 0) {
+        return;
+    }
+    std::vector<char> data(size);
+    if (vkGetPipelineCacheData(device, cache, &size, data.data()) != VK_SUCCESS) {
+        return;
+    }
+
+    // Written aside and renamed, so a crash mid-write never leaves a
+    // truncated cache for the next run.
+    std::error_code error;
+    std::filesystem::create_directories(filePath.parent_path(), error);
+    std::filesystem::path tempPath = filePath;
+    tempPath += ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        file.write(data.data(), static_cast<std::streamsize>(size));
+        if (!file) {
+            std::cerr << "Unable to write pipeline cache " << tempPath << "." << std::endl;
+            return;
+        }
+    }
+    std::filesystem::rename(tempPath, filePath, error);
+    if (error) {
+        std::cerr << "Unable to save pipeline cache: " << error.message() << std::endl;
+    }
+}
+
+std::filesystem::path PipelineCache::cacheDirectory() {
+    if (const char *cacheHome = std::getenv("XDG_CACHE_HOME"); cacheHome != nullptr && *cacheHome != '\0') {
+        return std::filesystem::path(cacheHome) / "vulkan_grapher";
+    }
+    if (const char *home = std::getenv("HOME"); home != nullptr && *home != '\0') {
+        return std::filesystem::path(home) / ".cache" / "vulkan_grapher";
+    }
+    return std::filesystem::current_path();
+}
+
+std::filesystem::path PipelineCache::cacheFile(const VkPhysicalDeviceProperties &properties) {
+    std::ostringstream name;
+    name << "pipeline_cache_" << std::hex << std::setfill('0') << std::setw(4) << properties.vendorID << "_"
+         << std::setw(4) << properties.deviceID << ".bin";
+    return cacheDirectory() / name.str();
+}
+
+bool PipelineCache::matchesDevice(const std::vector<char> &data, const VkPhysicalDeviceProperties &properties) {
+    VkPipelineCacheHeaderVersionOne header;
+    if (data.size() < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, data.data(), sizeof(header));
+
+    return header.headerSize >= sizeof(header) && header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+           header.vendorID == properties.vendorID && header.deviceID == properties.deviceID &&
+           memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
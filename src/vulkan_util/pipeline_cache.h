@@ -0,0 +1,47 @@
+#ifndef PIPELINE_CACHE_H_
+#define PIPELINE_CACHE_H_
+
+#include <vulkan/vulkan.h>
+
+#include <filesystem>
+#include <vector>
+
+// A VkPipelineCache kept in a per-device file between runs, so pipelines
+// compiled once are loaded rather than compiled on later startups.
+//
+// Saved data is only passed to the driver if its header names this
+// device and driver build: drivers may reject foreign data, and some
+// misbehave on it. Failing to read or write the file is not an error; the
+// cache just starts empty.
+//
+// The cache is internally synchronized, so pipelines may be created with
+// it from several threads at once.
+class PipelineCache {
+public:
+    PipelineCache() = default;
+
+    PipelineCache(const PipelineCache &)            = delete;
+    PipelineCache &operator=(const PipelineCache &) = delete;
+
+    void init(VkPhysicalDevice physicalDevice, VkDevice device);
+    // Saves the cache to its file, then destroys it.
+    void destroy();
+
+    VkPipelineCache handle() const {
+        return cache;
+    }
+
+private:
+    static std::filesystem::path cacheDirectory();
+    static std::filesystem::path cacheFile(const VkPhysicalDeviceProperties &properties);
+    static bool matchesDevice(const std::vector<char> &data, const VkPhysicalDeviceProperties &properties);
+
+    void save();
+
+private:
+    VkDevice device       = VK_NULL_HANDLE;
+    VkPipelineCache cache = VK_NULL_HANDLE;
+    std::filesystem::path filePath;
+};
+
+#endif // PIPELINE_CACHE_H_
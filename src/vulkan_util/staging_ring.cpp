@@ -0,0 +1,83 @@
+#include "staging_ring.h"
+
+#include <stdexcept>
+
+void StagingRing::init(VkDevice inDevice, DeviceAllocator &inAllocator, VkDeviceSize capacity) {
+    device    = inDevice;
+    allocator = &inAllocator;
+    size      = capacity;
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size        = size;
+    bufferInfo.usage       = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateBuffer(device, &bufferInfo, nullptr, &stagingBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create staging ring buffer!");
+    }
+    // Host-visible memory stays mapped; see DeviceAllocator.
+    stagingAllocation = allocator->bindBuffer(
+        stagingBuffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    mappedData = static_cast<std::byte *>(stagingAllocation.mapped);
+
+    allocations.clear();
+    head = 0;
+}
+
+void StagingRing::destroy() {
+    if (device == VK_NULL_HANDLE) {
+        return;
+    }
+    vkDestroyBuffer(device, stagingBuffer, nullptr);
+    allocator->free(stagingAllocation);
+    mappedData = nullptr;
+    device     = VK_NULL_HANDLE;
+}
+
+std::optional<VkDeviceSize> StagingRing::allocate(VkDeviceSize allocSize, uint64_t timelineValue) {
+    allocSize = (allocSize + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    if (allocSize > size) {
+        return std::nullopt;
+    }
+
+    if (allocations.empty()) {
+        head = 0;
+    }
+    const VkDeviceSize tail = allocations.empty() ? 0 : allocations.front().begin;
+
+    VkDeviceSize offset = 0;
+    if (allocations.empty() || head > tail) {
+        // Free space runs from head to the end, then from the start to tail.
+        if (size - head >= allocSize) {
+            offset = head;
+        } else if (tail >= allocSize) {
+            offset = 0;
+        } else {
+            return std::nullopt;
+        }
+    } else if (head < tail && tail - head >= allocSize) {
+        // Wrapped around; free space runs from head to tail.
+        offset = head;
+    } else {
+        return std::nullopt;
+    }
+
+    allocations.push_back({offset, timelineValue, head});
+    head = offset + allocSize;
+    return offset;
+}
+
+void StagingRing::reclaim(uint64_t completedValue) {
+    while (!allocations.empty() && allocations.front().timelineValue <= completedValue) {
+        allocations.pop_front();
+    }
+}
+
+void StagingRing::release(uint64_t timelineValue) {
+    if (allocations.empty() || allocations.back().timelineValue != timelineValue) {
+        return;
+    }
+    head = allocations.back().previousHead;
+    allocations.pop_back();
+}
@@ -0,0 +1,84 @@
+#ifndef STAGING_RING_H_
+#define STAGING_RING_H_
+
+#include "device_allocator.h"
+
+#include <vulkan/vulkan.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+
+// A persistently mapped host-visible buffer that upload data is staged in.
+//
+// Space is handed out front to back and wraps around. Each allocation is
+// tagged with the timeline value of the submission that reads it, and is
+// reused once reclaim is given a completed value at least that large, so
+// staging costs a memcpy rather than an allocation and a mapping.
+//
+// Not thread safe; TransferQueue serializes access.
+class StagingRing {
+public:
+    StagingRing() = default;
+
+    StagingRing(const StagingRing &)            = delete;
+    StagingRing &operator=(const StagingRing &) = delete;
+
+    void init(VkDevice device, DeviceAllocator &allocator, VkDeviceSize capacity);
+    void destroy();
+
+    // Returns the offset of size bytes of space, or nullopt if not enough
+    // space is free; uploads larger than capacity never fit.
+    std::optional<VkDeviceSize> allocate(VkDeviceSize size, uint64_t timelineValue);
+
+    // Frees allocations whose submissions have completed.
+    void reclaim(uint64_t completedValue);
+
+    // Frees the newest allocation if it is tagged with timelineValue, for
+    // a submission that failed and so will never complete.
+    void release(uint64_t timelineValue);
+
+    // Timeline value to wait for to free the oldest allocation, or 0 if
+    // nothing is allocated.
+    uint64_t oldestValue() const {
+        return allocations.empty() ? 0 : allocations.front().timelineValue;
+    }
+
+    VkDeviceSize capacity() const {
+        return size;
+    }
+    VkBuffer buffer() const {
+        return stagingBuffer;
+    }
+    std::byte *mapped(VkDeviceSize offset) const {
+        return mappedData + offset;
+    }
+
+private:
+    // Allocations start at multiples of this, which satisfies the
+    // alignment of any element type copied through the ring.
+    static constexpr VkDeviceSize ALIGNMENT = 16;
+
+    struct Allocation {
+        VkDeviceSize begin;
+        uint64_t timelineValue;
+        // Where head was before this allocation, for release.
+        VkDeviceSize previousHead;
+    };
+
+private:
+    VkDevice device            = VK_NULL_HANDLE;
+    DeviceAllocator *allocator = nullptr;
+
+    VkBuffer stagingBuffer = VK_NULL_HANDLE;
+    DeviceAllocation stagingAllocation;
+    std::byte *mappedData = nullptr;
+    VkDeviceSize size     = 0;
+
+    // Allocations in use, oldest first; new space is taken after the last.
+    std::deque<Allocation> allocations;
+    VkDeviceSize head = 0;
+};
+
+#endif // STAGING_RING_H_
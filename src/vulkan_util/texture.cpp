@@ -0,0 +1,85 @@
+#include "texture.h"
+
+#include <stdexcept>
+#include <utility>
+
+Texture2D::Texture2D(Texture2D &&other) noexcept
+    : device(other.device),
+      transfer(other.transfer),
+      image(std::exchange(other.image, VK_NULL_HANDLE)),
+      allocation(std::exchange(other.allocation, {})),
+      view(std::exchange(other.view, VK_NULL_HANDLE)),
+      sampler(std::exchange(other.sampler, VK_NULL_HANDLE)),
+      format(other.format),
+      extentWidth(other.extentWidth),
+      extentHeight(other.extentHeight) {
+}
+
+Texture2D &Texture2D::operator=(Texture2D &&other) noexcept {
+    if (this != &other) {
+        device       = other.device;
+        transfer     = other.transfer;
+        image        = std::exchange(other.image, VK_NULL_HANDLE);
+        allocation   = std::exchange(other.allocation, {});
+        view         = std::exchange(other.view, VK_NULL_HANDLE);
+        sampler      = std::exchange(other.sampler, VK_NULL_HANDLE);
+        format       = other.format;
+        extentWidth  = other.extentWidth;
+        extentHeight = other.extentHeight;
+    }
+    return *this;
+}
+
+void Texture2D::create(VkDevice inDevice, TransferQueue &inTransfer, uint32_t width, uint32_t height,
+                       VkFormat inFormat, VkFilter filter) {
+    device       = inDevice;
+    transfer     = &inTransfer;
+    format       = inFormat;
+    extentWidth  = width;
+    extentHeight = height;
+
+    transfer->createDeviceImage(width, height, format, VK_IMAGE_USAGE_SAMPLED_BIT, image, allocation);
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType                       = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image                       = image;
+    viewInfo.viewType                    = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format                      = format;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.layerCount = 1;
+
+    if (vkCreateImageView(device, &viewInfo, nullptr, &view) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create texture image view!");
+    }
+
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType        = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter    = filter;
+    samplerInfo.minFilter    = filter;
+    samplerInfo.mipmapMode   = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.maxLod       = 0.0f;
+
+    if (vkCreateSampler(device, &samplerInfo, nullptr, &sampler) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create texture sampler!");
+    }
+}
+
+void Texture2D::destroy() {
+    if (!created()) {
+        return;
+    }
+    vkDestroySampler(device, sampler, nullptr);
+    vkDestroyImageView(device, view, nullptr);
+    transfer->destroyDeviceImage(image, allocation);
+    image   = VK_NULL_HANDLE;
+    view    = VK_NULL_HANDLE;
+    sampler = VK_NULL_HANDLE;
+}
+
+uint64_t Texture2D::upload(const void *data, VkDeviceSize size) {
+    return transfer->uploadImage(image, extentWidth, extentHeight, data, size);
+}
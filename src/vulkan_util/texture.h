@@ -0,0 +1,63 @@
+#ifndef TEXTURE_H_
+#define TEXTURE_H_
+
+#include "device_allocator.h"
+#include "transfer_queue.h"
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+
+// A sampled 2D texture with one mip level, filled through a TransferQueue,
+// with its view and a clamp-to-edge sampler.
+//
+// Move-only. The texture must be destroyed explicitly, once no frames or
+// copies in flight use it.
+class Texture2D {
+public:
+    Texture2D() = default;
+
+    Texture2D(Texture2D &&other) noexcept;
+    Texture2D &operator=(Texture2D &&other) noexcept;
+
+    Texture2D(const Texture2D &)            = delete;
+    Texture2D &operator=(const Texture2D &) = delete;
+
+    void create(VkDevice device, TransferQueue &transfer, uint32_t width, uint32_t height, VkFormat format,
+                VkFilter filter = VK_FILTER_LINEAR);
+    void destroy();
+
+    // Replaces the whole image with tightly packed texels; see
+    // TransferQueue::uploadImage. Returns the transfer timeline value at
+    // which the copy has completed.
+    uint64_t upload(const void *data, VkDeviceSize size);
+
+    bool created() const {
+        return image != VK_NULL_HANDLE;
+    }
+    uint32_t width() const {
+        return extentWidth;
+    }
+    uint32_t height() const {
+        return extentHeight;
+    }
+
+    // For combined image sampler descriptors.
+    VkDescriptorImageInfo descriptorInfo() const {
+        return {sampler, view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    }
+
+private:
+    VkDevice device         = VK_NULL_HANDLE;
+    TransferQueue *transfer = nullptr;
+
+    VkImage image = VK_NULL_HANDLE;
+    DeviceAllocation allocation;
+    VkImageView view      = VK_NULL_HANDLE;
+    VkSampler sampler     = VK_NULL_HANDLE;
+    VkFormat format       = VK_FORMAT_UNDEFINED;
+    uint32_t extentWidth  = 0;
+    uint32_t extentHeight = 0;
+};
+
+#endif // TEXTURE_H_
@@ -0,0 +1,336 @@
+#include "transfer_queue.h"
+
+#include <cstring>
+#include <stdexcept>
+
+void TransferQueue::init(VkDevice inDevice, DeviceAllocator &inAllocator, VkQueue inQueue, uint32_t queueFamilyIndex,
+                         uint32_t graphicsFamilyIndex, std::mutex &inQueueMutex) {
+    device     = inDevice;
+    allocator  = &inAllocator;
+    queue      = inQueue;
+    queueMutex = &inQueueMutex;
+
+    sharingFamilies = {graphicsFamilyIndex};
+    if (queueFamilyIndex != graphicsFamilyIndex) {
+        sharingFamilies.push_back(queueFamilyIndex);
+    }
+
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags            = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    poolInfo.queueFamilyIndex = queueFamilyIndex;
+
+    if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create transfer command pool!");
+    }
+
+    VkSemaphoreTypeCreateInfo typeInfo{};
+    typeInfo.sType         = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    typeInfo.initialValue  = 0;
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreInfo.pNext = &typeInfo;
+
+    if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &timeline) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create transfer timeline semaphore!");
+    }
+    lastSubmitted = 0;
+
+    stagingRing.init(device, *allocator, STAGING_RING_SIZE);
+}
+
+void TransferQueue::destroy() {
+    if (device == VK_NULL_HANDLE) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    reclaim(true);
+    stagingRing.destroy();
+    vkDestroySemaphore(device, timeline, nullptr);
+    // Frees the recycled command buffers too.
+    vkDestroyCommandPool(device, commandPool, nullptr);
+    freeCommandBuffers.clear();
+    device = VK_NULL_HANDLE;
+}
+
+void TransferQueue::createDeviceBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer &buffer,
+                                       DeviceAllocation &allocation) {
+    // Not bindBuffer with host-visible flags, whose first matching type may
+    // be a heap too small for meshes.
+    createUnboundBuffer(size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, buffer);
+    allocation = allocator->bindDeviceBuffer(buffer);
+}
+
+void TransferQueue::destroyDeviceBuffer(VkBuffer buffer, DeviceAllocation &allocation) {
+    vkDestroyBuffer(device, buffer, nullptr);
+    allocator->free(allocation);
+}
+
+void TransferQueue::createDeviceImage(uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage,
+                                      VkImage &image, DeviceAllocation &allocation) {
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType     = VK_IMAGE_TYPE_2D;
+    imageInfo.extent        = {width, height, 1};
+    imageInfo.mipLevels     = 1;
+    imageInfo.arrayLayers   = 1;
+    imageInfo.format        = format;
+    imageInfo.tiling        = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage         = usage | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    imageInfo.samples       = VK_SAMPLE_COUNT_1_BIT;
+    if (sharingFamilies.size() > 1) {
+        imageInfo.sharingMode           = VK_SHARING_MODE_CONCURRENT;
+        imageInfo.queueFamilyIndexCount = static_cast<uint32_t>(sharingFamilies.size());
+        imageInfo.pQueueFamilyIndices   = sharingFamilies.data();
+    } else {
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    }
+
+    if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create image!");
+    }
+
+    allocation = allocator->bindImage(image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+}
+
+void TransferQueue::destroyDeviceImage(VkImage image, DeviceAllocation &allocation) {
+    vkDestroyImage(device, image, nullptr);
+    allocator->free(allocation);
+}
+
+uint64_t TransferQueue::upload(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void *data, VkDeviceSize size) {
+    std::lock_guard<std::mutex> lock(mutex);
+    reclaim(false);
+
+    PendingUpload pending{};
+    pending.timelineValue = lastSubmitted + 1;
+    pending.commandBuffer = takeCommandBuffer();
+
+    auto [srcBuffer, srcOffset] = stageData(data, size, pending);
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(pending.commandBuffer, &beginInfo);
+
+    VkBufferCopy copyRegion{};
+    copyRegion.srcOffset = srcOffset;
+    copyRegion.dstOffset = dstOffset;
+    copyRegion.size      = size;
+    vkCmdCopyBuffer(pending.commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+
+    return submit(pending);
+}
+
+uint64_t TransferQueue::uploadImage(VkImage dstImage, uint32_t width, uint32_t height, const void *data,
+                                    VkDeviceSize size) {
+    std::lock_guard<std::mutex> lock(mutex);
+    reclaim(false);
+
+    PendingUpload pending{};
+    pending.timelineValue = lastSubmitted + 1;
+    pending.commandBuffer = takeCommandBuffer();
+
+    auto [srcBuffer, srcOffset] = stageData(data, size, pending);
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(pending.commandBuffer, &beginInfo);
+
+    VkImageMemoryBarrier barrier{};
+    barrier.sType                       = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask               = 0;
+    barrier.dstAccessMask               = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.oldLayout                   = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout                   = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex         = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex         = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image                       = dstImage;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.layerCount = 1;
+    vkCmdPipelineBarrier(pending.commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0,
+                         nullptr, 0, nullptr, 1, &barrier);
+
+    VkBufferImageCopy copyRegion{};
+    copyRegion.bufferOffset                = srcOffset;
+    copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    copyRegion.imageSubresource.layerCount = 1;
+    copyRegion.imageExtent                 = {width, height, 1};
+    vkCmdCopyBufferToImage(pending.commandBuffer, srcBuffer, dstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
+                           &copyRegion);
+
+    // The transfer queue may not support shader stages; frames that sample
+    // the image wait on the timeline, which makes the copy visible to them.
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = 0;
+    barrier.oldLayout     = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout     = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    vkCmdPipelineBarrier(pending.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                         0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    return submit(pending);
+}
+
+uint64_t TransferQueue::submit(PendingUpload &pending) {
+    vkEndCommandBuffer(pending.commandBuffer);
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType                     = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues    = &pending.timelineValue;
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext                = &timelineInfo;
+    submitInfo.commandBufferCount   = 1;
+    submitInfo.pCommandBuffers      = &pending.commandBuffer;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores    = &timeline;
+
+    VkResult result = VK_SUCCESS;
+    {
+        std::lock_guard<std::mutex> queueLock(*queueMutex);
+        result = vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
+    }
+
+    if (result != VK_SUCCESS) {
+        // Nothing will signal the upload's timeline value, so reclaim never
+        // would free its resources, and waiting for it would never return.
+        freeCommandBuffers.push_back(pending.commandBuffer);
+        if (pending.stagingBuffer != VK_NULL_HANDLE) {
+            vkDestroyBuffer(device, pending.stagingBuffer, nullptr);
+            allocator->free(pending.stagingAllocation);
+        } else {
+            stagingRing.release(pending.timelineValue);
+        }
+        throw std::runtime_error("Failed to submit transfer command buffer!");
+    }
+    pendingUploads.push_back(pending);
+    lastSubmitted = pending.timelineValue;
+    return lastSubmitted;
+}
+
+uint64_t TransferQueue::write(VkBuffer dstBuffer, const DeviceAllocation &dstAllocation, VkDeviceSize dstOffset,
+                              const void *data, VkDeviceSize size) {
+    if (dstAllocation.mapped == nullptr) {
+        return upload(dstBuffer, dstOffset, data, size);
+    }
+    // Coherent memory, so the data is visible to the next queue submission.
+    memcpy(static_cast<std::byte *>(dstAllocation.mapped) + dstOffset, data, static_cast<size_t>(size));
+    return 0;
+}
+
+std::pair<VkBuffer, VkDeviceSize> TransferQueue::stageData(const void *data, VkDeviceSize size,
+                                                           PendingUpload &pending) {
+    if (size > stagingRing.capacity()) {
+        createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                     pending.stagingBuffer, pending.stagingAllocation);
+
+        memcpy(pending.stagingAllocation.mapped, data, static_cast<size_t>(size));
+        return {pending.stagingBuffer, 0};
+    }
+
+    std::optional<VkDeviceSize> offset = stagingRing.allocate(size, pending.timelineValue);
+    while (!offset.has_value()) {
+        // The ring is full of uploads still in flight.
+        wait(stagingRing.oldestValue());
+        reclaim(false);
+        offset = stagingRing.allocate(size, pending.timelineValue);
+    }
+    memcpy(stagingRing.mapped(*offset), data, static_cast<size_t>(size));
+    return {stagingRing.buffer(), *offset};
+}
+
+VkCommandBuffer TransferQueue::takeCommandBuffer() {
+    if (!freeCommandBuffers.empty()) {
+        VkCommandBuffer commandBuffer = freeCommandBuffers.back();
+        freeCommandBuffers.pop_back();
+        return commandBuffer;
+    }
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool        = commandPool;
+    allocInfo.commandBufferCount = 1;
+
+    VkCommandBuffer commandBuffer;
+    if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate transfer command buffer!");
+    }
+    return commandBuffer;
+}
+
+void TransferQueue::flush() {
+    std::lock_guard<std::mutex> lock(mutex);
+    reclaim(true);
+}
+
+bool TransferQueue::reached(uint64_t value) const {
+    uint64_t completed = 0;
+    vkGetSemaphoreCounterValue(device, timeline, &completed);
+    return completed >= value;
+}
+
+void TransferQueue::wait(uint64_t value) const {
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType          = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores    = &timeline;
+    waitInfo.pValues        = &value;
+    vkWaitSemaphores(device, &waitInfo, UINT64_MAX);
+}
+
+void TransferQueue::reclaim(bool waitAll) {
+    if (waitAll) {
+        wait(lastSubmitted);
+    }
+    uint64_t completed = 0;
+    vkGetSemaphoreCounterValue(device, timeline, &completed);
+    stagingRing.reclaim(completed);
+
+    size_t kept = 0;
+    for (PendingUpload &pending : pendingUploads) {
+        if (pending.timelineValue > completed) {
+            pendingUploads[kept++] = pending;
+            continue;
+        }
+        // Beginning the command buffer again resets it.
+        freeCommandBuffers.push_back(pending.commandBuffer);
+        if (pending.stagingBuffer != VK_NULL_HANDLE) {
+            vkDestroyBuffer(device, pending.stagingBuffer, nullptr);
+            allocator->free(pending.stagingAllocation);
+        }
+    }
+    pendingUploads.resize(kept);
+}
+
+void TransferQueue::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
+                                 VkBuffer &buffer, DeviceAllocation &allocation) {
+    createUnboundBuffer(size, usage, buffer);
+    allocation = allocator->bindBuffer(buffer, properties);
+}
+
+void TransferQueue::createUnboundBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer &buffer) {
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size  = size;
+    bufferInfo.usage = usage;
+    if (sharingFamilies.size() > 1) {
+        bufferInfo.sharingMode           = VK_SHARING_MODE_CONCURRENT;
+        bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(sharingFamilies.size());
+        bufferInfo.pQueueFamilyIndices   = sharingFamilies.data();
+    } else {
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    }
+
+    if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create buffer!");
+    }
+}
@@ -0,0 +1,129 @@
+#ifndef TRANSFER_QUEUE_H_
+#define TRANSFER_QUEUE_H_
+
+#include "device_allocator.h"
+#include "staging_ring.h"
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Copies data into device-local buffers and images, typically from a
+// background thread.
+//
+// Uploads are staged in a persistently mapped StagingRing and submitted
+// without waiting, so the caller can prepare the next upload while the copy
+// runs. Each submission signals the next value of a timeline semaphore,
+// which callers poll or wait on to know when buffers are ready. All methods
+// may be called from any thread.
+//
+// Buffers and images created here are shared between the transfer and
+// graphics queue families, so they can be used without an ownership
+// transfer.
+class TransferQueue {
+public:
+    TransferQueue() = default;
+
+    TransferQueue(const TransferQueue &)            = delete;
+    TransferQueue &operator=(const TransferQueue &) = delete;
+
+    // Submissions hold queueMutex, which other threads must also hold to
+    // submit to the same queue or to wait for the whole device to idle.
+    void init(VkDevice device, DeviceAllocator &allocator, VkQueue queue, uint32_t queueFamilyIndex,
+              uint32_t graphicsFamilyIndex, std::mutex &queueMutex);
+    // Waits for uploads in flight, then frees everything.
+    void destroy();
+
+    // Creates a device-local buffer that uploads can write to. If the
+    // allocator has host-visible device-local memory, the buffer is placed
+    // there, mapped, and write copies into it without staging.
+    void createDeviceBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer &buffer,
+                            DeviceAllocation &allocation);
+    void destroyDeviceBuffer(VkBuffer buffer, DeviceAllocation &allocation);
+
+    // Creates a device-local, optimally tiled 2D image with one mip level
+    // that uploadImage can write to.
+    void createDeviceImage(uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, VkImage &image,
+                           DeviceAllocation &allocation);
+    void destroyDeviceImage(VkImage image, DeviceAllocation &allocation);
+
+    // Copies size bytes of data to dstBuffer at dstOffset. Returns once the
+    // data is staged; the copy itself completes asynchronously, when the
+    // returned timeline value is reached.
+    uint64_t upload(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void *data, VkDeviceSize size);
+
+    // Copies tightly packed texels covering all of dstImage, which must be
+    // unused, and leaves it in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL.
+    // Completes asynchronously, like upload.
+    uint64_t uploadImage(VkImage dstImage, uint32_t width, uint32_t height, const void *data, VkDeviceSize size);
+
+    // Copies directly if dstAllocation is mapped and returns 0, which is
+    // always reached; otherwise goes through upload.
+    uint64_t write(VkBuffer dstBuffer, const DeviceAllocation &dstAllocation, VkDeviceSize dstOffset,
+                   const void *data, VkDeviceSize size);
+
+    // Waits until all submitted uploads have completed.
+    void flush();
+
+    VkSemaphore timelineSemaphore() const {
+        return timeline;
+    }
+    // True once every upload up to and including value has completed.
+    bool reached(uint64_t value) const;
+    void wait(uint64_t value) const;
+
+private:
+    // Staging space for uploads that fit in the ring; larger ones get a
+    // buffer of their own.
+    static constexpr VkDeviceSize STAGING_RING_SIZE = 32 * 1024 * 1024;
+
+    struct PendingUpload {
+        VkCommandBuffer commandBuffer;
+        uint64_t timelineValue;
+        // Only set for uploads too large for the staging ring.
+        VkBuffer stagingBuffer;
+        DeviceAllocation stagingAllocation;
+    };
+
+    // Returns staging space for size bytes, waiting for earlier uploads to
+    // free some if needed. Sets pending's own staging buffer if the data
+    // does not fit in the ring.
+    std::pair<VkBuffer, VkDeviceSize> stageData(const void *data, VkDeviceSize size, PendingUpload &pending);
+    VkCommandBuffer takeCommandBuffer();
+    // Ends pending's recorded command buffer and submits it, signaling its
+    // timeline value. Expects mutex to be held.
+    uint64_t submit(PendingUpload &pending);
+
+    // Frees uploads that have completed, or all of them if waitAll is set.
+    void reclaim(bool waitAll);
+    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
+                      VkBuffer &buffer, DeviceAllocation &allocation);
+    // Shared between the queue families that use device buffers.
+    void createUnboundBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer &buffer);
+
+private:
+    VkDevice device            = VK_NULL_HANDLE;
+    DeviceAllocator *allocator = nullptr;
+    VkQueue queue              = VK_NULL_HANDLE;
+    std::mutex *queueMutex     = nullptr;
+
+    // Distinct queue families that use the device buffers.
+    std::vector<uint32_t> sharingFamilies;
+
+    // Guards everything below.
+    std::mutex mutex;
+
+    VkCommandPool commandPool = VK_NULL_HANDLE;
+    // Command buffers of completed uploads, reused by later ones.
+    std::vector<VkCommandBuffer> freeCommandBuffers;
+    std::vector<PendingUpload> pendingUploads;
+    StagingRing stagingRing;
+
+    VkSemaphore timeline   = VK_NULL_HANDLE;
+    uint64_t lastSubmitted = 0;
+};
+
+#endif // TRANSFER_QUEUE_H_
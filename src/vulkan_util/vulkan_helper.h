@@ -51,7 +51,7 @@ public:
         return true;
     }
 
-    // These are currently unused. Methods for them exist on GlfwVulkanWrapper.
+    // For code without access to GlfwVulkanWrapper, which has its own versions.
 
     static uint32_t findMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeFilter,
                                    VkMemoryPropertyFlags properties) {
@@ -1,6 +1,8 @@
 #ifndef VULKAN_OBJECTS_H_
 #define VULKAN_OBJECTS_H_
 
+#include "device_allocator.h"
+
 #include <vulkan/vulkan.h>
 
 #include <cassert>
@@ -29,6 +31,8 @@ struct QueueFamilyIndices {
     uint32_t graphicsFamilyIndex;
     uint32_t computeFamilyIndex;
     uint32_t presentFamilyIndex;
+    // A transfer-only family if the device has one, else the graphics family.
+    uint32_t transferFamilyIndex;
 };
 
 struct DebugInfo {
@@ -53,38 +57,38 @@ struct DebugInfo {
 
 struct UniformInfo {
     std::vector<VkBuffer> uniformBuffers;
-    std::vector<VkDeviceMemory> uniformBuffersMemory;
+    std::vector<DeviceAllocation> uniformBufferAllocations;
     std::vector<void *> uniformBuffersMapped;
 
-    void destroy(VkDevice device) {
+    void destroy(VkDevice device, DeviceAllocator &allocator) {
         for (size_t i = 0; i < uniformBuffers.size(); i++) {
             vkDestroyBuffer(device, uniformBuffers[i], nullptr);
-            vkFreeMemory(device, uniformBuffersMemory[i], nullptr);
+            allocator.free(uniformBufferAllocations[i]);
         }
     }
 };
 
 struct ImageInfo {
     VkImage image;
-    VkDeviceMemory imageMemory;
+    DeviceAllocation imageAllocation;
     VkImageView imageView;
 
-    void destroy(VkDevice device) {
+    void destroy(VkDevice device, DeviceAllocator &allocator) {
         vkDestroyImageView(device, imageView, nullptr);
         vkDestroyImage(device, image, nullptr);
-        vkFreeMemory(device, imageMemory, nullptr);
+        allocator.free(imageAllocation);
     }
 };
 
 struct DescriptorSetLayout {
     DescriptorSetLayout() = default;
 
-    void init(VkDevice inDevice) {
+    void init(VkDevice inDevice, VkDescriptorType type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) {
         device = inDevice;
         VkDescriptorSetLayoutBinding uboLayoutBinding{};
         uboLayoutBinding.binding            = 0;
         uboLayoutBinding.descriptorCount    = 1;
-        uboLayoutBinding.descriptorType     = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        uboLayoutBinding.descriptorType     = type;
         uboLayoutBinding.pImmutableSamplers = nullptr;
         uboLayoutBinding.stageFlags         = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
 
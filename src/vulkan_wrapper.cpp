@@ -10,13 +10,27 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "mesh.h"
-#include "shader_util.h"
+#include "scheduler.h"
 #include "uniforms.h"
 #include "vulkan_debug.h"
 #include "vulkan_helper.h"
 
+// Generated by the build; see shaders/CMakeLists.txt.
+#include <shaders/cull_comp.h>
+#include <shaders/pbr2_frag.h>
+#include <shaders/pbr2_vert.h>
+#include <shaders/pbr_frag.h>
+#include <shaders/pbr_vert.h>
+#include <shaders/surface_tesc.h>
+#include <shaders/surface_tese.h>
+#include <shaders/surface_vert.h>
+#include <shaders/wireframe_frag.h>
+#include <shaders/wireframe_vert.h>
+
+#include <algorithm>
 #include <array>
 #include <cassert>
+#include <cstddef>
 #include <cstdint>
 
 // State management functions.
@@ -34,6 +48,9 @@ void GlfwVulkanWrapper::init(GLFWwindow *inWindow, uint32_t inWindowWidth, uint3
     pickPhysicalDevice();
     getDeviceQueueIndices();
     createLogicalDevice();
+    allocator.init(physicalDevice, device);
+    createTransferQueue();
+    geometryArena.init(transferQueue);
 
     // Create render objects from logical device.
 
@@ -41,7 +58,10 @@ void GlfwVulkanWrapper::init(GLFWwindow *inWindow, uint32_t inWindowWidth, uint3
     createImageViews();
     createRenderPass();
     initSceneUniform();
-    descriptorSetLayout.init(device);
+    initModelStorage();
+    initIndirectDraws();
+    initSurfaceDescriptors();
+    initNormalMaps();
     createGraphicsPipelines();
     createColorResources();
     createDepthResources();
@@ -59,53 +79,302 @@ void GlfwVulkanWrapper::initSceneUniform() {
     sceneUniform.createDescriptorSets(device, MAX_FRAMES_IN_FLIGHT);
 }
 
-void GlfwVulkanWrapper::initMesh(IndexedMesh &mesh) {
-    createVertexBuffer(mesh.vertices, mesh.vertexBuffer, mesh.vertexBufferMemory);
-    assert(mesh.vertexBuffer != VK_NULL_HANDLE);
-    createIndexBuffer(mesh.indices, mesh.indexBuffer, mesh.indexBufferMemory);
-    assert(mesh.indexBuffer != VK_NULL_HANDLE);
+void GlfwVulkanWrapper::initModelStorage() {
+    modelStorage.init();
 
-    createMeshUniformBuffers(mesh.uniformInfo, sizeof(ModelUniform));
-    mesh.createDescriptorSetLayout(device);
-    mesh.createDescriptorPool(device, MAX_FRAMES_IN_FLIGHT);
-    mesh.createDescriptorSets(device, MAX_FRAMES_IN_FLIGHT);
+    createMeshUniformBuffers(modelStorage.storageInfo, ModelStorage::bufferSize(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    modelStorage.createDescriptorSetLayout(device);
+    modelStorage.createDescriptorPool(device, MAX_FRAMES_IN_FLIGHT);
+    modelStorage.createDescriptorSets(device, MAX_FRAMES_IN_FLIGHT);
 }
 
-void GlfwVulkanWrapper::updateMesh(IndexedMesh &newMesh, IndexedMesh &currentMesh) {
-    waitForDeviceIdle();
-    // Destroys existing vertex and index buffers.
-    currentMesh.destroyBuffers(device);
+void GlfwVulkanWrapper::initIndirectDraws() {
+    createMeshUniformBuffers(indirectDraws.objectInfo, IndirectDraws::objectBufferSize(),
+                             VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
 
-    currentMesh.vertices = std::move(newMesh.vertices);
-    currentMesh.indices  = std::move(newMesh.indices);
+    indirectDraws.commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+    indirectDraws.commandBufferAllocations.resize(MAX_FRAMES_IN_FLIGHT);
+    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        createBuffer(IndirectDraws::commandBufferSize(),
+                     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indirectDraws.commandBuffers[i],
+                     indirectDraws.commandBufferAllocations[i]);
+    }
 
-    auto start = std::chrono::high_resolution_clock::now();
-    createVertexBuffer(currentMesh.vertices, currentMesh.vertexBuffer, currentMesh.vertexBufferMemory);
-    assert(currentMesh.vertexBuffer != VK_NULL_HANDLE);
-    createIndexBuffer(currentMesh.indices, currentMesh.indexBuffer, currentMesh.indexBufferMemory);
-    assert(currentMesh.indexBuffer != VK_NULL_HANDLE);
-    auto stop     = std::chrono::high_resolution_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start);
-    spdlog::debug("Buffer copy time: {} ms", duration.count());
+    indirectDraws.createDescriptorSetLayout(device);
+    indirectDraws.createDescriptorPool(device, MAX_FRAMES_IN_FLIGHT);
+    indirectDraws.createDescriptorSets(device, MAX_FRAMES_IN_FLIGHT, sceneUniform.uniformInfo,
+                                       modelStorage.storageInfo);
+}
 
-    // Note that the copy commands here use vkQueueWaitIdle to copy
-    // sequentially. This should be fine here, as generating the mesh
-    // should take longer than copying it to the device.
+void GlfwVulkanWrapper::initSurfaceDescriptors() {
+    if (!tessellationSupported) {
+        return;
+    }
+    surfaceDescriptors.createDescriptorSetLayout(device);
+    surfaceDescriptors.createDescriptorPool(device);
 }
 
-void GlfwVulkanWrapper::updateGraphAndFloorMeshes(std::array<IndexedMesh, 2> &newMeshData) {
-    if (graphMesh.has_value()) {
-        updateMesh(newMeshData[0], graphMesh.value());
-    } else {
-        graphMesh = std::move(newMeshData[0]);
-        initMesh(graphMesh.value());
+void GlfwVulkanWrapper::initNormalMaps() {
+    normalMapDescriptors.createDescriptorSetLayout(device);
+    normalMapDescriptors.createDescriptorPool(device);
+
+    flatNormalMap.createFlat(device, transferQueue);
+    normalMapDescriptors.allocateSet(device, flatNormalMap);
+    meshesReadyValue = std::max(meshesReadyValue, flatNormalMap.readyValue);
+}
+
+void GlfwVulkanWrapper::initMesh(IndexedMesh &mesh, MeshUpload *upload) {
+    createMeshBuffers(mesh, upload);
+
+    mesh.uniformSlot = modelStorage.acquireSlot();
+    mesh.controller.setNeedsWrite();
+}
+
+void GlfwVulkanWrapper::createMeshBuffers(IndexedMesh &mesh, MeshUpload *upload) {
+    if (upload != nullptr) {
+        // Already on the device; see MeshUpload.
+        mesh.geometry = upload->release();
+        return;
     }
-    if (floorMesh.has_value()) {
-        updateMesh(newMeshData[1], floorMesh.value());
-    } else {
+    // A graph drawn as a tessellated surface has no geometry.
+    if (mesh.vertices.empty()) {
+        return;
+    }
+
+    // This is only used for the floor mesh; function meshes are uploaded by
+    // the builder. Frames wait on the transfer timeline for the copies.
+    MeshUpload floorUpload{geometryArena, mesh.vertices.size(), mesh.indices.size()};
+    floorUpload.writeVertices(0, mesh.vertices);
+    floorUpload.writeIndices(0, mesh.indices);
+    floorUpload.finish();
+    meshesReadyValue = std::max(meshesReadyValue, floorUpload.readyValue());
+    mesh.geometry    = floorUpload.release();
+    // The data is staged, so the host copies are no longer needed.
+    mesh.releaseHostData();
+}
+
+void GlfwVulkanWrapper::updateGraphAndFloorMeshes(std::array<IndexedMesh, 2> &newMeshData, MeshUpload &&graphUpload,
+                                                  const std::optional<NormalMap> &normalMap) {
+    // The builder has already uploaded the graph and dropped its arrays.
+    setPendingGraph(newMeshData, PendingMesh{std::move(newMeshData[0]), std::move(graphUpload), std::nullopt,
+                                             createNormalMapTexture(normalMap)});
+}
+
+void GlfwVulkanWrapper::updateGraphAndFloorMeshes(std::array<IndexedMesh, 2> &newMeshData, const HeightField &field,
+                                                  const std::optional<NormalMap> &normalMap) {
+    assert(tessellationSupported);
+    SurfaceTextures surface;
+    surface.create(device, transferQueue, field);
+    setPendingGraph(newMeshData, PendingMesh{std::move(newMeshData[0]), std::nullopt, std::move(surface),
+                                             createNormalMapTexture(normalMap)});
+}
+
+std::optional<NormalMapTexture> GlfwVulkanWrapper::createNormalMapTexture(const std::optional<NormalMap> &normalMap) {
+    if (!normalMap.has_value()) {
+        return std::nullopt;
+    }
+    NormalMapTexture texture;
+    texture.create(device, transferQueue, normalMap.value());
+    return texture;
+}
+
+void GlfwVulkanWrapper::attachGraphNormalMap(const NormalMap &normalMap) {
+    NormalMapTexture texture;
+    texture.create(device, transferQueue, normalMap);
+
+    // A graph not shown yet takes the map along when it is.
+    std::optional<NormalMapTexture> &slot = pendingGraph.has_value() ? pendingGraph->normalMap : pendingNormalMap;
+    if (slot.has_value()) {
+        retiredNormalMaps.push_back(std::move(slot.value()));
+    }
+    slot = std::move(texture);
+}
+
+void GlfwVulkanWrapper::detachGraphNormalMap() {
+    if (pendingNormalMap.has_value()) {
+        retiredNormalMaps.push_back(std::move(pendingNormalMap.value()));
+        pendingNormalMap.reset();
+    }
+    if (pendingGraph.has_value() && pendingGraph->normalMap.has_value()) {
+        retiredNormalMaps.push_back(std::move(pendingGraph->normalMap.value()));
+        pendingGraph->normalMap.reset();
+    }
+    if (graphNormalMap.has_value()) {
+        setGraphNormalMap(std::nullopt);
+        if (graphMesh.has_value()) {
+            graphMesh->controller.setNormalMapped(false);
+        }
+        sceneVersion++;
+    }
+}
+
+void GlfwVulkanWrapper::setPendingGraph(std::array<IndexedMesh, 2> &newMeshData, PendingMesh &&pending) {
+    // A map waiting to be attached belongs to the graph being replaced.
+    if (pendingNormalMap.has_value()) {
+        retiredNormalMaps.push_back(std::move(pendingNormalMap.value()));
+        pendingNormalMap.reset();
+    }
+    if (pendingGraph.has_value()) {
+        if (pendingGraph->upload.has_value()) {
+            retireUpload(std::move(pendingGraph->upload.value()));
+        }
+        if (pendingGraph->surface.has_value()) {
+            retiredSurfaces.push_back(std::move(pendingGraph->surface.value()));
+        }
+        if (pendingGraph->normalMap.has_value()) {
+            retiredNormalMaps.push_back(std::move(pendingGraph->normalMap.value()));
+        }
+    }
+    pendingGraph = std::move(pending);
+
+    if (!floorMesh.has_value()) {
         floorMesh = std::move(newMeshData[1]);
         initMesh(floorMesh.value());
+        sceneVersion++;
+    }
+}
+
+void GlfwVulkanWrapper::retireUpload(MeshUpload &&upload) {
+    retiredUploads.push_back(std::move(upload));
+}
+
+void GlfwVulkanWrapper::promotePendingGraph() {
+    // Polling rather than waiting keeps the current mesh on screen until
+    // the new one is ready, so a slow upload never delays a frame.
+    std::erase_if(retiredUploads, [](const MeshUpload &upload) { return upload.ready(); });
+    std::erase_if(retiredSurfaces, [this](SurfaceTextures &surface) {
+        if (!transferQueue.reached(surface.readyValue)) {
+            return false;
+        }
+        surface.destroy();
+        return true;
+    });
+    std::erase_if(retiredNormalMaps, [this](NormalMapTexture &map) {
+        if (!transferQueue.reached(map.readyValue)) {
+            return false;
+        }
+        map.destroy();
+        return true;
+    });
+    if (pendingNormalMap.has_value() && transferQueue.reached(pendingNormalMap->readyValue)) {
+        // The graph may have been pinned since, which keeps it unmapped.
+        if (graphMesh.has_value()) {
+            setGraphNormalMap(std::move(pendingNormalMap));
+            graphMesh->controller.setNormalMapped(true);
+            sceneVersion++;
+        } else {
+            retiredNormalMaps.push_back(std::move(pendingNormalMap.value()));
+        }
+        pendingNormalMap.reset();
+    }
+    if (!pendingGraph.has_value()) {
+        return;
+    }
+    uint64_t readyValue = pendingGraph->upload.has_value() ? pendingGraph->upload->readyValue()
+                                                           : pendingGraph->surface->readyValue;
+    if (pendingGraph->normalMap.has_value()) {
+        readyValue = std::max(readyValue, pendingGraph->normalMap->readyValue);
+    }
+    if (!transferQueue.reached(readyValue)) {
+        return;
+    }
+    meshesReadyValue = std::max(meshesReadyValue, readyValue);
+
+    if (graphSurface.has_value()) {
+        // Shared, as deferred destruction must be copyable.
+        auto retired = std::make_shared<SurfaceTextures>(std::move(graphSurface.value()));
+        deferDestruction([this, retired] {
+            surfaceDescriptors.freeSet(device, *retired);
+            retired->destroy();
+        });
+        graphSurface.reset();
+    }
+    if (pendingGraph->surface.has_value()) {
+        graphSurface = std::move(pendingGraph->surface);
+        surfaceDescriptors.allocateSet(device, graphSurface.value());
+    }
+    setGraphNormalMap(std::move(pendingGraph->normalMap));
+
+    MeshUpload *upload = pendingGraph->upload.has_value() ? &pendingGraph->upload.value() : nullptr;
+    if (graphMesh.has_value()) {
+        // Frames still in flight may be drawing the old geometry.
+        deferDestruction([this, geometry = graphMesh->geometry]() mutable { geometryArena.free(geometry); });
+        graphMesh->geometry = {};
+        graphMesh->metadata = pendingGraph->mesh.metadata;
+        createMeshBuffers(graphMesh.value(), upload);
+    } else {
+        graphMesh = std::move(pendingGraph->mesh);
+        initMesh(graphMesh.value(), upload);
+        // A graph replacing pinned ones starts where they are.
+        if (!pinnedGraphs.empty()) {
+            graphMesh->controller = pinnedGraphs.back().controller;
+            graphMesh->controller.setNeedsWrite();
+        }
     }
+    graphMesh->controller.setNormalMapped(graphNormalMap.has_value());
+    pendingGraph.reset();
+    sceneVersion++;
+}
+
+void GlfwVulkanWrapper::setGraphNormalMap(std::optional<NormalMapTexture> &&normalMap) {
+    if (graphNormalMap.has_value()) {
+        auto retired = std::make_shared<NormalMapTexture>(std::move(graphNormalMap.value()));
+        deferDestruction([this, retired] {
+            normalMapDescriptors.freeSet(device, *retired);
+            retired->destroy();
+        });
+        graphNormalMap.reset();
+    }
+    if (normalMap.has_value()) {
+        graphNormalMap = std::move(normalMap);
+        normalMapDescriptors.allocateSet(device, graphNormalMap.value());
+    }
+}
+
+void GlfwVulkanWrapper::updatePinnedGraphs(AppState &appState) {
+    if (appState.pinGraph) {
+        appState.pinGraph = false;
+        // The next graph built takes the current one's place. Surfaces
+        // have no geometry to pin.
+        if (graphMesh.has_value() && !graphSurface.has_value() && pinnedGraphs.size() < MAX_PINNED_GRAPHS) {
+            // The normal map stays with the current graph until replaced.
+            graphMesh->controller.setNormalMapped(false);
+            pinnedGraphs.push_back(std::move(graphMesh.value()));
+            graphMesh.reset();
+            sceneVersion++;
+        }
+    }
+
+    if (appState.clearPinnedGraphs) {
+        appState.clearPinnedGraphs = false;
+        if (!pinnedGraphs.empty()) {
+            for (IndexedMesh &mesh : pinnedGraphs) {
+                retireMesh(mesh);
+            }
+            pinnedGraphs.clear();
+            sceneVersion++;
+        }
+    }
+}
+
+void GlfwVulkanWrapper::retireMesh(IndexedMesh &mesh) {
+    deferDestruction([this, geometry = mesh.geometry, slot = mesh.uniformSlot]() mutable {
+        geometryArena.free(geometry);
+        modelStorage.releaseSlot(slot);
+    });
+    mesh.geometry = {};
+}
+
+void GlfwVulkanWrapper::deferDestruction(std::function<void()> destroy) {
+    deferredDestruction[currentFrame].push_back(std::move(destroy));
+}
+
+void GlfwVulkanWrapper::runDeferredDestruction(uint32_t frame) {
+    for (auto &destroy : deferredDestruction[frame]) {
+        destroy();
+    }
+    deferredDestruction[frame].clear();
 }
 
 void GlfwVulkanWrapper::recreateSwapchain() {
@@ -128,9 +397,12 @@ void GlfwVulkanWrapper::recreateSwapchain() {
     createDepthResources();
     createFramebuffers();
     createUIFrameBuffersCallback(*this);
+    sceneVersion++;
 }
 
 void GlfwVulkanWrapper::waitForDeviceIdle() {
+    // Waiting on the device needs every queue, including the transfer queue.
+    std::lock_guard<std::mutex> lock(queueMutex);
     vkDeviceWaitIdle(device);
 }
 
@@ -139,20 +411,74 @@ void GlfwVulkanWrapper::deinit() {
 
     cleanupSwapChain();
 
-    vkDestroyPipeline(device, wireframePipeline, nullptr);
-    vkDestroyPipeline(device, pbrPipeline, nullptr);
-    vkDestroyPipeline(device, pbr2Pipeline, nullptr);
+    pipelineCompileTasks.wait();
+    for (const auto &[variant, pipeline] : pipelines) {
+        vkDestroyPipeline(device, pipeline, nullptr);
+    }
+    pipelines.clear();
+    for (const auto &[variant, compile] : pipelineCompiles) {
+        if (compile->pipeline != VK_NULL_HANDLE) {
+            vkDestroyPipeline(device, compile->pipeline, nullptr);
+        }
+    }
+    pipelineCompiles.clear();
     vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+    vkDestroyPipelineLayout(device, surfacePipelineLayout, nullptr);
+    vkDestroyPipeline(device, cullPipeline, nullptr);
+    vkDestroyPipelineLayout(device, cullPipelineLayout, nullptr);
+    pipelineCache.destroy();
     vkDestroyRenderPass(device, renderPass, nullptr);
 
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+        runDeferredDestruction(i);
+    }
+    if (pendingGraph.has_value() && pendingGraph->surface.has_value()) {
+        pendingGraph->surface->destroy();
+    }
+    if (pendingGraph.has_value() && pendingGraph->normalMap.has_value()) {
+        pendingGraph->normalMap->destroy();
+    }
+    pendingGraph.reset();
+    if (pendingNormalMap.has_value()) {
+        pendingNormalMap->destroy();
+        pendingNormalMap.reset();
+    }
+    retiredUploads.clear();
+    for (SurfaceTextures &retired : retiredSurfaces) {
+        retired.destroy();
+    }
+    retiredSurfaces.clear();
+    if (graphSurface.has_value()) {
+        graphSurface->destroy();
+        graphSurface.reset();
+    }
+    surfaceDescriptors.destroyResources(device);
+    for (NormalMapTexture &retired : retiredNormalMaps) {
+        retired.destroy();
+    }
+    retiredNormalMaps.clear();
+    if (graphNormalMap.has_value()) {
+        graphNormalMap->destroy();
+        graphNormalMap.reset();
+    }
+    flatNormalMap.destroy();
+    normalMapDescriptors.destroyResources(device);
     if (graphMesh.has_value()) {
-        graphMesh->destroyResources(device);
+        geometryArena.free(graphMesh->geometry);
+    }
+    for (IndexedMesh &pinned : pinnedGraphs) {
+        geometryArena.free(pinned.geometry);
     }
+    pinnedGraphs.clear();
     if (floorMesh.has_value()) {
-        floorMesh->destroyResources(device);
+        geometryArena.free(floorMesh->geometry);
     }
-    descriptorSetLayout.destroy();
-    sceneUniform.destroyResources(device);
+    geometryArena.destroy();
+    indirectDraws.destroyResources(device, allocator);
+    modelStorage.destroyResources(device, allocator);
+    sceneUniform.destroyResources(device, allocator);
+    transferQueue.destroy();
+    allocator.destroy();
 
     for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
         vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
@@ -183,8 +509,13 @@ void GlfwVulkanWrapper::drawFrame(AppState &appState, bool frameBufferResized) {
         sceneUniform.updateUniformBuffer(currentFrame);
     }
 
-    if (graphMesh.has_value()) {
-        MeshController &controller = graphMesh->controller;
+    // User input moves the current graph, or the last pinned one while
+    // there is none, and the other pinned graphs follow it.
+    IndexedMesh *leadGraph = graphMesh.has_value() ? &graphMesh.value()
+                             : pinnedGraphs.empty() ? nullptr
+                                                    : &pinnedGraphs.back();
+    if (leadGraph != nullptr) {
+        MeshController &controller = leadGraph->controller;
         if (appState.resetPosition) {
             controller.reset();
             appState.resetPosition = false;
@@ -193,10 +524,22 @@ void GlfwVulkanWrapper::drawFrame(AppState &appState, bool frameBufferResized) {
         controller.applyUserRotation({userInput.xUserRot, userInput.yUserRot});
         controller.applyUserTranslation(userInput.xUserTrans, userInput.yUserTrans);
         controller.applyTimedRotation();
+    }
+
+    if (graphMesh.has_value()) {
+        MeshController &controller = graphMesh->controller;
         controller.updateFromAppState(appState);
         controller.updateColor(appState.graphColor);
-        if (graphMesh->needsUniformBufferWrite()) {
-            graphMesh->updateUniformBuffer(currentFrame);
+        if (graphMesh->needsUniformBufferWrite(currentFrame)) {
+            graphMesh->updateUniformBuffer(modelStorage, currentFrame);
+        }
+    }
+
+    // Pinned graphs keep the color and material they had when pinned.
+    for (IndexedMesh &pinned : pinnedGraphs) {
+        pinned.controller.syncModel(leadGraph->controller);
+        if (pinned.needsUniformBufferWrite(currentFrame)) {
+            pinned.updateUniformBuffer(modelStorage, currentFrame);
         }
     }
 
@@ -204,15 +547,19 @@ void GlfwVulkanWrapper::drawFrame(AppState &appState, bool frameBufferResized) {
         MeshController &controller = floorMesh->controller;
         controller.syncYRotation(floorMesh.has_value() ? floorMesh->controller.yRotRad : 0.0);
         controller.updateColor(floorMesh->getVertColor());
-        if (floorMesh->needsUniformBufferWrite()) {
-            floorMesh->updateUniformBuffer(currentFrame);
+        if (floorMesh->needsUniformBufferWrite(currentFrame)) {
+            floorMesh->updateUniformBuffer(modelStorage, currentFrame);
         }
     }
 
-    // TODO: We can detect if scene changed and only re-record command buffers on change.
-
     vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
 
+    // Frames complete in submission order, so no frame in flight uses what
+    // was retired before this frame slot was last submitted.
+    runDeferredDestruction(currentFrame);
+    promotePendingGraph();
+    updatePinnedGraphs(appState);
+
     uint32_t imageIndex;
     VkResult result = vkAcquireNextImageKHR(device, swapChainInfo.swapchain, UINT64_MAX,
                                             imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
@@ -228,17 +575,35 @@ void GlfwVulkanWrapper::drawFrame(AppState &appState, bool frameBufferResized) {
     vkResetCommandBuffer(commandBuffers[currentFrame], /*VkCommandBufferResetFlagBits*/ 0);
     recordCommandBuffer(appState, commandBuffers[currentFrame], imageIndex);
 
+    // The UI backend may submit uploads of its own while recording.
+    std::unique_lock<std::mutex> queueLock = lockGraphicsQueue();
+
     // Record UI draw commands.
     VkCommandBuffer uiBuffer = uiDrawCallback(currentFrame, imageIndex, swapChainInfo.swapChainExtent);
 
     VkSubmitInfo submitInfo = {};
     submitInfo.sType        = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-    VkSemaphore waitSemaphores[]      = {imageAvailableSemaphores[currentFrame]};
-    VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    submitInfo.waitSemaphoreCount     = 1;
-    submitInfo.pWaitSemaphores        = waitSemaphores;
-    submitInfo.pWaitDstStageMask      = waitStages;
+    // Mesh buffers are written on the transfer queue. Graph uploads have
+    // already completed, so this wait mostly just orders memory accesses.
+    std::array<VkSemaphore, 2> waitSemaphores = {imageAvailableSemaphores[currentFrame],
+                                                 transferQueue.timelineSemaphore()};
+
+    std::array<VkPipelineStageFlags, 2> waitStages = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                                                      VK_PIPELINE_STAGE_VERTEX_INPUT_BIT};
+
+    // Binary semaphores ignore their value.
+    std::array<uint64_t, 2> waitValues = {0, meshesReadyValue};
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+    timelineInfo.sType                         = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount       = static_cast<uint32_t>(waitValues.size());
+    timelineInfo.pWaitSemaphoreValues          = waitValues.data();
+
+    submitInfo.pNext              = &timelineInfo;
+    submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+    submitInfo.pWaitSemaphores    = waitSemaphores.data();
+    submitInfo.pWaitDstStageMask  = waitStages.data();
 
     std::array<VkCommandBuffer, 2> cmdBuffers = {commandBuffers[currentFrame], uiBuffer};
     submitInfo.commandBufferCount             = static_cast<uint32_t>(cmdBuffers.size());
@@ -264,6 +629,9 @@ void GlfwVulkanWrapper::drawFrame(AppState &appState, bool frameBufferResized) {
     presentInfo.pImageIndices = &imageIndex;
 
     result = vkQueuePresentKHR(presentQueue, &presentInfo);
+    if (queueLock.owns_lock()) {
+        queueLock.unlock();
+    }
 
     if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || frameBufferResized) {
         recreateSwapchain();
@@ -343,11 +711,11 @@ SwapchainConfig GlfwVulkanWrapper::querySwapchainSupport(const VkPhysicalDevice
     return config;
 }
 
-VkShaderModule GlfwVulkanWrapper::createShaderModule(const std::vector<char> &shaderCode) {
+VkShaderModule GlfwVulkanWrapper::createShaderModule(std::span<const uint32_t> shaderCode) {
     VkShaderModuleCreateInfo createInfo = {};
     createInfo.sType                    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    createInfo.codeSize                 = shaderCode.size();
-    createInfo.pCode                    = reinterpret_cast<const uint32_t *>(shaderCode.data());
+    createInfo.codeSize                 = shaderCode.size_bytes();
+    createInfo.pCode                    = shaderCode.data();
 
     VkShaderModule shaderModule;
     if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
@@ -357,19 +725,6 @@ VkShaderModule GlfwVulkanWrapper::createShaderModule(const std::vector<char> &sh
     return shaderModule;
 }
 
-uint32_t GlfwVulkanWrapper::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
-    VkPhysicalDeviceMemoryProperties memProperties;
-    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
-
-    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-        if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-            return i;
-        }
-    }
-
-    throw std::runtime_error("failed to find suitable memory type!");
-}
-
 VkSampleCountFlagBits GlfwVulkanWrapper::getMaxUsableSampleCount() {
     VkPhysicalDeviceProperties physicalDeviceProperties;
     vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProperties);
@@ -401,7 +756,7 @@ VkSampleCountFlagBits GlfwVulkanWrapper::getMaxUsableSampleCount() {
 // Buffer management helpers.
 
 void GlfwVulkanWrapper::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
-                                     VkBuffer &buffer, VkDeviceMemory &bufferMemory) {
+                                     VkBuffer &buffer, DeviceAllocation &allocation) {
     VkBufferCreateInfo bufferInfo{};
     bufferInfo.sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     bufferInfo.size        = size;
@@ -412,54 +767,7 @@ void GlfwVulkanWrapper::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage
         throw std::runtime_error("failed to create buffer!");
     }
 
-    VkMemoryRequirements memRequirements;
-    vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
-
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize  = memRequirements.size;
-    allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-    if (vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-        throw std::runtime_error("failed to allocate buffer memory!");
-    }
-
-    vkBindBufferMemory(device, buffer, bufferMemory, 0);
-}
-
-void GlfwVulkanWrapper::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
-    VkCommandBufferAllocateInfo allocInfo{};
-    allocInfo.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandPool        = commandPool;
-    allocInfo.commandBufferCount = 1;
-
-    VkCommandBuffer commandBuffer;
-    vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
-
-    VkCommandBufferBeginInfo beginInfo{};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-    vkBeginCommandBuffer(commandBuffer, &beginInfo);
-
-    VkBufferCopy copyRegion{};
-    copyRegion.srcOffset = 0;
-    copyRegion.dstOffset = 0;
-    copyRegion.size      = size;
-    vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
-
-    vkEndCommandBuffer(commandBuffer);
-
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers    = &commandBuffer;
-
-    vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-    // TODO: Switch to using a fence here.
-    vkQueueWaitIdle(graphicsQueue);
-
-    vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+    allocation = allocator.bindBuffer(buffer, properties);
 }
 
 // Image creation helper.
@@ -467,7 +775,7 @@ void GlfwVulkanWrapper::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDev
 void GlfwVulkanWrapper::createImage(uint32_t width, uint32_t height, uint32_t mipLevels,
                                     VkSampleCountFlagBits numSamples, VkFormat format, VkImageTiling tiling,
                                     VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage &image,
-                                    VkDeviceMemory &imageMemory) {
+                                    DeviceAllocation &allocation) {
     VkImageCreateInfo imageInfo{};
     imageInfo.sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     imageInfo.imageType     = VK_IMAGE_TYPE_2D;
@@ -487,19 +795,7 @@ void GlfwVulkanWrapper::createImage(uint32_t width, uint32_t height, uint32_t mi
         throw std::runtime_error("failed to create image!");
     }
 
-    VkMemoryRequirements memRequirements;
-    vkGetImageMemoryRequirements(device, image, &memRequirements);
-
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize  = memRequirements.size;
-    allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-    if (vkAllocateMemory(device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
-        throw std::runtime_error("failed to allocate image memory!");
-    }
-
-    vkBindImageMemory(device, image, imageMemory, 0);
+    allocation = allocator.bindImage(image, properties);
 }
 
 // Swap chain creation helpers.
@@ -701,24 +997,55 @@ void GlfwVulkanWrapper::getDeviceQueueIndices() {
             queueIndices.computeFamilyIndex = i;
         }
     }
+
+    // Prefer a family that only does transfers, which usually maps to a
+    // DMA engine that runs alongside rendering.
+    queueIndices.transferFamilyIndex = queueIndices.graphicsFamilyIndex;
+    for (size_t i = 0; i < queueProperties.size(); ++i) {
+        VkQueueFlags flags = queueProperties[i].queueFlags;
+        if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+            queueIndices.transferFamilyIndex = i;
+            break;
+        }
+    }
 }
 
 void GlfwVulkanWrapper::createLogicalDevice() {
-    std::set<uint32_t> uniqueQueueIndices = {queueIndices.graphicsFamilyIndex, queueIndices.presentFamilyIndex};
+    std::set<uint32_t> uniqueQueueIndices = {queueIndices.graphicsFamilyIndex, queueIndices.presentFamilyIndex,
+                                             queueIndices.transferFamilyIndex};
+
+    // Without a transfer-only family, ask for a second graphics queue for
+    // transfers if there is one; otherwise transfers share the first.
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> familyProperties(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, familyProperties.data());
+
+    transferSharesGraphicsQueue =
+        queueIndices.transferFamilyIndex == queueIndices.graphicsFamilyIndex &&
+        familyProperties[queueIndices.graphicsFamilyIndex].queueCount < 2;
+
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-    const float priority = 1.0f;
+    const std::array<float, 2> priorities = {1.0f, 1.0f};
     for (uint32_t queueIndex : uniqueQueueIndices) {
+        bool secondQueue = queueIndex == queueIndices.graphicsFamilyIndex &&
+                           queueIndices.transferFamilyIndex == queueIndex && !transferSharesGraphicsQueue;
+
         VkDeviceQueueCreateInfo queueInfo = {};
         queueInfo.sType                   = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-        queueInfo.queueCount              = 1;
+        queueInfo.queueCount              = secondQueue ? 2 : 1;
         queueInfo.queueFamilyIndex        = queueIndex;
-        queueInfo.pQueuePriorities        = &priority;
+        queueInfo.pQueuePriorities        = priorities.data();
         queueCreateInfos.push_back(queueInfo);
     }
 
+    // Mesh uploads signal a timeline semaphore.
+    VkPhysicalDeviceVulkan12Features vulkan12Features = {};
+    vulkan12Features.sType                            = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
     VkPhysicalDeviceFeatures2 features = {
         .sType    = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
-        .pNext    = nullptr,
+        .pNext    = &vulkan12Features,
         .features = {},
     };
     vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
@@ -726,6 +1053,19 @@ void GlfwVulkanWrapper::createLogicalDevice() {
     if (!features.features.fillModeNonSolid) {
         throw std::runtime_error("Device does not support wireframe rendering!");
     }
+    if (!vulkan12Features.timelineSemaphore) {
+        throw std::runtime_error("Device does not support timeline semaphores!");
+    }
+    // Optional; without it graphs are always meshed on the CPU.
+    tessellationSupported = features.features.tessellationShader;
+    // Each draw's first instance selects its model in ModelStorage.
+    if (!features.features.multiDrawIndirect || !features.features.drawIndirectFirstInstance) {
+        throw std::runtime_error("Device does not support multi-draw indirect!");
+    }
+    // Culling is dispatched on the graphics queue.
+    if (!(familyProperties[queueIndices.graphicsFamilyIndex].queueFlags & VK_QUEUE_COMPUTE_BIT)) {
+        throw std::runtime_error("Graphics queue does not support compute!");
+    }
 
     VkDeviceCreateInfo deviceInfo = {};
     deviceInfo.sType              = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -749,11 +1089,32 @@ void GlfwVulkanWrapper::createLogicalDevice() {
         throw std::runtime_error("Unable to create logical device!");
     }
 
-    // We use only the first queue in each family.
+    // We use only the first queue in each family, except for transfers.
     vkGetDeviceQueue(device, queueIndices.graphicsFamilyIndex, 0, &graphicsQueue);
     vkGetDeviceQueue(device, queueIndices.presentFamilyIndex, 0, &presentQueue);
 }
 
+void GlfwVulkanWrapper::createTransferQueue() {
+    VkQueue queue = graphicsQueue;
+    if (queueIndices.transferFamilyIndex != queueIndices.graphicsFamilyIndex) {
+        vkGetDeviceQueue(device, queueIndices.transferFamilyIndex, 0, &queue);
+    } else if (!transferSharesGraphicsQueue) {
+        vkGetDeviceQueue(device, queueIndices.graphicsFamilyIndex, 1, &queue);
+    }
+
+    transferQueue.init(device, allocator, queue, queueIndices.transferFamilyIndex,
+                       queueIndices.graphicsFamilyIndex, queueMutex);
+    spdlog::debug("Transfer queue family: {}{}", queueIndices.transferFamilyIndex,
+                  transferSharesGraphicsQueue ? " (shared with graphics)" : "");
+}
+
+std::unique_lock<std::mutex> GlfwVulkanWrapper::lockGraphicsQueue() {
+    if (!transferSharesGraphicsQueue) {
+        return {};
+    }
+    return std::unique_lock<std::mutex>(queueMutex);
+}
+
 // Setup methods that use the logical device.
 
 void GlfwVulkanWrapper::createSwapchain() {
@@ -881,225 +1242,370 @@ void GlfwVulkanWrapper::createRenderPass() {
 }
 
 void GlfwVulkanWrapper::createGraphicsPipelines() {
-    VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
-    vertexInputInfo.sType                                = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-
-    auto bindingDescription    = Vertex::getBindingDescription();
-    auto attributeDescriptions = Vertex::getAttributeDescriptions();
-
-    vertexInputInfo.vertexBindingDescriptionCount   = 1;
-    vertexInputInfo.pVertexBindingDescriptions      = &bindingDescription;
-    vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-    vertexInputInfo.pVertexAttributeDescriptions    = attributeDescriptions.data();
-
-    VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo = {};
-    inputAssemblyInfo.sType                  = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    inputAssemblyInfo.topology               = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-    inputAssemblyInfo.primitiveRestartEnable = VK_FALSE;
-
-    VkViewport viewport = {};
-    viewport.x          = 0.0f;
-    viewport.y          = 0.0f;
-    viewport.width      = static_cast<float>(swapChainInfo.swapChainExtent.width);
-    viewport.height     = static_cast<float>(swapChainInfo.swapChainExtent.height);
-    viewport.minDepth   = 0.0f;
-    viewport.maxDepth   = 1.0f;
-
-    VkRect2D scissor = {};
-    scissor.extent   = swapChainInfo.swapChainExtent;
-    scissor.offset   = {0, 0};
-
-    VkPipelineViewportStateCreateInfo viewPortInfo = {};
-    viewPortInfo.sType                             = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-    viewPortInfo.viewportCount                     = 1;
-    viewPortInfo.pViewports                        = &viewport;
-    viewPortInfo.scissorCount                      = 1;
-    viewPortInfo.pScissors                         = &scissor;
-
-    VkPipelineRasterizationStateCreateInfo rasterizerInfo = {};
-    rasterizerInfo.sType                                  = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    rasterizerInfo.depthClampEnable                       = VK_FALSE;
-    rasterizerInfo.rasterizerDiscardEnable                = VK_FALSE;
-    rasterizerInfo.cullMode                               = VK_CULL_MODE_NONE;
-    rasterizerInfo.frontFace                              = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-    rasterizerInfo.lineWidth                              = 1.0f;
-    rasterizerInfo.depthBiasEnable                        = VK_FALSE;
-    rasterizerInfo.depthBiasConstantFactor                = 0.0f;
-    rasterizerInfo.depthBiasClamp                         = 0.0f;
-    rasterizerInfo.depthBiasSlopeFactor                   = 0.0f;
-
-    // Render wireframe.
-    rasterizerInfo.polygonMode = VK_POLYGON_MODE_LINE;
-
-    VkPipelineMultisampleStateCreateInfo multisamplingInfo = {};
-    multisamplingInfo.sType                                = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    multisamplingInfo.rasterizationSamples                 = msaaSamples;
-    multisamplingInfo.sampleShadingEnable                  = VK_FALSE;
-    multisamplingInfo.minSampleShading                     = 1.0f;
-    multisamplingInfo.pSampleMask                          = nullptr;
-    multisamplingInfo.alphaToCoverageEnable                = VK_FALSE;
-    multisamplingInfo.alphaToOneEnable                     = VK_FALSE;
-
-    VkPipelineDepthStencilStateCreateInfo depthStencilInfo{};
-    depthStencilInfo.sType                 = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-    depthStencilInfo.depthTestEnable       = VK_TRUE;
-    depthStencilInfo.depthWriteEnable      = VK_TRUE;
-    depthStencilInfo.depthCompareOp        = VK_COMPARE_OP_LESS;
-    depthStencilInfo.depthBoundsTestEnable = VK_FALSE;
-    depthStencilInfo.minDepthBounds        = 0.0f;
-    depthStencilInfo.maxDepthBounds        = 1.0f;
-    depthStencilInfo.stencilTestEnable     = VK_FALSE;
-    depthStencilInfo.front                 = {};
-    depthStencilInfo.back                  = {};
-
-    VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
-    colorBlendAttachment.colorWriteMask =
-        VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-    colorBlendAttachment.blendEnable = VK_FALSE;
-
-    VkPipelineColorBlendStateCreateInfo colorBlendingInfo = {};
-    colorBlendingInfo.sType                               = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    colorBlendingInfo.logicOpEnable                       = VK_FALSE;
-    colorBlendingInfo.logicOp                             = VK_LOGIC_OP_COPY;
-    colorBlendingInfo.attachmentCount                     = 1;
-    colorBlendingInfo.pAttachments                        = &colorBlendAttachment;
-    colorBlendingInfo.blendConstants[0]                   = 0.0f;
-    colorBlendingInfo.blendConstants[1]                   = 0.0f;
-    colorBlendingInfo.blendConstants[2]                   = 0.0f;
-    colorBlendingInfo.blendConstants[3]                   = 0.0f;
-
-    std::array<VkDescriptorSetLayout, 2> descriptorSetLayouts = {sceneUniform.descriptorSetLayout.layout,
-                                                                 descriptorSetLayout.layout};
+    pipelineCache.init(physicalDevice, device);
+    createPipelineStates();
+
+    std::array<VkDescriptorSetLayout, 3> descriptorSetLayouts = {sceneUniform.descriptorSetLayout.layout,
+                                                                 modelStorage.descriptorSetLayout.layout,
+                                                                 normalMapDescriptors.descriptorSetLayout};
     VkPipelineLayoutCreateInfo pipelineLayoutInfo             = {};
     pipelineLayoutInfo.sType                                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     pipelineLayoutInfo.setLayoutCount                         = static_cast<uint32_t>(descriptorSetLayouts.size());
     pipelineLayoutInfo.pSetLayouts                            = descriptorSetLayouts.data();
 
-    std::vector<VkDynamicState> dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
-    VkPipelineDynamicStateCreateInfo dynamicState{};
-    dynamicState.sType             = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-    dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
-    dynamicState.pDynamicStates    = dynamicStates.data();
-
     if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
         throw std::runtime_error("Unable to create graphics pipeline layout!");
     }
 
-    // Create wireframe pipelin.
-
-    auto vertShaderCode = loadShader("shaders/wireframe_vert.spv");
-    auto fragShaderCode = loadShader("shaders/wireframe_frag.spv");
-
-    VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-    VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
+    if (tessellationSupported) {
+        std::array<VkDescriptorSetLayout, 4> surfaceSetLayouts = {sceneUniform.descriptorSetLayout.layout,
+                                                                  modelStorage.descriptorSetLayout.layout,
+                                                                  normalMapDescriptors.descriptorSetLayout,
+                                                                  surfaceDescriptors.descriptorSetLayout};
+        VkPushConstantRange pushConstantRange = {};
+        pushConstantRange.stageFlags          = VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+        pushConstantRange.offset              = 0;
+        pushConstantRange.size                = sizeof(SurfaceConstants);
+
+        VkPipelineLayoutCreateInfo surfaceLayoutInfo = {};
+        surfaceLayoutInfo.sType                      = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        surfaceLayoutInfo.setLayoutCount             = static_cast<uint32_t>(surfaceSetLayouts.size());
+        surfaceLayoutInfo.pSetLayouts                = surfaceSetLayouts.data();
+        surfaceLayoutInfo.pushConstantRangeCount     = 1;
+        surfaceLayoutInfo.pPushConstantRanges        = &pushConstantRange;
+
+        if (vkCreatePipelineLayout(device, &surfaceLayoutInfo, nullptr, &surfacePipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("Unable to create surface pipeline layout!");
+        }
+    }
 
-    VkPipelineShaderStageCreateInfo vertShaderStageInfo = {};
-    vertShaderStageInfo.sType                           = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    vertShaderStageInfo.stage                           = VK_SHADER_STAGE_VERTEX_BIT;
-    vertShaderStageInfo.module                          = vertShaderModule;
-    vertShaderStageInfo.pName                           = "main";
+    // The variants drawn with in the first frame, for the default app
+    // state, are compiled now, concurrently. Others are compiled in the
+    // background when first selected; see getPipeline.
 
-    VkPipelineShaderStageCreateInfo fragShaderStageInfo = {};
-    fragShaderStageInfo.sType                           = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    fragShaderStageInfo.stage                           = VK_SHADER_STAGE_FRAGMENT_BIT;
-    fragShaderStageInfo.module                          = fragShaderModule;
-    fragShaderStageInfo.pName                           = "main";
+    // NOTE: The second PBR pipeline is a version of the first that
+    // moves the PBR computations to the fragment shader. This
+    // reduces interpolation error and dramatically improves the
+    // surface lighting on reasonably-sized meshes.
 
-    VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
+    const std::array<PipelineVariant, 2> startupVariants = {PipelineVariant{PipelineKind::PBR},
+                                                            PipelineVariant{PipelineKind::PBR2}};
+    std::array<VkPipeline, startupVariants.size()> startupPipelines;
 
-    VkGraphicsPipelineCreateInfo pipelineInfo = {};
-    pipelineInfo.sType                        = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipelineInfo.stageCount                   = 2;
-    pipelineInfo.pStages                      = shaderStages;
-    pipelineInfo.pVertexInputState            = &vertexInputInfo;
-    pipelineInfo.pInputAssemblyState          = &inputAssemblyInfo;
-    pipelineInfo.pViewportState               = &viewPortInfo;
-    pipelineInfo.pRasterizationState          = &rasterizerInfo;
-    pipelineInfo.pMultisampleState            = &multisamplingInfo;
-    pipelineInfo.pDepthStencilState           = &depthStencilInfo;
-    pipelineInfo.pColorBlendState             = &colorBlendingInfo;
-    pipelineInfo.pDynamicState                = &dynamicState;
-    pipelineInfo.layout                       = pipelineLayout;
-    pipelineInfo.renderPass                   = renderPass;
-    pipelineInfo.subpass                      = 0;
-    pipelineInfo.basePipelineHandle           = VK_NULL_HANDLE;
+    jobs::TaskGroup group;
+    for (size_t i = 0; i < startupVariants.size(); ++i) {
+        group.run([this, &startupVariants, &startupPipelines, i] {
+            startupPipelines[i] = createPipeline(startupVariants[i].normalized());
+        });
+    }
+    group.run([this] { createCullPipeline(); });
+    group.wait();
 
-    if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &wireframePipeline) !=
-        VK_SUCCESS) {
-        throw std::runtime_error("Unable to create graphics pipeline!");
+    for (size_t i = 0; i < startupVariants.size(); ++i) {
+        pipelines.emplace(startupVariants[i].normalized(), startupPipelines[i]);
     }
+}
 
-    vkDestroyShaderModule(device, vertShaderModule, nullptr);
-    vkDestroyShaderModule(device, fragShaderModule, nullptr);
+void GlfwVulkanWrapper::createCullPipeline() {
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags          = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset              = 0;
+    pushConstantRange.size                = sizeof(CullConstants);
 
-    // Create PBR pipeline.
+    VkPipelineLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType                      = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layoutInfo.setLayoutCount             = 1;
+    layoutInfo.pSetLayouts                = &indirectDraws.descriptorSetLayout;
+    layoutInfo.pushConstantRangeCount     = 1;
+    layoutInfo.pPushConstantRanges        = &pushConstantRange;
 
-    rasterizerInfo.polygonMode = VK_POLYGON_MODE_FILL;
+    if (vkCreatePipelineLayout(device, &layoutInfo, nullptr, &cullPipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Unable to create culling pipeline layout!");
+    }
 
-    vertShaderCode = loadShader("shaders/pbr_vert.spv");
-    fragShaderCode = loadShader("shaders/pbr_frag.spv");
+    VkShaderModule shaderModule = createShaderModule(shaders::CULL_COMP);
 
-    vertShaderModule = createShaderModule(vertShaderCode);
-    fragShaderModule = createShaderModule(fragShaderCode);
+    VkComputePipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType                       = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType                 = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage                 = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module                = shaderModule;
+    pipelineInfo.stage.pName                 = "main";
+    pipelineInfo.layout                      = cullPipelineLayout;
 
-    vertShaderStageInfo        = {};
-    vertShaderStageInfo.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    vertShaderStageInfo.stage  = VK_SHADER_STAGE_VERTEX_BIT;
-    vertShaderStageInfo.module = vertShaderModule;
-    vertShaderStageInfo.pName  = "main";
+    VkResult result =
+        vkCreateComputePipelines(device, pipelineCache.handle(), 1, &pipelineInfo, nullptr, &cullPipeline);
+    vkDestroyShaderModule(device, shaderModule, nullptr);
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create culling pipeline!");
+    }
+}
 
-    fragShaderStageInfo        = {};
-    fragShaderStageInfo.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    fragShaderStageInfo.stage  = VK_SHADER_STAGE_FRAGMENT_BIT;
-    fragShaderStageInfo.module = fragShaderModule;
-    fragShaderStageInfo.pName  = "main";
+GlfwVulkanWrapper::PipelineVariant GlfwVulkanWrapper::PipelineVariant::normalized() const {
+    PipelineVariant variant = *this;
+    if (variant.kind != PipelineKind::PBR2 && variant.kind != PipelineKind::SURFACE &&
+        variant.kind != PipelineKind::SURFACE_WIREFRAME) {
+        variant.colorEffect = ColorEffect::None;
+    }
+    if (variant.kind == PipelineKind::WIREFRAME) {
+        variant.numLights = 0;
+    } else {
+        variant.numLights = std::clamp(variant.numLights, 1, AppState::MAX_LIGHTS);
+    }
+    return variant;
+}
 
-    shaderStages[0]      = vertShaderStageInfo;
-    shaderStages[1]      = fragShaderStageInfo;
-    pipelineInfo.pStages = shaderStages;
+VkPipeline GlfwVulkanWrapper::getPipeline(const PipelineVariant &variant, VkPipeline &shown) {
+    const PipelineVariant key = variant.normalized();
+    if (auto it = pipelines.find(key); it != pipelines.end()) {
+        shown = it->second;
+        return shown;
+    }
+
+    auto [it, firstUse] = pipelineCompiles.try_emplace(key, nullptr);
+    if (firstUse) {
+        // Compiling takes long enough to drop frames, so it is done off the
+        // render thread.
+        it->second = std::make_shared<PipelineCompile>();
+        pipelineCompileTasks.run([this, key, compile = it->second] {
+            try {
+                compile->pipeline = createPipeline(key);
+            } catch (const std::exception &e) {
+                spdlog::error("Unable to compile pipeline variant: {}", e.what());
+            }
+            compile->done.store(true, std::memory_order_release);
+        });
+        return shown;
+    }
 
-    if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pbrPipeline) != VK_SUCCESS) {
-        throw std::runtime_error("Unable to create graphics pipeline!");
+    const PipelineCompile &compile = *it->second;
+    if (compile.done.load(std::memory_order_acquire) && compile.pipeline != VK_NULL_HANDLE) {
+        shown = pipelines.emplace(key, compile.pipeline).first->second;
+        pipelineCompiles.erase(it);
     }
+    return shown;
+}
 
-    vkDestroyShaderModule(device, vertShaderModule, nullptr);
-    vkDestroyShaderModule(device, fragShaderModule, nullptr);
+// Specialization constants of the PBR shaders, laid out as their
+// constant_id values.
+struct PbrSpecialization {
+    int32_t colorEffect;
+    int32_t numLights;
+    std::array<float, 3 * AppState::MAX_LIGHTS> lightPositions;
+};
+
+static constexpr std::array<float, 3 * AppState::MAX_LIGHTS> PBR_LIGHT_POSITIONS = {
+    -1.0f, 5.0f, 1.0f,  //
+    1.0f,  4.0f, 1.0f,  //
+    0.0f,  5.0f, -2.0f, //
+    0.0f,  3.0f, 3.0f,  //
+};
+
+static constexpr std::array<float, 3 * AppState::MAX_LIGHTS> PBR2_LIGHT_POSITIONS = {
+    -2.0f, 5.0f, 2.0f,  //
+    2.0f,  5.0f, 2.0f,  //
+    0.0f,  5.0f, -2.0f, //
+    0.0f,  3.0f, 3.0f,  //
+};
+
+static constexpr auto PBR_SPECIALIZATION_ENTRIES = [] {
+    std::array<VkSpecializationMapEntry, 2 + 3 * AppState::MAX_LIGHTS> entries = {};
+    entries[0] = {0, offsetof(PbrSpecialization, colorEffect), sizeof(int32_t)};
+    entries[1] = {1, offsetof(PbrSpecialization, numLights), sizeof(int32_t)};
+    for (uint32_t i = 0; i < 3 * AppState::MAX_LIGHTS; ++i) {
+        entries[2 + i] = {2 + i, static_cast<uint32_t>(offsetof(PbrSpecialization, lightPositions) + i * sizeof(float)),
+                          sizeof(float)};
+    }
+    return entries;
+}();
+
+VkPipeline GlfwVulkanWrapper::createPipeline(const PipelineVariant &variant) {
+    if (variant.kind == PipelineKind::WIREFRAME) {
+        const std::array<ShaderStage, 2> stages = {{
+            {VK_SHADER_STAGE_VERTEX_BIT, shaders::WIREFRAME_VERT},
+            {VK_SHADER_STAGE_FRAGMENT_BIT, shaders::WIREFRAME_FRAG},
+        }};
+        return createGraphicsPipeline(stages, VK_POLYGON_MODE_LINE, nullptr);
+    }
+
+    const bool pbr   = variant.kind == PipelineKind::PBR;
+    const bool pbr2  = variant.kind == PipelineKind::PBR2;
+    const bool lines = variant.kind == PipelineKind::SURFACE_WIREFRAME;
+
+    PbrSpecialization data = {};
+    data.colorEffect       = static_cast<int32_t>(variant.colorEffect);
+    data.numLights         = variant.numLights;
+    data.lightPositions    = pbr ? PBR_LIGHT_POSITIONS : PBR2_LIGHT_POSITIONS;
+
+    VkSpecializationInfo specialization = {};
+    specialization.mapEntryCount        = static_cast<uint32_t>(PBR_SPECIALIZATION_ENTRIES.size());
+    specialization.pMapEntries          = PBR_SPECIALIZATION_ENTRIES.data();
+    specialization.dataSize             = sizeof(data);
+    specialization.pData                = &data;
+
+    if (pbr) {
+        const std::array<ShaderStage, 2> stages = {{
+            {VK_SHADER_STAGE_VERTEX_BIT, shaders::PBR_VERT},
+            {VK_SHADER_STAGE_FRAGMENT_BIT, shaders::PBR_FRAG},
+        }};
+        return createGraphicsPipeline(stages, VK_POLYGON_MODE_FILL, &specialization);
+    }
+    if (pbr2) {
+        const std::array<ShaderStage, 2> stages = {{
+            {VK_SHADER_STAGE_VERTEX_BIT, shaders::PBR2_VERT},
+            {VK_SHADER_STAGE_FRAGMENT_BIT, shaders::PBR2_FRAG},
+        }};
+        return createGraphicsPipeline(stages, VK_POLYGON_MODE_FILL, &specialization);
+    }
+
+    // Surfaces are lit like PBR2, per fragment.
+    const std::array<ShaderStage, 4> stages = {{
+        {VK_SHADER_STAGE_VERTEX_BIT, shaders::SURFACE_VERT},
+        {VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT, shaders::SURFACE_TESC},
+        {VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT, shaders::SURFACE_TESE},
+        {VK_SHADER_STAGE_FRAGMENT_BIT, shaders::PBR2_FRAG},
+    }};
+    return createGraphicsPipeline(stages, lines ? VK_POLYGON_MODE_LINE : VK_POLYGON_MODE_FILL, &specialization);
+}
 
-    // Create second PBR pipeline.
+void GlfwVulkanWrapper::createPipelineStates() {
+    pipelineStates         = {};
+    PipelineStates &states = pipelineStates;
+
+    states.bindingDescription    = Vertex::getBindingDescription();
+    states.attributeDescriptions = Vertex::getAttributeDescriptions();
+
+    states.vertexInputInfo.sType                           = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    states.vertexInputInfo.vertexBindingDescriptionCount   = 1;
+    states.vertexInputInfo.pVertexBindingDescriptions      = &states.bindingDescription;
+    states.vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(states.attributeDescriptions.size());
+    states.vertexInputInfo.pVertexAttributeDescriptions    = states.attributeDescriptions.data();
+
+    states.inputAssemblyInfo.sType                  = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    states.inputAssemblyInfo.topology               = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    states.inputAssemblyInfo.primitiveRestartEnable = VK_FALSE;
+
+    // Surface patch corners come from the vertex index; see surface.vert.
+    states.surfaceVertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+    states.patchInputAssemblyInfo.sType                  = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    states.patchInputAssemblyInfo.topology               = VK_PRIMITIVE_TOPOLOGY_PATCH_LIST;
+    states.patchInputAssemblyInfo.primitiveRestartEnable = VK_FALSE;
+
+    states.tessellationInfo.sType              = VK_STRUCTURE_TYPE_PIPELINE_TESSELLATION_STATE_CREATE_INFO;
+    states.tessellationInfo.patchControlPoints = 4;
+
+    // Viewport and scissor are dynamic state, set when recording.
+    states.viewPortInfo.sType         = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    states.viewPortInfo.viewportCount = 1;
+    states.viewPortInfo.scissorCount  = 1;
+
+    states.rasterizerInfo.sType                   = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    states.rasterizerInfo.depthClampEnable        = VK_FALSE;
+    states.rasterizerInfo.rasterizerDiscardEnable = VK_FALSE;
+    states.rasterizerInfo.polygonMode             = VK_POLYGON_MODE_FILL;
+    states.rasterizerInfo.cullMode                = VK_CULL_MODE_NONE;
+    states.rasterizerInfo.frontFace               = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    states.rasterizerInfo.lineWidth               = 1.0f;
+    states.rasterizerInfo.depthBiasEnable         = VK_FALSE;
+    states.rasterizerInfo.depthBiasConstantFactor = 0.0f;
+    states.rasterizerInfo.depthBiasClamp          = 0.0f;
+    states.rasterizerInfo.depthBiasSlopeFactor    = 0.0f;
+
+    states.multisamplingInfo.sType                 = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    states.multisamplingInfo.rasterizationSamples  = msaaSamples;
+    states.multisamplingInfo.sampleShadingEnable   = VK_FALSE;
+    states.multisamplingInfo.minSampleShading      = 1.0f;
+    states.multisamplingInfo.pSampleMask           = nullptr;
+    states.multisamplingInfo.alphaToCoverageEnable = VK_FALSE;
+    states.multisamplingInfo.alphaToOneEnable      = VK_FALSE;
+
+    states.depthStencilInfo.sType                 = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    states.depthStencilInfo.depthTestEnable       = VK_TRUE;
+    states.depthStencilInfo.depthWriteEnable      = VK_TRUE;
+    states.depthStencilInfo.depthCompareOp        = VK_COMPARE_OP_LESS;
+    states.depthStencilInfo.depthBoundsTestEnable = VK_FALSE;
+    states.depthStencilInfo.minDepthBounds        = 0.0f;
+    states.depthStencilInfo.maxDepthBounds        = 1.0f;
+    states.depthStencilInfo.stencilTestEnable     = VK_FALSE;
+    states.depthStencilInfo.front                 = {};
+    states.depthStencilInfo.back                  = {};
+
+    states.colorBlendAttachment.colorWriteMask =
+        VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    states.colorBlendAttachment.blendEnable = VK_FALSE;
+
+    states.colorBlendingInfo.sType             = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    states.colorBlendingInfo.logicOpEnable     = VK_FALSE;
+    states.colorBlendingInfo.logicOp           = VK_LOGIC_OP_COPY;
+    states.colorBlendingInfo.attachmentCount   = 1;
+    states.colorBlendingInfo.pAttachments      = &states.colorBlendAttachment;
+    states.colorBlendingInfo.blendConstants[0] = 0.0f;
+    states.colorBlendingInfo.blendConstants[1] = 0.0f;
+    states.colorBlendingInfo.blendConstants[2] = 0.0f;
+    states.colorBlendingInfo.blendConstants[3] = 0.0f;
+
+    states.dynamicStates                  = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+    states.dynamicState.sType             = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    states.dynamicState.dynamicStateCount = static_cast<uint32_t>(states.dynamicStates.size());
+    states.dynamicState.pDynamicStates    = states.dynamicStates.data();
+}
 
-    // NOTE: This is a version of the previous PBR pipeline that
-    // moves the PBR computations to the fragment shader. This
-    // reduces interpolation error and dramatically improves the
-    // surface lighting on reasonably-sized meshes.
+VkPipeline GlfwVulkanWrapper::createGraphicsPipeline(std::span<const ShaderStage> stages, VkPolygonMode polygonMode,
+                                                     const VkSpecializationInfo *specialization) {
+    bool tessellated = false;
+    std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
+    for (const ShaderStage &stage : stages) {
+        VkPipelineShaderStageCreateInfo stageInfo = {};
+        stageInfo.sType                           = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        stageInfo.stage                           = stage.stage;
+        stageInfo.module                          = createShaderModule(stage.code);
+        stageInfo.pName                           = "main";
+        stageInfo.pSpecializationInfo             = specialization;
+        shaderStages.push_back(stageInfo);
 
-    vertShaderCode = loadShader("shaders/pbr2_vert.spv");
-    fragShaderCode = loadShader("shaders/pbr2_frag.spv");
+        tessellated = tessellated || stage.stage == VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+    }
+
+    VkPipelineRasterizationStateCreateInfo rasterizerInfo = pipelineStates.rasterizerInfo;
+    rasterizerInfo.polygonMode                            = polygonMode;
 
-    vertShaderModule = createShaderModule(vertShaderCode);
-    fragShaderModule = createShaderModule(fragShaderCode);
+    VkGraphicsPipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType                        = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.stageCount                   = static_cast<uint32_t>(shaderStages.size());
+    pipelineInfo.pStages                      = shaderStages.data();
+    pipelineInfo.pVertexInputState            = &pipelineStates.vertexInputInfo;
+    pipelineInfo.pInputAssemblyState          = &pipelineStates.inputAssemblyInfo;
+    pipelineInfo.pViewportState               = &pipelineStates.viewPortInfo;
+    pipelineInfo.pRasterizationState          = &rasterizerInfo;
+    pipelineInfo.pMultisampleState            = &pipelineStates.multisamplingInfo;
+    pipelineInfo.pDepthStencilState           = &pipelineStates.depthStencilInfo;
+    pipelineInfo.pColorBlendState             = &pipelineStates.colorBlendingInfo;
+    pipelineInfo.pDynamicState                = &pipelineStates.dynamicState;
+    pipelineInfo.layout                       = pipelineLayout;
+    pipelineInfo.renderPass                   = renderPass;
+    pipelineInfo.subpass                      = 0;
+    pipelineInfo.basePipelineHandle           = VK_NULL_HANDLE;
 
-    vertShaderStageInfo        = {};
-    vertShaderStageInfo.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    vertShaderStageInfo.stage  = VK_SHADER_STAGE_VERTEX_BIT;
-    vertShaderStageInfo.module = vertShaderModule;
-    vertShaderStageInfo.pName  = "main";
+    if (tessellated) {
+        pipelineInfo.pVertexInputState   = &pipelineStates.surfaceVertexInputInfo;
+        pipelineInfo.pInputAssemblyState = &pipelineStates.patchInputAssemblyInfo;
+        pipelineInfo.pTessellationState  = &pipelineStates.tessellationInfo;
+        pipelineInfo.layout              = surfacePipelineLayout;
+    }
 
-    fragShaderStageInfo        = {};
-    fragShaderStageInfo.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    fragShaderStageInfo.stage  = VK_SHADER_STAGE_FRAGMENT_BIT;
-    fragShaderStageInfo.module = fragShaderModule;
-    fragShaderStageInfo.pName  = "main";
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    VkResult result     = vkCreateGraphicsPipelines(device, pipelineCache.handle(), 1, &pipelineInfo, nullptr,
+                                                    &pipeline);
 
-    shaderStages[0]      = vertShaderStageInfo;
-    shaderStages[1]      = fragShaderStageInfo;
-    pipelineInfo.pStages = shaderStages;
+    for (const VkPipelineShaderStageCreateInfo &stageInfo : shaderStages) {
+        vkDestroyShaderModule(device, stageInfo.module, nullptr);
+    }
 
-    if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pbr2Pipeline) != VK_SUCCESS) {
+    if (result != VK_SUCCESS) {
         throw std::runtime_error("Unable to create graphics pipeline!");
     }
-
-    vkDestroyShaderModule(device, vertShaderModule, nullptr);
-    vkDestroyShaderModule(device, fragShaderModule, nullptr);
+    return pipeline;
 }
 
 void GlfwVulkanWrapper::createFramebuffers() {
@@ -1140,7 +1646,7 @@ void GlfwVulkanWrapper::createColorResources() {
 
     createImage(swapChainInfo.swapChainExtent.width, swapChainInfo.swapChainExtent.height, 1, msaaSamples, colorFormat,
                 VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, colorImageInfo.image, colorImageInfo.imageMemory);
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, colorImageInfo.image, colorImageInfo.imageAllocation);
     colorImageInfo.imageView = createImageView(colorImageInfo.image, colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
 }
 
@@ -1148,67 +1654,21 @@ void GlfwVulkanWrapper::createDepthResources() {
     VkFormat depthFormat = findDepthFormat();
     createImage(swapChainInfo.swapChainExtent.width, swapChainInfo.swapChainExtent.height, 1, msaaSamples, depthFormat,
                 VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImageInfo.image, depthImageInfo.imageMemory);
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImageInfo.image, depthImageInfo.imageAllocation);
     depthImageInfo.imageView = createImageView(depthImageInfo.image, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
 }
 
-void GlfwVulkanWrapper::createVertexBuffer(const std::vector<Vertex> &vertexData, VkBuffer &vertexBuffer,
-                                           VkDeviceMemory &vertexBufferMemory) {
-    VkDeviceSize bufferSize = sizeof(vertexData[0]) * vertexData.size();
-
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer,
-                 stagingBufferMemory);
-
-    void *data;
-    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, vertexData.data(), (size_t)bufferSize);
-    vkUnmapMemory(device, stagingBufferMemory);
-
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
-
-    copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
-}
-
-void GlfwVulkanWrapper::createIndexBuffer(const std::vector<uint32_t> &indices, VkBuffer &indexBuffer,
-                                          VkDeviceMemory &indexBufferMemory) {
-    VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
-
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer,
-                 stagingBufferMemory);
-
-    void *data;
-    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, indices.data(), (size_t)bufferSize);
-    vkUnmapMemory(device, stagingBufferMemory);
-
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory);
-
-    copyBuffer(stagingBuffer, indexBuffer, bufferSize);
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
-}
-
-void GlfwVulkanWrapper::createMeshUniformBuffers(UniformInfo &uniformInfo, VkDeviceSize bufferSize) {
+void GlfwVulkanWrapper::createMeshUniformBuffers(UniformInfo &uniformInfo, VkDeviceSize bufferSize,
+                                                 VkBufferUsageFlags usage) {
     uniformInfo.uniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-    uniformInfo.uniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
+    uniformInfo.uniformBufferAllocations.resize(MAX_FRAMES_IN_FLIGHT);
     uniformInfo.uniformBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
 
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                     uniformInfo.uniformBuffers[i], uniformInfo.uniformBuffersMemory[i]);
-        vkMapMemory(device, uniformInfo.uniformBuffersMemory[i], 0, bufferSize, 0,
-                    &uniformInfo.uniformBuffersMapped[i]);
+        createBuffer(bufferSize, usage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                     uniformInfo.uniformBuffers[i], uniformInfo.uniformBufferAllocations[i]);
+        // Host-visible blocks stay mapped.
+        uniformInfo.uniformBuffersMapped[i] = uniformInfo.uniformBufferAllocations[i].mapped;
     }
 }
 
@@ -1224,6 +1684,18 @@ void GlfwVulkanWrapper::createCommandBuffers() {
     if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
         throw std::runtime_error("Failed to allocate command buffers!");
     }
+
+    std::vector<VkCommandBuffer> secondaryBuffers(MAX_FRAMES_IN_FLIGHT);
+    allocInfo.level              = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+    allocInfo.commandBufferCount = static_cast<uint32_t>(secondaryBuffers.size());
+
+    if (vkAllocateCommandBuffers(device, &allocInfo, secondaryBuffers.data()) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate scene command buffers!");
+    }
+    sceneCommands.assign(MAX_FRAMES_IN_FLIGHT, {});
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+        sceneCommands[i].commandBuffer = secondaryBuffers[i];
+    }
 }
 
 void GlfwVulkanWrapper::recordCommandBuffer(const AppState &appState, VkCommandBuffer commandBuffer,
@@ -1249,66 +1721,232 @@ void GlfwVulkanWrapper::recordCommandBuffer(const AppState &appState, VkCommandB
     renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
     renderPassInfo.pClearValues    = clearValues.data();
 
-    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    // Pipelines are looked up each frame, as they follow the app state,
+    // but are only compiled once; see getPipeline.
+    VkPipeline graphPipeline = VK_NULL_HANDLE;
+    if (graphMesh.has_value() || !pinnedGraphs.empty()) {
+        PipelineVariant variant = {PipelineKind::PBR, appState.colorEffect, appState.numLights};
+        if (appState.wireframe) {
+            variant.kind = PipelineKind::WIREFRAME;
+        } else if (appState.pbrFragPipeline) {
+            variant.kind = PipelineKind::PBR2;
+        }
+        graphPipeline = getPipeline(variant, shownGraphPipeline);
+    }
+    VkPipeline floorPipeline = VK_NULL_HANDLE;
+    if (floorMesh.has_value() && appState.drawFloor) {
+        floorPipeline = getPipeline({PipelineKind::PBR, ColorEffect::None, appState.numLights}, shownFloorPipeline);
+    }
+    VkPipeline surfacePipeline = VK_NULL_HANDLE;
+    if (graphSurface.has_value()) {
+        PipelineKind kind = appState.wireframe ? PipelineKind::SURFACE_WIREFRAME : PipelineKind::SURFACE;
+        surfacePipeline   = getPipeline({kind, appState.colorEffect, appState.numLights}, shownSurfacePipeline);
+    }
+
+    // This frame's fence has signaled, so its scene commands are not in use.
+    // The surface's pixel error is a push constant, recorded with them.
+    SceneCommands &commands = sceneCommands[currentFrame];
+    if (commands.sceneVersion != sceneVersion || commands.graphPipeline != graphPipeline ||
+        commands.floorPipeline != floorPipeline || commands.surfacePipeline != surfacePipeline ||
+        (surfacePipeline != VK_NULL_HANDLE && commands.surfacePixelError != appState.lodPixelError)) {
+        recordSceneCommands(commands, graphPipeline, floorPipeline, surfacePipeline, appState.lodPixelError);
+    }
+
+    // Culling writes this frame's draw commands before the render pass
+    // reads them. Levels of detail are picked then too, so they follow the
+    // camera without re-recording the scene.
+    if (commands.numDraws > 0) {
+        CullConstants constants  = {};
+        constants.numDraws       = commands.numDraws;
+        constants.maxPixelError  = appState.lodPixelError;
+        constants.viewportHeight = static_cast<float>(swapChainInfo.swapChainExtent.height);
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 1,
+                                &indirectDraws.descriptorSets[currentFrame], 0, nullptr);
+        vkCmdPushConstants(commandBuffer, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants),
+                           &constants);
+        vkCmdDispatch(commandBuffer, IndirectDraws::workgroupCount(commands.numDraws), 1, 1);
+
+        VkMemoryBarrier barrier = {};
+        barrier.sType           = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask   = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask   = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+                             0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+    vkCmdExecuteCommands(commandBuffer, 1, &commands.commandBuffer);
+    vkCmdEndRenderPass(commandBuffer);
 
-    auto drawMesh = [commandBuffer, this](const IndexedMesh &mesh) {
-        VkBuffer vertexBuffers[] = {mesh.vertexBuffer};
-        VkDeviceSize offsets[]   = {0};
-        vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
-        vkCmdBindIndexBuffer(commandBuffer, mesh.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to record command buffer!");
+    }
+}
 
-        std::array<VkDescriptorSet, 2> descriptorSets = {sceneUniform.descriptorSets[currentFrame],
-                                                         mesh.descriptorSets[currentFrame]};
-        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0,
-                                static_cast<uint32_t>(descriptorSets.size()), descriptorSets.data(), 0, nullptr);
-        vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(mesh.indices.size()), 1, 0, 0, 0);
-    };
+void GlfwVulkanWrapper::recordSceneCommands(SceneCommands &commands, VkPipeline graphPipeline,
+                                            VkPipeline floorPipeline, VkPipeline surfacePipeline,
+                                            float surfacePixelError) {
+    VkCommandBuffer commandBuffer = commands.commandBuffer;
 
-    {
-        VkViewport viewport{};
-        viewport.x        = 0.0f;
-        viewport.y        = 0.0f;
-        viewport.width    = (float)swapChainInfo.swapChainExtent.width;
-        viewport.height   = (float)swapChainInfo.swapChainExtent.height;
-        viewport.minDepth = 0.0f;
-        viewport.maxDepth = 1.0f;
-        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
-
-        VkRect2D scissor{};
-        scissor.offset = {0, 0};
-        scissor.extent = swapChainInfo.swapChainExtent;
-        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+    // The framebuffer is left out so the commands work with any swapchain
+    // image; only the render pass has to match.
+    VkCommandBufferInheritanceInfo inheritanceInfo = {};
+    inheritanceInfo.sType                          = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass                     = renderPass;
+    inheritanceInfo.subpass                        = 0;
+    inheritanceInfo.framebuffer                    = VK_NULL_HANDLE;
 
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType                    = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags                    = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    beginInfo.pInheritanceInfo         = &inheritanceInfo;
+
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+        throw std::runtime_error("failed to begin recording scene command buffer!");
+    }
+
+    // Draws are ordered by pipeline and then geometry page, so each run
+    // that shares both is one indirect draw.
+    std::vector<std::pair<VkPipeline, const IndexedMesh *>> meshDraws;
+    if (graphPipeline != VK_NULL_HANDLE) {
         if (graphMesh.has_value()) {
-            VkPipeline pipeline;
-            if (appState.wireframe) {
-                pipeline = wireframePipeline;
-            } else if (appState.pbrFragPipeline) {
-                pipeline = pbr2Pipeline;
-            } else {
-                pipeline = pbrPipeline;
-            }
-            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-            drawMesh(graphMesh.value());
+            meshDraws.emplace_back(graphPipeline, &graphMesh.value());
+        }
+        for (const IndexedMesh &pinned : pinnedGraphs) {
+            meshDraws.emplace_back(graphPipeline, &pinned);
+        }
+    }
+    if (floorPipeline != VK_NULL_HANDLE) {
+        meshDraws.emplace_back(floorPipeline, &floorMesh.value());
+    }
+    std::stable_sort(meshDraws.begin(), meshDraws.end(), [](const auto &a, const auto &b) {
+        return std::make_pair(a.first, a.second->geometry.page) < std::make_pair(b.first, b.second->geometry.page);
+    });
+
+    // Each mesh cluster is a draw of its own, culled separately.
+    struct DrawRun {
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        uint32_t page       = MeshGeometry::NO_PAGE;
+        uint32_t firstDraw  = 0;
+        uint32_t numDraws   = 0;
+    };
+    std::vector<DrawObject> drawObjects;
+    std::vector<DrawRun> runs;
+    for (const auto &[pipeline, mesh] : meshDraws) {
+        if (runs.empty() || runs.back().pipeline != pipeline || runs.back().page != mesh->geometry.page) {
+            runs.push_back({pipeline, mesh->geometry.page, static_cast<uint32_t>(drawObjects.size()), 0});
         }
 
-        if (floorMesh.has_value() && appState.drawFloor) {
-            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pbrPipeline);
-            drawMesh(floorMesh.value());
+        for (const MeshCluster &cluster : mesh->metadata.clusters) {
+            if (cluster.lods[0].numIndices == 0) {
+                continue;
+            }
+            DrawObject object;
+            object.command.indexCount    = cluster.lods[0].numIndices;
+            object.command.instanceCount = 1;
+            object.command.firstIndex    = mesh->geometry.firstIndex + cluster.lods[0].firstIndex;
+            object.command.vertexOffset  = static_cast<int32_t>(mesh->geometry.firstVertex);
+            object.command.firstInstance = mesh->uniformSlot;
+            object.numLods               = cluster.numLods;
+            object.boundsMin             = glm::vec4(cluster.boundsMin, 1.0f);
+            object.boundsMax             = glm::vec4(cluster.boundsMax, 1.0f);
+            for (uint32_t lod = 0; lod < cluster.numLods; ++lod) {
+                object.lods[lod].firstIndex = mesh->geometry.firstIndex + cluster.lods[lod].firstIndex;
+                object.lods[lod].indexCount = cluster.lods[lod].numIndices;
+                object.lods[lod].error      = cluster.lods[lod].error;
+            }
+            drawObjects.push_back(object);
+            runs.back().numDraws++;
+        }
+    }
+    indirectDraws.writeObjects(currentFrame, drawObjects);
+
+    VkViewport viewport{};
+    viewport.x        = 0.0f;
+    viewport.y        = 0.0f;
+    viewport.width    = (float)swapChainInfo.swapChainExtent.width;
+    viewport.height   = (float)swapChainInfo.swapChainExtent.height;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+    VkRect2D scissor{};
+    scissor.offset = {0, 0};
+    scissor.extent = swapChainInfo.swapChainExtent;
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+    // Only the current graph samples its normal map; see ModelUniform.
+    const VkDescriptorSet normalMapSet = graphNormalMap.has_value() ? graphNormalMap->descriptorSet
+                                                                    : flatNormalMap.descriptorSet;
+
+    std::array<VkDescriptorSet, 3> descriptorSets = {sceneUniform.descriptorSets[currentFrame],
+                                                     modelStorage.descriptorSets[currentFrame], normalMapSet};
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0,
+                            static_cast<uint32_t>(descriptorSets.size()), descriptorSets.data(), 0, nullptr);
+
+    VkPipeline boundPipeline = VK_NULL_HANDLE;
+    uint32_t boundPage       = MeshGeometry::NO_PAGE;
+    for (const DrawRun &run : runs) {
+        if (run.numDraws == 0) {
+            continue;
+        }
+        if (run.pipeline != boundPipeline) {
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, run.pipeline);
+            boundPipeline = run.pipeline;
         }
+        if (run.page != boundPage) {
+            VkBuffer vertexBuffers[] = {geometryArena.vertexBuffer(run.page)};
+            VkDeviceSize offsets[]   = {0};
+            vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+            vkCmdBindIndexBuffer(commandBuffer, geometryArena.indexBuffer(run.page), 0, VK_INDEX_TYPE_UINT32);
+            boundPage = run.page;
+        }
+
+        vkCmdDrawIndexedIndirect(commandBuffer, indirectDraws.commandBuffers[currentFrame],
+                                 IndirectDraws::commandOffset(run.firstDraw), run.numDraws,
+                                 sizeof(VkDrawIndexedIndirectCommand));
     }
 
-    vkCmdEndRenderPass(commandBuffer);
+    // The surface is one draw of all its patches, each tessellated as
+    // finely as the view needs; see surface.tesc. The surface layout's
+    // push constants make it incompatible with the sets bound above.
+    if (surfacePipeline != VK_NULL_HANDLE) {
+        std::array<VkDescriptorSet, 4> surfaceSets = {sceneUniform.descriptorSets[currentFrame],
+                                                      modelStorage.descriptorSets[currentFrame], normalMapSet,
+                                                      graphSurface->descriptorSet};
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, surfacePipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, surfacePipelineLayout, 0,
+                                static_cast<uint32_t>(surfaceSets.size()), surfaceSets.data(), 0, nullptr);
+
+        SurfaceConstants constants = {};
+        constants.maxPixelError    = surfacePixelError;
+        constants.viewportHeight   = viewport.height;
+        vkCmdPushConstants(commandBuffer, surfacePipelineLayout, VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT, 0,
+                           sizeof(constants), &constants);
+
+        constexpr uint32_t NUM_PATCHES = HeightField::PATCHES * HeightField::PATCHES;
+        vkCmdDraw(commandBuffer, 4 * NUM_PATCHES, 1, 0, graphMesh->uniformSlot);
+    }
 
     if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
-        throw std::runtime_error("failed to record command buffer!");
+        throw std::runtime_error("failed to record scene command buffer!");
     }
+
+    commands.sceneVersion      = sceneVersion;
+    commands.graphPipeline     = graphPipeline;
+    commands.floorPipeline     = floorPipeline;
+    commands.surfacePipeline   = surfacePipeline;
+    commands.surfacePixelError = surfacePixelError;
+    commands.numDraws          = static_cast<uint32_t>(drawObjects.size());
 }
 
 void GlfwVulkanWrapper::createSyncObjects() {
     imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
     renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
     inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+    deferredDestruction.resize(MAX_FRAMES_IN_FLIGHT);
     imagesInFlight.resize(swapChainInfo.swapchainImages.size(), VK_NULL_HANDLE);
 
     VkSemaphoreCreateInfo semaphoreCreateInfo = {};
@@ -1336,8 +1974,8 @@ void GlfwVulkanWrapper::createSyncObjects() {
 // Cleanup methods.
 
 void GlfwVulkanWrapper::cleanupSwapChain() {
-    colorImageInfo.destroy(device);
-    depthImageInfo.destroy(device);
+    colorImageInfo.destroy(device, allocator);
+    depthImageInfo.destroy(device, allocator);
 
     for (auto swapchainFramebuffer : swapChainInfo.swapchainFramebuffers) {
         vkDestroyFramebuffer(device, swapchainFramebuffer, nullptr);
@@ -9,10 +9,28 @@
 #include <vulkan/vulkan_core.h>
 
 #include "app_state.h"
+#include "device_allocator.h"
+#include "geometry_arena.h"
+#include "height_field.h"
+#include "indirect_draws.h"
 #include "mesh.h"
-
+#include "mesh_upload.h"
+#include "normal_map_texture.h"
+#include "pipeline_cache.h"
+#include "scheduler.h"
+#include "surface_textures.h"
+#include "transfer_queue.h"
+
+#include <array>
+#include <atomic>
+#include <compare>
 #include <cstdint>
 #include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
 #include <vector>
 
 // A first version of abstracting over the Vulkan interface as a component
@@ -39,6 +57,19 @@ private:
     VkQueue graphicsQueue;
     VkQueue presentQueue;
 
+    // Sub-allocates memory for all buffers and images.
+    DeviceAllocator allocator;
+
+    // Mesh uploads from the builder thread. On devices without a second
+    // queue this shares graphicsQueue.
+    TransferQueue transferQueue;
+    bool transferSharesGraphicsQueue = false;
+    // Held by transfer submissions; see lockGraphicsQueue.
+    std::mutex queueMutex;
+
+    // Graphs can be drawn as tessellated surfaces; see SurfaceTextures.
+    bool tessellationSupported = false;
+
     SwapChainInfo swapChainInfo;
     VkRenderPass renderPass;
 
@@ -47,10 +78,79 @@ private:
     // Image for depth buffer;
     ImageInfo depthImageInfo;
 
+    // Fixed-function state shared by the graphics pipelines, kept so that
+    // pipelines can also be created after startup. The create infos point
+    // into the struct, so it must not be copied.
+    struct PipelineStates {
+        VkVertexInputBindingDescription bindingDescription;
+        std::array<VkVertexInputAttributeDescription, 5> attributeDescriptions;
+        VkPipelineVertexInputStateCreateInfo vertexInputInfo;
+        VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo;
+        // Surface pipelines have no vertex input and draw quad patches.
+        VkPipelineVertexInputStateCreateInfo surfaceVertexInputInfo;
+        VkPipelineInputAssemblyStateCreateInfo patchInputAssemblyInfo;
+        VkPipelineTessellationStateCreateInfo tessellationInfo;
+        VkPipelineViewportStateCreateInfo viewPortInfo;
+        VkPipelineRasterizationStateCreateInfo rasterizerInfo;
+        VkPipelineMultisampleStateCreateInfo multisamplingInfo;
+        VkPipelineDepthStencilStateCreateInfo depthStencilInfo;
+        VkPipelineColorBlendAttachmentState colorBlendAttachment;
+        VkPipelineColorBlendStateCreateInfo colorBlendingInfo;
+        std::array<VkDynamicState, 2> dynamicStates;
+        VkPipelineDynamicStateCreateInfo dynamicState;
+    };
+
+    enum class PipelineKind : uint8_t {
+        WIREFRAME = 0,
+        PBR       = 1,
+        PBR2      = 2,
+        // Tessellated height field surfaces, shaded like PBR2.
+        SURFACE           = 3,
+        SURFACE_WIREFRAME = 4,
+    };
+
+    // Shader options compiled into a pipeline as specialization constants,
+    // so the driver folds them instead of branching on them per fragment.
+    struct PipelineVariant {
+        PipelineKind kind;
+        // Only used by PBR2 and the surface kinds.
+        ColorEffect colorEffect = ColorEffect::None;
+        // Unused by WIREFRAME.
+        int numLights = 2;
+
+        auto operator<=>(const PipelineVariant &) const = default;
+
+        // Resets the options kind does not use, so that variants that only
+        // differ in those share a pipeline.
+        PipelineVariant normalized() const;
+    };
+
+    PipelineCache pipelineCache;
+    PipelineStates pipelineStates;
+    // Scene uniform, model storage and normal map sets.
     VkPipelineLayout pipelineLayout;
-    VkPipeline wireframePipeline;
-    VkPipeline pbrPipeline;
-    VkPipeline pbr2Pipeline;
+    // Adds the surface textures' set and push constants to pipelineLayout.
+    VkPipelineLayout surfacePipelineLayout = VK_NULL_HANDLE;
+    // Compiled on first use; see getPipeline.
+    std::map<PipelineVariant, VkPipeline> pipelines;
+    // A variant compiling in the background. The task sets pipeline, left
+    // null if compiling failed, then done.
+    struct PipelineCompile {
+        VkPipeline pipeline    = VK_NULL_HANDLE;
+        std::atomic<bool> done = false;
+    };
+    // Variants not yet in pipelines. A failed one stays, so it isn't retried.
+    std::map<PipelineVariant, std::shared_ptr<PipelineCompile>> pipelineCompiles;
+    jobs::TaskGroup pipelineCompileTasks;
+    // Last pipelines drawn with, which keep drawing while newly selected
+    // variants compile.
+    VkPipeline shownGraphPipeline   = VK_NULL_HANDLE;
+    VkPipeline shownFloorPipeline   = VK_NULL_HANDLE;
+    VkPipeline shownSurfacePipeline = VK_NULL_HANDLE;
+
+    // Frustum culls the scene's draws; see IndirectDraws.
+    VkPipelineLayout cullPipelineLayout;
+    VkPipeline cullPipeline;
 
     enum class MeshStage : uint8_t {
         DRAW_FLOOR = 0,
@@ -61,11 +161,69 @@ private:
     VkCommandPool commandPool;
     std::vector<VkCommandBuffer> commandBuffers;
 
+    // Scene draws, recorded into a secondary command buffer per frame in
+    // flight and replayed until something they depend on changes.
+    struct SceneCommands {
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        // What the commands were recorded with.
+        uint64_t sceneVersion      = 0;
+        VkPipeline graphPipeline   = VK_NULL_HANDLE;
+        VkPipeline floorPipeline   = VK_NULL_HANDLE;
+        VkPipeline surfacePipeline = VK_NULL_HANDLE;
+        float surfacePixelError    = 0.0f;
+        // Draws listed for culling.
+        uint32_t numDraws = 0;
+    };
+    std::vector<SceneCommands> sceneCommands;
+    // Bumped when meshes or the swapchain change, which invalidates all
+    // recorded scene commands.
+    uint64_t sceneVersion = 1;
+
     SceneInfo sceneUniform;
-    DescriptorSetLayout descriptorSetLayout;
+    ModelStorage modelStorage;
+    IndirectDraws indirectDraws;
+    // Vertices and indices of all meshes.
+    GeometryArena geometryArena;
+
     std::optional<IndexedMesh> graphMesh;
+    // Earlier graphs kept in the scene to compare with the current one.
+    // They are drawn like graphMesh and move with it.
+    std::vector<IndexedMesh> pinnedGraphs;
     std::optional<IndexedMesh> floorMesh;
 
+    // Set while graphMesh is drawn as a tessellated surface, in which case
+    // the mesh has no geometry of its own.
+    std::optional<SurfaceTextures> graphSurface;
+    SurfaceDescriptors surfaceDescriptors;
+
+    // Shades graphMesh when set; see NormalMap. Other meshes are bound
+    // flatNormalMap, which their shaders ignore.
+    std::optional<NormalMapTexture> graphNormalMap;
+    NormalMapTexture flatNormalMap;
+    NormalMapDescriptors normalMapDescriptors;
+
+    // Graph mesh to show once its upload completes; see promotePendingGraph.
+    // It has either an upload or surface textures, and may have a normal map.
+    struct PendingMesh {
+        IndexedMesh mesh;
+        std::optional<MeshUpload> upload;
+        std::optional<SurfaceTextures> surface;
+        std::optional<NormalMapTexture> normalMap;
+    };
+    std::optional<PendingMesh> pendingGraph;
+    // Normal map for the graph already shown, swapped in once uploaded; see
+    // attachGraphNormalMap.
+    std::optional<NormalMapTexture> pendingNormalMap;
+    // Transfer timeline value by which the buffers of shown meshes were written.
+    uint64_t meshesReadyValue = 0;
+    // Uploads superseded before they were shown, freed once their copies end.
+    std::vector<MeshUpload> retiredUploads;
+    std::vector<SurfaceTextures> retiredSurfaces;
+    std::vector<NormalMapTexture> retiredNormalMaps;
+    // Destroys resources that frames in flight may still use. Indexed by
+    // frame; each runs once that frame's fence has signaled again.
+    std::vector<std::vector<std::function<void()>>> deferredDestruction;
+
     uint32_t imageCount                 = 0;
     uint32_t currentFrame               = 0;
     const uint32_t MAX_FRAMES_IN_FLIGHT = 2;
@@ -95,12 +253,37 @@ public:
     // Initialization functions.
     void init(GLFWwindow *window, uint32_t windowWidth, uint32_t windowHeight);
 
-    void initSceneUniform();
-    void initMesh(IndexedMesh &mesh);
+    static constexpr size_t MAX_PINNED_GRAPHS = 64;
 
-    // This moves out of meshData members and takes ownership of data.
-    void updateGraphAndFloorMeshes(std::array<IndexedMesh, 2> &meshData);
-    void updateMesh(IndexedMesh &newMesh, IndexedMesh &currentMesh);
+    void initSceneUniform();
+    void initModelStorage();
+    void initIndirectDraws();
+    void initSurfaceDescriptors();
+    void initNormalMaps();
+    // Uses the geometry of upload if given, else uploads the mesh data.
+    void initMesh(IndexedMesh &mesh, MeshUpload *upload = nullptr);
+
+    // This moves out of meshData members and takes ownership of data. The
+    // graph mesh replaces the current one once graphUpload has completed,
+    // without stalling rendering. The floor never changes, so it is only
+    // uploaded the first time. If normalMap is given the graph is shaded
+    // with it instead of its vertex normals.
+    void updateGraphAndFloorMeshes(std::array<IndexedMesh, 2> &meshData, MeshUpload &&graphUpload,
+                                   const std::optional<NormalMap> &normalMap);
+    // As above, but the graph, which has no geometry, is drawn as a
+    // tessellated surface of field once its textures are uploaded.
+    // Precondition: supportsTessellation().
+    void updateGraphAndFloorMeshes(std::array<IndexedMesh, 2> &meshData, const HeightField &field,
+                                   const std::optional<NormalMap> &normalMap);
+    // Shades the graph last passed to updateGraphAndFloorMeshes with
+    // normalMap once it is uploaded, whether or not that graph is shown yet.
+    // For a graph built without one; the graph is left as it is.
+    void attachGraphNormalMap(const NormalMap &normalMap);
+    // Shades the graph with its vertex normals again, dropping any map it
+    // has or is getting.
+    void detachGraphNormalMap();
+    // Frees an upload that will not be shown once its copies complete.
+    void retireUpload(MeshUpload &&upload);
 
     void setUIDeinitCallback(const std::function<DeinitUICallback> &inUiDeinitCallback) {
         uiDeinitCallback = inUiDeinitCallback;
@@ -137,6 +320,13 @@ public:
     const QueueFamilyIndices &getQueueIndices() {
         return queueIndices;
     }
+    bool supportsTessellation() const {
+        return tessellationSupported;
+    }
+    // For uploads from one background thread at a time.
+    GeometryArena &getGeometryArena() {
+        return geometryArena;
+    }
 
     ImGui_ImplVulkan_InitInfo imGuiInitInfo(VkDescriptorPool uiDescriptorPool, VkRenderPass uiRenderPass);
 
@@ -145,14 +335,29 @@ private:
     std::vector<const char *> getRequiredExtensions() const;
     bool isDeviceSuitable(VkPhysicalDevice device);
     SwapchainConfig querySwapchainSupport(const VkPhysicalDevice &device);
-    VkShaderModule createShaderModule(const std::vector<char> &shaderCode);
-    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+    VkShaderModule createShaderModule(std::span<const uint32_t> shaderCode);
     VkSampleCountFlagBits getMaxUsableSampleCount();
 
     // Buffer management helpers.
     void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer &buffer,
-                      VkDeviceMemory &bufferMemory);
-    void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
+                      DeviceAllocation &allocation);
+    void createMeshBuffers(IndexedMesh &mesh, MeshUpload *upload);
+
+    // Locks queueMutex if the transfer queue shares the graphics queue.
+    std::unique_lock<std::mutex> lockGraphicsQueue();
+
+    // Mesh replacement helpers, used at the start of each frame.
+    // Starts uploading normalMap, if given.
+    std::optional<NormalMapTexture> createNormalMapTexture(const std::optional<NormalMap> &normalMap);
+    void setPendingGraph(std::array<IndexedMesh, 2> &meshData, PendingMesh &&pending);
+    // Replaces graphNormalMap, destroying the old one once no frame uses it.
+    void setGraphNormalMap(std::optional<NormalMapTexture> &&normalMap);
+    void promotePendingGraph();
+    void updatePinnedGraphs(AppState &appState);
+    // Frees a mesh's geometry and model slot once frames in flight are done with them.
+    void retireMesh(IndexedMesh &mesh);
+    void deferDestruction(std::function<void()> destroy);
+    void runDeferredDestruction(uint32_t frame);
 
     // Swap chain creation helpers.
     VkExtent2D pickSwapchainExtent(const VkSurfaceCapabilitiesKHR &surfaceCapabilities);
@@ -162,7 +367,7 @@ private:
     // Image creation helpers.
     void createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples,
                      VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties,
-                     VkImage &image, VkDeviceMemory &imageMemory);
+                     VkImage &image, DeviceAllocation &allocation);
     VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels);
 
     VkFormat findDepthFormat();
@@ -174,27 +379,46 @@ private:
     void pickPhysicalDevice();
     void getDeviceQueueIndices();
     void createLogicalDevice();
+    void createTransferQueue();
 
     // Setup methods that use the logical device.
     void createSwapchain();
     void createImageViews();
     void createRenderPass();
     void createGraphicsPipelines();
+    void createPipelineStates();
+    struct ShaderStage {
+        VkShaderStageFlagBits stage;
+        std::span<const uint32_t> code;
+    };
+    // Thread safe, so pipelines can be compiled concurrently. Pipelines
+    // with tessellation stages draw surfaces; see PipelineStates.
+    VkPipeline createGraphicsPipeline(std::span<const ShaderStage> stages, VkPolygonMode polygonMode,
+                                      const VkSpecializationInfo *specialization);
+    VkPipeline createPipeline(const PipelineVariant &variant);
+    // Sets shown to the pipeline for variant and returns it if it is
+    // compiled. Otherwise starts compiling it in the background, if this is
+    // its first use, and returns shown unchanged, so frames keep drawing
+    // with the previous pipeline meanwhile; VK_NULL_HANDLE skips the draw.
+    // Render thread only.
+    VkPipeline getPipeline(const PipelineVariant &variant, VkPipeline &shown);
+    void createCullPipeline();
 
     void createFramebuffers();
     void createCommandPool();
     void createColorResources();
     void createDepthResources();
 
-    // Mesh buffer creation helpers.
-    void createVertexBuffer(const std::vector<Vertex> &vertexData, VkBuffer &vertexBuffer,
-                            VkDeviceMemory &vertexBufferMemory);
-    void createIndexBuffer(const std::vector<uint32_t> &indices, VkBuffer &indexBuffer,
-                           VkDeviceMemory &indexBufferMemory);
-    void createMeshUniformBuffers(UniformInfo &uniformInfo, VkDeviceSize bufferSize);
+    // Creates a mapped host-visible buffer for each frame in flight.
+    void createMeshUniformBuffers(UniformInfo &uniformInfo, VkDeviceSize bufferSize,
+                                  VkBufferUsageFlags usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
 
     void createCommandBuffers();
     void createSyncObjects();
+    // Lists the scene's draws for culling and records them into commands,
+    // for the current frame. Null pipelines skip their meshes.
+    void recordSceneCommands(SceneCommands &commands, VkPipeline graphPipeline, VkPipeline floorPipeline,
+                             VkPipeline surfacePipeline, float surfacePixelError);
 
     // Cleanup methods.
     void cleanupSwapChain();